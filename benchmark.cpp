@@ -0,0 +1,551 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "benchmark.hpp"
+
+#include <nvh/nvprint.hpp>
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace dynlod {
+
+static const char* s_sectionNames[SectionTimers::NUM_SECTIONS] = {
+    "Frame", "Lod", "Cont", "Bin", "Cmds", "Draw", "Tess", "Mesh", "Impo", "Pnts", "HiZ", "Slots",
+};
+
+const char* SectionTimers::getName(int section)
+{
+  return s_sectionNames[section];
+}
+
+int SectionTimers::findSection(const char* name)
+{
+  for(int i = 0; i < NUM_SECTIONS; i++)
+  {
+    if(strcmp(name, s_sectionNames[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+SectionTimers::Scope::Scope(SectionTimers& timers, const char* name)
+    : m_timers(timers)
+    , m_query(~0u)
+{
+  if(!timers.m_enabled)
+    return;
+
+  Frame& frame   = timers.m_frames[timers.m_current];
+  int    section = findSection(name);
+  if(section < 0 || frame.used + 2 > MAX_QUERIES)
+    return;
+
+  // reserve begin and end query, sections can be nested
+  m_query = frame.used;
+  frame.used += 2;
+  frame.sections[m_query / 2] = uint8_t(section);
+  frame.last                  = m_query;
+  glQueryCounter(frame.queries[m_query], GL_TIMESTAMP);
+}
+
+SectionTimers::Scope::~Scope()
+{
+  if(m_query == ~0u)
+    return;
+
+  Frame& frame = m_timers.m_frames[m_timers.m_current];
+  frame.last   = m_query + 1;
+  glQueryCounter(frame.queries[m_query + 1], GL_TIMESTAMP);
+}
+
+void SectionTimers::init()
+{
+  m_frames.resize(FRAMES);
+  for(auto& frame : m_frames)
+  {
+    glGenQueries(MAX_QUERIES, frame.queries);
+    frame.used    = 0;
+    frame.pending = false;
+  }
+  m_current = 0;
+}
+
+void SectionTimers::deinit()
+{
+  for(auto& frame : m_frames)
+  {
+    glDeleteQueries(MAX_QUERIES, frame.queries);
+  }
+  m_frames.clear();
+  m_results.clear();
+}
+
+void SectionTimers::collect(Frame& frame)
+{
+  Result result;
+  for(int i = 0; i < NUM_SECTIONS; i++)
+  {
+    result.microseconds[i] = 0;
+  }
+
+  // jobs can repeat sections, their times are accumulated
+  for(uint32_t q = 0; q < frame.used; q += 2)
+  {
+    GLuint64 begin;
+    GLuint64 end;
+    glGetQueryObjectui64v(frame.queries[q], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(frame.queries[q + 1], GL_QUERY_RESULT, &end);
+    result.microseconds[frame.sections[q / 2]] += double(end - begin) / 1000.0;
+  }
+
+  m_results.push_back(result);
+  m_latest = result;
+  m_collected++;
+  frame.used    = 0;
+  frame.pending = false;
+}
+
+void SectionTimers::beginFrame()
+{
+  if(m_frames.empty())
+    return;
+
+  if(m_frames[m_current].used)
+  {
+    m_frames[m_current].pending = true;
+  }
+
+  // collect oldest frames first, stop at the first one not yet available
+  for(uint32_t i = 1; i <= FRAMES; i++)
+  {
+    Frame& frame = m_frames[(m_current + i) % FRAMES];
+    if(!frame.pending)
+      continue;
+
+    GLint available = 0;
+    glGetQueryObjectiv(frame.queries[frame.last], GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available)
+      break;
+
+    collect(frame);
+  }
+
+  m_current = (m_current + 1) % FRAMES;
+
+  // ring is full, we have to wait for the frame we reuse
+  Frame& next = m_frames[m_current];
+  if(next.pending)
+  {
+    collect(next);
+  }
+  next.used = 0;
+}
+
+bool SectionTimers::popResult(Result& result)
+{
+  if(m_results.empty())
+    return false;
+
+  result = m_results.front();
+  m_results.erase(m_results.begin());
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void SweepBenchmark::addVariable(const char* name, Setter setter)
+{
+  Variable var;
+  var.name   = name;
+  var.setter = setter;
+  m_variables.push_back(var);
+}
+
+void SweepBenchmark::addCounter(const char* name, Counter counter)
+{
+  NamedCounter named;
+  named.name    = name;
+  named.counter = counter;
+  m_counters.push_back(named);
+}
+
+bool SweepBenchmark::setup(const std::string& spec, uint32_t warmupFrames, uint32_t recordFrames, const std::string& outputFile)
+{
+  m_dimensions.clear();
+  m_rows.clear();
+
+  size_t start = 0;
+  while(start < spec.size())
+  {
+    size_t end = spec.find(';', start);
+    if(end == std::string::npos)
+      end = spec.size();
+
+    std::string entry = spec.substr(start, end - start);
+    start             = end + 1;
+    if(entry.empty())
+      continue;
+
+    size_t assign = entry.find('=');
+    if(assign == std::string::npos)
+    {
+      LOGE("sweep: missing '=' in \"%s\"\n", entry.c_str());
+      return false;
+    }
+
+    std::string name = entry.substr(0, assign);
+    Dimension   dim;
+    dim.variable = -1;
+    for(size_t i = 0; i < m_variables.size(); i++)
+    {
+      if(m_variables[i].name == name)
+        dim.variable = int(i);
+    }
+    if(dim.variable < 0)
+    {
+      LOGE("sweep: unknown variable \"%s\"\n", name.c_str());
+      return false;
+    }
+
+    const char* values = entry.c_str() + assign + 1;
+    while(*values)
+    {
+      char* next;
+      long  value = strtol(values, &next, 0);
+      if(next == values)
+      {
+        LOGE("sweep: invalid value in \"%s\"\n", entry.c_str());
+        return false;
+      }
+      dim.values.push_back(int(value));
+      values = *next == ',' ? next + 1 : next;
+    }
+    if(dim.values.empty())
+    {
+      LOGE("sweep: no values for \"%s\"\n", name.c_str());
+      return false;
+    }
+    m_dimensions.push_back(dim);
+  }
+
+  if(m_dimensions.empty())
+  {
+    LOGE("sweep: empty configuration\n");
+    return false;
+  }
+
+  m_numConfigs = 1;
+  for(auto& dim : m_dimensions)
+  {
+    m_numConfigs *= uint32_t(dim.values.size());
+  }
+
+  // results of the previous configuration must have left the timer ring
+  m_warmupFrames = std::max(warmupFrames, 8u);
+  m_recordFrames = std::max(recordFrames, 1u);
+  m_outputFile   = outputFile;
+  m_selector     = nullptr;
+  m_config       = 0;
+  m_state        = STATE_APPLY;
+
+  LOGI("sweep: %d configurations, %d warmup, %d recorded frames\n", m_numConfigs, m_warmupFrames, m_recordFrames);
+
+  return true;
+}
+
+bool SweepBenchmark::setup(const std::string& spec, uint32_t warmupFrames, uint32_t recordFrames, Selector selector)
+{
+  if(!setup(spec, warmupFrames, recordFrames, std::string()))
+    return false;
+
+  m_selector = selector;
+  return true;
+}
+
+void SweepBenchmark::applyConfig(uint32_t config)
+{
+  m_configValues.resize(m_dimensions.size());
+
+  // first dimension varies slowest
+  for(size_t d = m_dimensions.size(); d-- > 0;)
+  {
+    const Dimension& dim = m_dimensions[d];
+    uint32_t         num = uint32_t(dim.values.size());
+    m_configValues[d]    = dim.values[config % num];
+    config /= num;
+
+    m_variables[dim.variable].setter(m_configValues[d]);
+  }
+
+  std::string label;
+  for(size_t d = 0; d < m_dimensions.size(); d++)
+  {
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%s%s=%d", d ? " " : "", m_variables[m_dimensions[d].variable].name.c_str(),
+             m_configValues[d]);
+    label += buffer;
+  }
+  LOGI("sweep: config %d/%d: %s\n", m_config + 1, m_numConfigs, label.c_str());
+}
+
+void SweepBenchmark::finishConfig()
+{
+  Row row;
+  row.values = m_configValues;
+
+  std::vector<double> times(m_samples.size());
+  for(int s = 0; s < SectionTimers::NUM_SECTIONS; s++)
+  {
+    double sum = 0;
+    for(size_t i = 0; i < m_samples.size(); i++)
+    {
+      times[i] = m_samples[i].microseconds[s];
+      sum += times[i];
+    }
+    std::sort(times.begin(), times.end());
+
+    // nearest-rank percentiles
+    size_t n             = times.size();
+    row.sections[s].mean = sum / double(n);
+    row.sections[s].p50  = times[std::min(n - 1, (n * 50 + 99) / 100 - 1)];
+    row.sections[s].p99  = times[std::min(n - 1, (n * 99 + 99) / 100 - 1)];
+  }
+
+  for(double sum : m_counterSums)
+  {
+    row.counters.push_back(m_counterFrames ? sum / double(m_counterFrames) : 0.0);
+  }
+
+  m_rows.push_back(row);
+  m_samples.clear();
+}
+
+bool SweepBenchmark::writeOutput() const
+{
+  FILE* file = fopen(m_outputFile.c_str(), "wt");
+  if(!file)
+  {
+    LOGE("sweep: could not write %s\n", m_outputFile.c_str());
+    return false;
+  }
+
+  bool json = m_outputFile.size() >= 5 && m_outputFile.compare(m_outputFile.size() - 5, 5, ".json") == 0;
+
+  if(json)
+  {
+    fprintf(file, "[\n");
+    for(size_t r = 0; r < m_rows.size(); r++)
+    {
+      const Row& row = m_rows[r];
+      fprintf(file, "  {");
+      for(size_t d = 0; d < m_dimensions.size(); d++)
+      {
+        fprintf(file, "\"%s\": %d, ", m_variables[m_dimensions[d].variable].name.c_str(), row.values[d]);
+      }
+      fprintf(file, "\"us\": {");
+      for(int s = 0; s < SectionTimers::NUM_SECTIONS; s++)
+      {
+        fprintf(file, "%s\"%s\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f}", s ? ", " : "",
+                SectionTimers::getName(s), row.sections[s].mean, row.sections[s].p50, row.sections[s].p99);
+      }
+      fprintf(file, "}, \"counters\": {");
+      for(size_t c = 0; c < m_counters.size(); c++)
+      {
+        fprintf(file, "%s\"%s\": %.1f", c ? ", " : "", m_counters[c].name.c_str(), row.counters[c]);
+      }
+      fprintf(file, "}}%s\n", r + 1 < m_rows.size() ? "," : "");
+    }
+    fprintf(file, "]\n");
+  }
+  else
+  {
+    for(size_t d = 0; d < m_dimensions.size(); d++)
+    {
+      fprintf(file, "%s,", m_variables[m_dimensions[d].variable].name.c_str());
+    }
+    for(int s = 0; s < SectionTimers::NUM_SECTIONS; s++)
+    {
+      const char* name = SectionTimers::getName(s);
+      fprintf(file, "%s_mean,%s_p50,%s_p99", name, name, name);
+      fprintf(file, s + 1 < SectionTimers::NUM_SECTIONS || !m_counters.empty() ? "," : "\n");
+    }
+    for(size_t c = 0; c < m_counters.size(); c++)
+    {
+      fprintf(file, "%s%s", m_counters[c].name.c_str(), c + 1 < m_counters.size() ? "," : "\n");
+    }
+    for(const Row& row : m_rows)
+    {
+      for(size_t d = 0; d < m_dimensions.size(); d++)
+      {
+        fprintf(file, "%d,", row.values[d]);
+      }
+      for(int s = 0; s < SectionTimers::NUM_SECTIONS; s++)
+      {
+        fprintf(file, "%.3f,%.3f,%.3f", row.sections[s].mean, row.sections[s].p50, row.sections[s].p99);
+        fprintf(file, s + 1 < SectionTimers::NUM_SECTIONS || !m_counters.empty() ? "," : "\n");
+      }
+      for(size_t c = 0; c < row.counters.size(); c++)
+      {
+        fprintf(file, "%.1f%s", row.counters[c], c + 1 < row.counters.size() ? "," : "\n");
+      }
+    }
+  }
+
+  fclose(file);
+  LOGI("sweep: wrote %s\n", m_outputFile.c_str());
+  return true;
+}
+
+SweepBenchmark::Action SweepBenchmark::frame(SectionTimers& timers)
+{
+  SectionTimers::Result result;
+
+  switch(m_state)
+  {
+    case STATE_APPLY:
+      applyConfig(m_config);
+      timers.clearResults();
+      m_frame         = 0;
+      m_counterFrames = 0;
+      m_counterSums.assign(m_counters.size(), 0.0);
+      m_state = STATE_WARMUP;
+      return ACTION_APPLIED;
+
+    case STATE_WARMUP:
+      while(timers.popResult(result))
+      {
+      }
+      if(++m_frame >= m_warmupFrames)
+      {
+        m_state = STATE_RECORD;
+      }
+      return ACTION_NONE;
+
+    case STATE_RECORD:
+      while(m_samples.size() < m_recordFrames && timers.popResult(result))
+      {
+        m_samples.push_back(result);
+      }
+      for(size_t c = 0; c < m_counters.size(); c++)
+      {
+        m_counterSums[c] += m_counters[c].counter();
+      }
+      m_counterFrames++;
+      if(m_samples.size() < m_recordFrames)
+        return ACTION_NONE;
+
+      finishConfig();
+      if(++m_config < m_numConfigs)
+      {
+        m_state = STATE_APPLY;
+        return ACTION_NONE;
+      }
+
+      if(!m_outputFile.empty())
+      {
+        writeOutput();
+      }
+      if(m_selector)
+      {
+        m_selector(m_rows);
+      }
+      m_state = STATE_INACTIVE;
+      return ACTION_FINISHED;
+
+    default:
+      return ACTION_NONE;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void Autotuner::clearTasks()
+{
+  m_tasks.clear();
+  m_sweep = SweepBenchmark();
+}
+
+void Autotuner::addTask(const char* name, int section, const std::vector<int>& candidates, Setter setter)
+{
+  Task task;
+  task.name       = name;
+  task.section    = section;
+  task.candidates = candidates;
+  task.setter     = setter;
+  m_tasks.push_back(task);
+  m_sweep.addVariable(name, setter);
+}
+
+bool Autotuner::start(uint32_t warmupFrames, uint32_t recordFrames)
+{
+  if(m_tasks.empty() || recordFrames == 0)
+    return false;
+
+  m_warmupFrames = warmupFrames;
+  m_recordFrames = recordFrames;
+  m_task         = 0;
+  LOGI("autotune: %d tasks, %d warmup, %d recorded frames\n", int(m_tasks.size()), m_warmupFrames, m_recordFrames);
+  return startTask();
+}
+
+bool Autotuner::startTask()
+{
+  const Task& task = m_tasks[m_task];
+
+  std::string spec = task.name + "=";
+  for(size_t c = 0; c < task.candidates.size(); c++)
+  {
+    spec += (c ? "," : "") + std::to_string(task.candidates[c]);
+  }
+  return m_sweep.setup(spec, m_warmupFrames, m_recordFrames,
+                       [this, &task](const std::vector<SweepBenchmark::Row>& rows) { selectCandidate(task, rows); });
+}
+
+void Autotuner::selectCandidate(const Task& task, const std::vector<SweepBenchmark::Row>& rows)
+{
+  size_t best = 0;
+  for(size_t r = 0; r < rows.size(); r++)
+  {
+    LOGI("autotune: %s %d: %.1f us\n", task.name.c_str(), rows[r].values[0], rows[r].sections[task.section].mean);
+    if(rows[r].sections[task.section].mean < rows[best].sections[task.section].mean)
+    {
+      best = r;
+    }
+  }
+  LOGI("autotune: %s keeps %d\n", task.name.c_str(), rows[best].values[0]);
+  task.setter(rows[best].values[0]);
+}
+
+Autotuner::Action Autotuner::frame(SectionTimers& timers)
+{
+  Action action = m_sweep.frame(timers);
+  if(action != SweepBenchmark::ACTION_FINISHED)
+    return action;
+
+  // the next task is timed with the kept value of this one
+  if(++m_task < m_tasks.size() && startTask())
+    return SweepBenchmark::ACTION_APPLIED;
+
+  return SweepBenchmark::ACTION_FINISHED;
+}
+
+}  // namespace dynlod
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <nvgl/extensions_gl.hpp>
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace dynlod {
+
+// Per-frame GL timestamps for the sections of interest. Unlike the
+// profiler's averages this keeps every frame, so distributions can be
+// computed. Results are read a few frames later without stalling.
+
+class SectionTimers
+{
+public:
+  enum Section
+  {
+    SECTION_FRAME,
+    SECTION_LOD,
+    SECTION_CONT,
+    SECTION_BIN,
+    SECTION_CMDS,
+    SECTION_DRAW,
+    SECTION_TESS,
+    SECTION_MESH,
+    SECTION_IMPOSTOR,
+    SECTION_PNTS,
+    SECTION_HIZ,
+    SECTION_SLOTS,
+    NUM_SECTIONS,
+  };
+
+  struct Result
+  {
+    double microseconds[NUM_SECTIONS];
+  };
+
+  class Scope
+  {
+  public:
+    Scope(SectionTimers& timers, const char* name);
+    ~Scope();
+
+  private:
+    SectionTimers& m_timers;
+    uint32_t       m_query;
+  };
+
+  static const char* getName(int section);
+  static int         findSection(const char* name);
+
+  void init();
+  void deinit();
+
+  // disabled timers issue no queries
+  void setEnabled(bool state) { m_enabled = state; }
+  bool isEnabled() const { return m_enabled; }
+
+  // retires the current frame and collects completed ones
+  void beginFrame();
+  bool popResult(Result& result);
+  void clearResults() { m_results.clear(); }
+
+  // most recent result regardless of popping, the counter tells when
+  // a new one arrived
+  const Result& getLatest() const { return m_latest; }
+  uint32_t      getCollected() const { return m_collected; }
+
+private:
+  static const uint32_t FRAMES      = 4;
+  static const uint32_t MAX_QUERIES = 2048;
+
+  struct Frame
+  {
+    GLuint   queries[MAX_QUERIES];
+    uint8_t  sections[MAX_QUERIES / 2];
+    uint32_t used    = 0;
+    uint32_t last    = 0;
+    bool     pending = false;
+  };
+
+  void collect(Frame& frame);
+
+  bool                m_enabled = false;
+  uint32_t            m_current = 0;
+  std::vector<Frame>  m_frames;
+  std::vector<Result> m_results;
+  Result              m_latest    = {};
+  uint32_t            m_collected = 0;
+};
+
+// Runs a grid of configurations, each for a number of warmup frames
+// followed by recorded frames, and writes mean/p50/p99 per section
+// as CSV or JSON (based on the output file extension). Counters, such as
+// the lod statistics, are sampled every recorded frame and their mean is
+// written as well. Instead of a file, a selector can receive the results,
+// e.g. to keep the best configuration.
+
+class SweepBenchmark
+{
+public:
+  typedef std::function<void(int)> Setter;
+  typedef std::function<double()>  Counter;
+
+  enum Action
+  {
+    ACTION_NONE,
+    ACTION_APPLIED,
+    ACTION_FINISHED,
+  };
+
+  struct Stats
+  {
+    double mean;
+    double p50;
+    double p99;
+  };
+
+  // one per configuration, values in the order of the spec
+  struct Row
+  {
+    std::vector<int>    values;
+    Stats               sections[SectionTimers::NUM_SECTIONS];
+    std::vector<double> counters;
+  };
+
+  typedef std::function<void(const std::vector<Row>&)> Selector;
+
+  void addVariable(const char* name, Setter setter);
+  void addCounter(const char* name, Counter counter);
+
+  // spec is "name=v0,v1,...;name=..." the cartesian product is run
+  bool setup(const std::string& spec, uint32_t warmupFrames, uint32_t recordFrames, const std::string& outputFile);
+  bool setup(const std::string& spec, uint32_t warmupFrames, uint32_t recordFrames, Selector selector);
+  bool isActive() const { return m_state != STATE_INACTIVE; }
+
+  // to be called once per frame before the settings are evaluated
+  Action frame(SectionTimers& timers);
+
+private:
+  enum State
+  {
+    STATE_INACTIVE,
+    STATE_APPLY,
+    STATE_WARMUP,
+    STATE_RECORD,
+  };
+
+  struct Variable
+  {
+    std::string name;
+    Setter      setter;
+  };
+
+  struct Dimension
+  {
+    int              variable;
+    std::vector<int> values;
+  };
+
+  struct NamedCounter
+  {
+    std::string name;
+    Counter     counter;
+  };
+
+  void applyConfig(uint32_t config);
+  void finishConfig();
+  bool writeOutput() const;
+
+  State       m_state = STATE_INACTIVE;
+  uint32_t    m_warmupFrames;
+  uint32_t    m_recordFrames;
+  std::string m_outputFile;
+  Selector    m_selector;
+
+  std::vector<Variable>     m_variables;
+  std::vector<NamedCounter> m_counters;
+  std::vector<Dimension>    m_dimensions;
+  uint32_t               m_numConfigs;
+  uint32_t               m_config;
+  uint32_t               m_frame;
+
+  std::vector<int>                   m_configValues;
+  std::vector<SectionTimers::Result> m_samples;
+  std::vector<double>                m_counterSums;
+  uint32_t                           m_counterFrames;
+  std::vector<Row>                   m_rows;
+};
+
+// Tunes settings one after another: every task is a sweep over its
+// candidate values, whose selector keeps the one with the lowest mean
+// time of the task's section.
+
+class Autotuner
+{
+public:
+  typedef SweepBenchmark::Setter Setter;
+  typedef SweepBenchmark::Action Action;
+
+  void clearTasks();
+  void addTask(const char* name, int section, const std::vector<int>& candidates, Setter setter);
+
+  bool start(uint32_t warmupFrames, uint32_t recordFrames);
+  bool isActive() const { return m_sweep.isActive(); }
+
+  // to be called once per frame before the settings are evaluated
+  Action frame(SectionTimers& timers);
+
+private:
+  struct Task
+  {
+    std::string      name;
+    int              section;
+    std::vector<int> candidates;
+    Setter           setter;
+  };
+
+  bool startTask();
+  void selectCandidate(const Task& task, const std::vector<SweepBenchmark::Row>& rows);
+
+  // one variable per task
+  SweepBenchmark    m_sweep;
+  uint32_t          m_warmupFrames;
+  uint32_t          m_recordFrames;
+  std::vector<Task> m_tasks;
+  uint32_t          m_task;
+};
+
+}  // namespace dynlod
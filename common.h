@@ -17,35 +17,123 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#ifndef DYNLOD_COMMON_H
+#define DYNLOD_COMMON_H
 
 #define VERTEX_POS      0
 #define VERTEX_COLOR    1
+#define VERTEX_PARTICLE 2
 
 #define UBO_SCENE     0
 #define UBO_CMDS      1
+#define UBO_VIEWS     2
 
 #define UNI_USE_CMDOFFSET             0
+#define UNI_LOD_LEVEL                 1
+#define UNI_MESH_VERTICES             2
+#define UNI_BATCH_SIZE                3
 #define UNI_CONTENT_IDX_OFFSET        0
 #define UNI_CONTENT_IDX_MAX           1
+#define UNI_CONTENT_CLUSTER_OFFSET    2
+#define UNI_CONTENT_INCR_RESET        3
+#define UNI_CONTENT_INCR_DELTA        4
+#define UNI_CONTENT_SIM_STEP          11
+#define UNI_CONTENT_LIST_STRIDE       12
+#define UNI_CONTENT_LIVENESS          13
+#define UNI_CONTENT_INCR_SCALE        14
+#define UNI_SCAN_GROUPS               0
+#define UNI_HIZ_LEVEL                 0
+#define UNI_CMDS_JOB                  0
+#define UNI_CMDS_JOBS                 1
+#define UNI_CMDS_LISTBASE             2
+#define UNI_CMDS_KEEP                 3
+#define UNI_BIN_LIST_STRIDE           0
+#define UNI_BIN_SCRATCH_STRIDE        1
+#define UNI_BIN_RANGE                 2
+#define UNI_VIEWS_IDX_OFFSET          0
+#define UNI_VIEWS_IDX_MAX             1
+#define UNI_VIEWS_COUNT               2
+#define UNI_VIEWS_LIST_STRIDE         3
+#define UNI_VIEWS_VIEW_STRIDE         4
+#define UNI_VIEWS_CMD_STRIDE          5
+#define UNI_VIEWS_LIVENESS            6
+#define UNI_SLOTS_COUNT               0
+#define UNI_SLOTS_VELOCITIES          1
 
 #define TEX_PARTICLES         0
 #define TEX_PARTICLEINDICES   1
+#define TEX_HIZ               2
 
 #define ABO_DATA_COUNTS       0
 
 #define SSBO_DATA_INDIRECTS   0
-#define SSBO_DATA_POINTS      1
-#define SSBO_DATA_BASIC       2
-#define SSBO_DATA_TESS        3
+#define SSBO_DATA_LISTS       1
+#define SSBO_DATA_BINS        2
+#define SSBO_DATA_SCRATCH     3
+#define SSBO_DATA_CLUSTERS    4
+#define SSBO_DATA_COUNTS      5
+#define SSBO_DATA_GROUPS      6
+#define SSBO_DATA_CLUSTERCACHE  7
+#define SSBO_DATA_MULTIDRAW     8
+#define SSBO_DATA_PARTICLES     9
+#define SSBO_DATA_VELOCITIES    10
+#define SSBO_DATA_STATS         11
+#define SSBO_DATA_LIVENESS      12
+#define SSBO_DATA_SLOTMOVES     13
+#define SSBO_DATA_SLOTPARTICLES   14
+#define SSBO_DATA_SLOTVELOCITIES  15
+#define SSBO_DATA_INCRSTATE       16
 
+// default number of particles per batched mesh, every mesh type has
+// its own batch size at runtime (LodLevel::batch)
 #define PARTICLE_BATCHSIZE      1024
 #define PARTICLE_BASICVERTICES  12
 #define PARTICLE_BASICPRIMS     20
 #define PARTICLE_BASICINDICES   (PARTICLE_BASICPRIMS*3)
 
-// setting this to 1 will cause all particles to have the same "size"
-// and pack color, so that the overall size of the particle is halved 
-#define USE_COMPACT_PARTICLE  0
+// lod chain from far to near: level 0 draws points, the last level
+// tessellated patches and the levels in between batched icospheres of
+// 0..LOD_MAX_SUBDIV subdivisions (20 * 4^subdiv triangles) or ray cast
+// sphere impostors (one point sprite per particle).
+// LOD_MAX_LEVELS must be 4 or 8 (16-bit counts in lodcontent's workgroup
+// append).
+#define LOD_MAX_LEVELS          8
+#define LOD_MAX_SUBDIV          2
+
+// optional coarse front-to-back order of the lists above level 0, see
+// lodbin.comp.glsl
+#define LOD_DEPTH_BINS          16
+#define LODBIN_WORKGROUP_SIZE   256
+
+// views classified together by lodviews.comp.glsl, e.g. stereo eyes
+#define LOD_MAX_VIEWS           4
+#define LODVIEWS_WORKGROUP_SIZE 256
+
+// particles are generated in bricks of 8 x 2 x 8, each forming a cluster
+#define PARTICLE_CLUSTERSIZE    128
+
+// list entry left behind when incremental classification moved the
+// particle to another list, drawn as nothing (index lists only)
+#define PARTICLE_INVALID        -1
+
+// storage of particles on the gpu, selected at runtime
+// FULL     32 bytes, vec4 position & size, vec4 color
+// COMPACT  16 bytes, all particles have the same "size" (scene.particleSize)
+//          and the color is packed to RGBA8
+// QUANT     8 bytes, 16-bit position within scene.particleBox, 8-bit size,
+//          RGB332 color
+#define PARTICLE_FORMAT_FULL      0
+#define PARTICLE_FORMAT_COMPACT   1
+#define PARTICLE_FORMAT_QUANT     2
+#define NUM_PARTICLE_FORMATS      3
+
+// simulation fused into lodcontent (see particlesim.cpp), particles
+// bounce off the scene's particle box
+#define SIM_GRAVITY               9.81
+#define SIM_RESTITUTION           0.75
+
+// particles added and removed at runtime, see particleslots.hpp
+#define PARTICLESLOTS_WORKGROUP_SIZE  256
 
 
 #ifdef __cplusplus
@@ -67,52 +155,123 @@ struct DrawElements {
   uint  first;
   uint  baseVertex;
   uint  baseInstance;
-  uvec2 _pad;
+  uint  _pad0;
+  uvec2 _pad1;
 };
 
+// same layout for std140 and std430, lodcontent accesses the counts as
+// scalars for atomics
 struct DrawCounters {
-  uint  farCnt;
-  uint  medCnt;
-  uint  nearCnt;
-  uint  _pad;
+  uvec4 levelCnt[LOD_MAX_LEVELS / 4]; // 4 levels per vector
+  uint  occludedCnt;
+  uint  _pad0;
+  uvec2 _pad1;
+};
+
+// accumulated by lodcmds over all jobs of a frame
+struct LodStats {
+  uvec4 levelCnt[LOD_MAX_LEVELS / 4];
+  uint  accepted;
+  uint  occluded;
+  uvec2 _pad;
 };
 
 struct DrawIndirects {
   DrawCounters  counters;
 
+  // level 0
   DrawArrays    farArray;
   DrawElements  farIndexed;
   
-  DrawElements  medFull;
-  DrawElements  medRest;
-  
-  DrawElements  nearFull;
-  DrawElements  nearRest;
+  // batched instancing per mesh level and the tessellated level,
+  // index 0 is unused
+  DrawElements  levelFull[LOD_MAX_LEVELS];
+  DrawElements  levelRest[LOD_MAX_LEVELS];
 };
 
+// the application always works with this, the other formats are
+// encoded from it
 struct Particle {
-#if USE_COMPACT_PARTICLE
-  vec4  posColor;
-#else
   vec4  posSize;
   vec4  color;
-#endif
+};
+
+struct ParticleCompact {
+  vec4  posColor;
+};
+
+struct ParticleQuant {
+  uvec2 data; // x: pos.x | pos.y << 16, y: pos.z | size << 16 | color << 24
+};
+
+struct Cluster {
+  vec4  bounds;     // sphere around particle centers
+  uint  first;
+  uint  count;
+  float sizeMin;
+  float sizeMax;
+};
+
+// state of the previous classification of a cluster, margin is how much
+// the classification inputs may still change without altering the result
+struct ClusterCache {
+  float margin;
+  int   band;
+  uint  bands[PARTICLE_CLUSTERSIZE / 8]; // 4 bits per particle, band + 1
+  // ranges of the kept lists the particles were appended to
+  uint  listStart[LOD_MAX_LEVELS];
+  uint  listCounts[LOD_MAX_LEVELS / 4];  // 8 bits per level
+};
+
+// kept lists of incremental classification, followed by the ids of the
+// clusters that are classified again (uint per cluster)
+struct IncrState {
+  uvec4 dispatch;                   // indirect compute of the dirty clusters
+  uvec4 holes[LOD_MAX_LEVELS / 4];  // invalidated entries per level
+  uint  reset;                      // lists were rebuilt this frame
+  uint  _pad0;
+  uvec2 _pad1;
+};
+
+struct LodLevel {
+  float pixels;     // minimum coverage, unused for level 0
+  uint  indices;    // per particle, 0 for points
+  uint  batch;      // particles per instance of the batched mesh
+  uint  _pad;
+};
+
+// the per-view part of SceneData for multi-view classification
+struct ViewData {
+  mat4  viewProjMatrix;
+  vec4  frustum[6];
 };
 
 struct SceneData {
   mat4  viewProjMatrix;
   mat4  viewMatrix;
   mat4  viewMatrixIT;
+  mat4  viewProjMatrixI;
   
   uvec2 viewport;
   vec2  viewpixelsize;
   
   vec4  frustum[6];
   
-  float farPixels;
-  float nearPixels;
+  uint  lodLevels;
   float tessPixels;
   float particleSize;
+  float _pad;
+  
+  vec4  particleBoxMin;   // w: minimum size
+  vec4  particleBoxScale; // w: size step
+  
+  // occlusion culling against the previous frame's depth pyramid
+  mat4  hizViewProjMatrix;
+  vec4  hizEyePos;
+  vec4  hizSize;          // xy: level 0 size, z: levels, w: 1 if enabled
+  
+  // first lodLevels are used, pixels are ascending
+  LodLevel lodTable[LOD_MAX_LEVELS];
 };
 
 #ifdef __cplusplus
@@ -136,4 +295,147 @@ vec4  shade(vec3 normal)
 layout(std140,binding=UBO_SCENE) uniform sceneBuffer {
   SceneData   scene;
 };
+
+#ifndef PARTICLE_FORMAT
+#define PARTICLE_FORMAT PARTICLE_FORMAT_FULL
+#endif
+
+// ParticleData is the particle as stored in buffers and lists
+#if PARTICLE_FORMAT == PARTICLE_FORMAT_QUANT
+#define ParticleData      ParticleQuant
+#define ParticleSampler   usamplerBuffer
+#elif PARTICLE_FORMAT == PARTICLE_FORMAT_COMPACT
+#define ParticleData      ParticleCompact
+#define ParticleSampler   samplerBuffer
+#else
+#define ParticleData      Particle
+#define ParticleSampler   samplerBuffer
+#endif
+
+ParticleData fetchParticle(ParticleSampler tex, int idx)
+{
+  ParticleData raw;
+#if PARTICLE_FORMAT == PARTICLE_FORMAT_QUANT
+  raw.data      = texelFetch(tex, idx).xy;
+#elif PARTICLE_FORMAT == PARTICLE_FORMAT_COMPACT
+  raw.posColor  = texelFetch(tex, idx);
+#else
+  raw.posSize   = texelFetch(tex, idx*2 + 0);
+  raw.color     = texelFetch(tex, idx*2 + 1);
+#endif
+  return raw;
+}
+
+// must match decodeParticle in particleformat.cpp
+void decodeParticle(ParticleData raw, out vec4 posSize, out vec4 color)
+{
+#if PARTICLE_FORMAT == PARTICLE_FORMAT_QUANT
+  uvec2 d     = raw.data;
+  vec3  q     = vec3(uvec3(d.x & 0xFFFFu, d.x >> 16, d.y & 0xFFFFu));
+  posSize.xyz = scene.particleBoxMin.xyz + q * scene.particleBoxScale.xyz;
+  posSize.w   = scene.particleBoxMin.w + float((d.y >> 16) & 0xFFu) * scene.particleBoxScale.w;
+  uint  c     = d.y >> 24;
+  color       = vec4(float(c >> 5) / 7.0, float((c >> 2) & 7u) / 7.0, float(c & 3u) / 3.0, 1.0);
+#elif PARTICLE_FORMAT == PARTICLE_FORMAT_COMPACT
+  posSize     = vec4(raw.posColor.xyz, scene.particleSize);
+  color       = unpackUnorm4x8(floatBitsToUint(raw.posColor.w));
+#else
+  posSize     = raw.posSize;
+  color       = raw.color;
+#endif
+}
+
+// must match encodeParticles in particleformat.cpp
+ParticleData encodeParticle(vec4 posSize, vec4 color)
+{
+  ParticleData raw;
+#if PARTICLE_FORMAT == PARTICLE_FORMAT_QUANT
+  uvec4 q   = uvec4(clamp((posSize - scene.particleBoxMin) / scene.particleBoxScale + 0.5,
+                          vec4(0), vec4(65535.0, 65535.0, 65535.0, 255.0)));
+  uvec3 c   = uvec3(clamp(color.xyz / vec3(1.0 / 7.0, 1.0 / 7.0, 1.0 / 3.0) + 0.5, vec3(0), vec3(7.0, 7.0, 3.0)));
+  raw.data  = uvec2(q.x | (q.y << 16), q.z | (q.w << 16) | (((c.x << 5) | (c.y << 2) | c.z) << 24));
+#elif PARTICLE_FORMAT == PARTICLE_FORMAT_COMPACT
+  raw.posColor  = vec4(posSize.xyz, uintBitsToFloat(packUnorm4x8(color)));
+#else
+  raw.posSize   = posSize;
+  raw.color     = color;
+#endif
+  return raw;
+}
+
+// bands are the lod levels, BAND_FAR (points) to scene.lodLevels-1
+#define BAND_CULLED     -1
+#define BAND_FAR        0
+
+// highest level whose threshold the coverage reaches
+int classifyCoverage(float coverage)
+{
+  int band = BAND_FAR;
+  for (int l = 1; l < int(scene.lodLevels); l++){
+    if (coverage >= scene.lodTable[l].pixels){
+      band = l;
+    }
+  }
+  return band;
+}
+
+// band of a particle seen through the given frustum and projection, the
+// lod table and pixel scale are the scene's (lodcontent, lodviews)
+int classifyParticleView(vec4 frustum[6], mat4 viewProj, vec3 pos, float size)
+{
+  for (int i = 0; i < 6; i++){
+    if (dot(frustum[i],vec4(pos,1)) < -size){
+      return BAND_CULLED;
+    }
+  }
+  
+  vec4 hPos = viewProj * vec4(pos,1);
+  vec2 pixelsize = 2.0 * size * scene.viewpixelsize / hPos.w;
+  
+  float coverage = dot(pixelsize,vec2(0.5));
+  
+  return classifyCoverage(coverage);
+}
+
+// primitives of PARTICLE_INVALID entries are moved outside the clip volume
+#define PARTICLE_CLIPPED  vec4(2.0, 2.0, 2.0, 1.0)
+
+#if USE_LIVENESS
+// one bit per particle slot, cleared for removed particles (ParticleSlots)
+layout(binding=SSBO_DATA_LIVENESS,std430) readonly buffer livenessBuffer {
+  uint liveness[];
+};
+
+bool isParticleLive(int idx)
+{
+  return (liveness[idx >> 5] & (1u << (idx & 31))) != 0u;
+}
+#endif
+
+#if USE_PARTICLE_ATTRIBS
+// particles sourced as vertex attributes, see Sample::updateVertexFormat
+#if PARTICLE_FORMAT == PARTICLE_FORMAT_QUANT
+in layout(location=VERTEX_PARTICLE) uvec2 inParticleData;
+#else
+in layout(location=VERTEX_POS)    vec4  inParticlePos;
+in layout(location=VERTEX_COLOR)  vec4  inParticleColor;
+#endif
+
+ParticleData loadParticleAttribs()
+{
+  ParticleData raw;
+#if PARTICLE_FORMAT == PARTICLE_FORMAT_QUANT
+  raw.data      = inParticleData;
+#elif PARTICLE_FORMAT == PARTICLE_FORMAT_COMPACT
+  raw.posColor  = vec4(inParticlePos.xyz, uintBitsToFloat(packUnorm4x8(inParticleColor)));
+#else
+  raw.posSize   = inParticlePos;
+  raw.color     = inParticleColor;
+#endif
+  return raw;
+}
+#endif
+
+#endif
+
 #endif
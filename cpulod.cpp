@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "cpulod.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <thread>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CPULOD_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CPULOD_SIMD_WIDTH 4
+#else
+#define CPULOD_SIMD_WIDTH 1
+#endif
+
+namespace dynlod {
+
+// each block is classified by one thread, the per-block counts are then
+// used to scatter the indices into the final lists in particle order
+static const uint32_t CPULOD_BLOCKSIZE = 16 * 1024;
+
+#if CPULOD_SIMD_WIDTH == 8
+typedef __m256 simdf;
+static inline simdf simd_set1(float f)
+{
+  return _mm256_set1_ps(f);
+}
+static inline simdf simd_load(const float* ptr)
+{
+  return _mm256_loadu_ps(ptr);
+}
+static inline simdf simd_add(simdf a, simdf b)
+{
+  return _mm256_add_ps(a, b);
+}
+static inline simdf simd_mul(simdf a, simdf b)
+{
+  return _mm256_mul_ps(a, b);
+}
+static inline simdf simd_div(simdf a, simdf b)
+{
+  return _mm256_div_ps(a, b);
+}
+static inline simdf simd_cmplt(simdf a, simdf b)
+{
+  return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+}
+static inline simdf simd_cmpge(simdf a, simdf b)
+{
+  return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+}
+static inline simdf simd_or(simdf a, simdf b)
+{
+  return _mm256_or_ps(a, b);
+}
+static inline simdf simd_zero()
+{
+  return _mm256_setzero_ps();
+}
+static inline uint32_t simd_movemask(simdf a)
+{
+  return uint32_t(_mm256_movemask_ps(a));
+}
+#elif CPULOD_SIMD_WIDTH == 4
+typedef __m128 simdf;
+static inline simdf simd_set1(float f)
+{
+  return _mm_set1_ps(f);
+}
+static inline simdf simd_load(const float* ptr)
+{
+  return _mm_loadu_ps(ptr);
+}
+static inline simdf simd_add(simdf a, simdf b)
+{
+  return _mm_add_ps(a, b);
+}
+static inline simdf simd_mul(simdf a, simdf b)
+{
+  return _mm_mul_ps(a, b);
+}
+static inline simdf simd_div(simdf a, simdf b)
+{
+  return _mm_div_ps(a, b);
+}
+static inline simdf simd_cmplt(simdf a, simdf b)
+{
+  return _mm_cmplt_ps(a, b);
+}
+static inline simdf simd_cmpge(simdf a, simdf b)
+{
+  return _mm_cmpge_ps(a, b);
+}
+static inline simdf simd_or(simdf a, simdf b)
+{
+  return _mm_or_ps(a, b);
+}
+static inline simdf simd_zero()
+{
+  return _mm_setzero_ps();
+}
+static inline uint32_t simd_movemask(simdf a)
+{
+  return uint32_t(_mm_movemask_ps(a));
+}
+#endif
+
+const char* CpuLodClassifier::getSimdName()
+{
+#if CPULOD_SIMD_WIDTH == 8
+  return "AVX";
+#elif CPULOD_SIMD_WIDTH == 4
+  return "SSE";
+#else
+  return "scalar";
+#endif
+}
+
+void CpuLodClassifier::init(const Particle* particles, size_t count)
+{
+  resize(count);
+  update(particles, 0, count);
+}
+
+void CpuLodClassifier::update(const Particle* particles, size_t begin, size_t end)
+{
+  assert(end <= m_count);
+
+  for(size_t i = begin; i < end; i++)
+  {
+    m_posX[i] = particles[i].posSize.x;
+    m_posY[i] = particles[i].posSize.y;
+    m_posZ[i] = particles[i].posSize.z;
+    m_size[i] = particles[i].posSize.w;
+  }
+}
+
+void CpuLodClassifier::resize(size_t count)
+{
+  m_count = count;
+
+  m_posX.resize(count);
+  m_posY.resize(count);
+  m_posZ.resize(count);
+  m_size.resize(count);
+  m_bands.resize(count, BAND_CULLED);
+}
+
+void CpuLodClassifier::deinit()
+{
+  m_count = 0;
+  m_posX  = std::vector<float>();
+  m_posY  = std::vector<float>();
+  m_posZ  = std::vector<float>();
+  m_size  = std::vector<float>();
+  m_bands = std::vector<uint8_t>();
+  for(int b = 0; b < NUM_BANDS; b++)
+  {
+    m_lists[b] = std::vector<uint32_t>();
+  }
+}
+
+void CpuLodClassifier::classifyBlock(const Setup& setup, uint32_t begin, uint32_t end, uint32_t counts[NUM_BANDS])
+{
+  uint32_t i = begin;
+
+#if CPULOD_SIMD_WIDTH > 1
+  simdf planes[6][4];
+  for(int p = 0; p < 6; p++)
+  {
+    for(int c = 0; c < 4; c++)
+    {
+      planes[p][c] = simd_set1(setup.planes[p][c]);
+    }
+  }
+  simdf wRow0      = simd_set1(setup.wRow[0]);
+  simdf wRow1      = simd_set1(setup.wRow[1]);
+  simdf wRow2      = simd_set1(setup.wRow[2]);
+  simdf wRow3      = simd_set1(setup.wRow[3]);
+  simdf pixelX     = simd_set1(2.0f * setup.viewpixelsize[0]);
+  simdf pixelY     = simd_set1(2.0f * setup.viewpixelsize[1]);
+  simdf half       = simd_set1(0.5f);
+  simdf zero       = simd_zero();
+  simdf lodPixels[LOD_MAX_LEVELS];
+  for(uint32_t l = 1; l < setup.lodLevels; l++)
+  {
+    lodPixels[l] = simd_set1(setup.lodPixels[l]);
+  }
+
+  for(; i + CPULOD_SIMD_WIDTH <= end; i += CPULOD_SIMD_WIDTH)
+  {
+    simdf x = simd_load(&m_posX[i]);
+    simdf y = simd_load(&m_posY[i]);
+    simdf z = simd_load(&m_posZ[i]);
+    simdf s = simd_load(&m_size[i]);
+
+    simdf negSize = simd_mul(s, simd_set1(-1.0f));
+    simdf culled  = zero;
+    for(int p = 0; p < 6; p++)
+    {
+      simdf d = simd_add(simd_add(simd_mul(x, planes[p][0]), simd_mul(y, planes[p][1])),
+                         simd_add(simd_mul(z, planes[p][2]), planes[p][3]));
+      culled  = simd_or(culled, simd_cmplt(d, negSize));
+    }
+
+    simdf w        = simd_add(simd_add(simd_mul(x, wRow0), simd_mul(y, wRow1)), simd_add(simd_mul(z, wRow2), wRow3));
+    simdf sizeX    = simd_div(simd_mul(s, pixelX), w);
+    simdf sizeY    = simd_div(simd_mul(s, pixelY), w);
+    simdf coverage = simd_add(simd_mul(sizeX, half), simd_mul(sizeY, half));
+
+    uint32_t fullMask = (1u << CPULOD_SIMD_WIDTH) - 1;
+    uint32_t visible  = (~simd_movemask(culled)) & fullMask;
+
+    // thresholds are ascending, the band is the number of reached ones
+    uint8_t bands[CPULOD_SIMD_WIDTH] = {0};
+    for(uint32_t l = 1; l < setup.lodLevels; l++)
+    {
+      uint32_t mask = simd_movemask(simd_cmpge(coverage, lodPixels[l])) & visible;
+      for(uint32_t lane = 0; lane < CPULOD_SIMD_WIDTH; lane++)
+      {
+        bands[lane] += uint8_t((mask >> lane) & 1);
+      }
+    }
+
+    for(uint32_t lane = 0; lane < CPULOD_SIMD_WIDTH; lane++)
+    {
+      uint8_t band = (visible >> lane) & 1 ? bands[lane] : uint8_t(BAND_CULLED);
+      if(band != BAND_CULLED)
+      {
+        counts[band]++;
+      }
+      m_bands[i + lane] = band;
+    }
+  }
+#endif
+
+  for(; i < end; i++)
+  {
+    float x = m_posX[i];
+    float y = m_posY[i];
+    float z = m_posZ[i];
+    float s = m_size[i];
+
+    bool culled = false;
+    for(int p = 0; p < 6; p++)
+    {
+      float d = (x * setup.planes[p][0] + y * setup.planes[p][1]) + (z * setup.planes[p][2] + setup.planes[p][3]);
+      culled  = culled || d < -s;
+    }
+
+    float w        = (x * setup.wRow[0] + y * setup.wRow[1]) + (z * setup.wRow[2] + setup.wRow[3]);
+    float sizeX    = (s * 2.0f * setup.viewpixelsize[0]) / w;
+    float sizeY    = (s * 2.0f * setup.viewpixelsize[1]) / w;
+    float coverage = sizeX * 0.5f + sizeY * 0.5f;
+
+    uint8_t band = BAND_CULLED;
+    if(!culled)
+    {
+      band = BAND_FAR;
+      for(uint32_t l = 1; l < setup.lodLevels; l++)
+      {
+        band = coverage >= setup.lodPixels[l] ? uint8_t(l) : band;
+      }
+      counts[band]++;
+    }
+    m_bands[i] = band;
+  }
+}
+
+void CpuLodClassifier::scatterBlock(uint32_t begin, uint32_t end, const uint32_t offsets[NUM_BANDS])
+{
+  uint32_t* lists[NUM_BANDS];
+  for(int b = 0; b < NUM_BANDS; b++)
+  {
+    lists[b] = m_lists[b].data() + offsets[b];
+  }
+
+  for(uint32_t i = begin; i < end; i++)
+  {
+    uint8_t band = m_bands[i];
+    if(band != BAND_CULLED)
+    {
+      *(lists[band]++) = i;
+    }
+  }
+}
+
+void CpuLodClassifier::classify(const SceneData& scene, uint32_t begin, uint32_t end, uint32_t numThreads)
+{
+  assert(end <= m_count);
+
+  Setup setup;
+  for(int p = 0; p < 6; p++)
+  {
+    setup.planes[p][0] = scene.frustum[p].x;
+    setup.planes[p][1] = scene.frustum[p].y;
+    setup.planes[p][2] = scene.frustum[p].z;
+    setup.planes[p][3] = scene.frustum[p].w;
+  }
+  // hPos.w of viewProjMatrix * vec4(pos,1)
+  setup.wRow[0]          = scene.viewProjMatrix[0].w;
+  setup.wRow[1]          = scene.viewProjMatrix[1].w;
+  setup.wRow[2]          = scene.viewProjMatrix[2].w;
+  setup.wRow[3]          = scene.viewProjMatrix[3].w;
+  setup.viewpixelsize[0] = scene.viewpixelsize.x;
+  setup.viewpixelsize[1] = scene.viewpixelsize.y;
+  setup.lodLevels        = std::min(scene.lodLevels, uint32_t(LOD_MAX_LEVELS));
+  for(uint32_t l = 0; l < LOD_MAX_LEVELS; l++)
+  {
+    setup.lodPixels[l] = scene.lodTable[l].pixels;
+  }
+
+  uint32_t numBlocks = (end - begin + CPULOD_BLOCKSIZE - 1) / CPULOD_BLOCKSIZE;
+  m_blockCounts.resize(size_t(numBlocks) * NUM_BANDS);
+
+  if(!numThreads)
+  {
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  numThreads = std::min(numThreads, std::max(1u, numBlocks));
+
+  auto runParallel = [&](const auto& fn) {
+    std::atomic_uint32_t nextBlock(0);
+    auto                 worker = [&]() {
+      uint32_t block;
+      while((block = nextBlock++) < numBlocks)
+      {
+        fn(block);
+      }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for(uint32_t t = 1; t < numThreads; t++)
+    {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for(auto& thread : threads)
+    {
+      thread.join();
+    }
+  };
+
+  // pass 1: classify and count per block
+  runParallel([&](uint32_t block) {
+    uint32_t* counts = &m_blockCounts[size_t(block) * NUM_BANDS];
+    for(int b = 0; b < NUM_BANDS; b++)
+    {
+      counts[b] = 0;
+    }
+    uint32_t blockBegin = begin + block * CPULOD_BLOCKSIZE;
+    uint32_t blockEnd   = std::min(end, blockBegin + CPULOD_BLOCKSIZE);
+    classifyBlock(setup, blockBegin, blockEnd, counts);
+  });
+
+  // turn counts into offsets
+  uint32_t totals[NUM_BANDS] = {0};
+  for(uint32_t block = 0; block < numBlocks; block++)
+  {
+    uint32_t* counts = &m_blockCounts[size_t(block) * NUM_BANDS];
+    for(int b = 0; b < NUM_BANDS; b++)
+    {
+      uint32_t cnt = counts[b];
+      counts[b]    = totals[b];
+      totals[b] += cnt;
+    }
+  }
+  for(int b = 0; b < NUM_BANDS; b++)
+  {
+    m_lists[b].resize(totals[b]);
+  }
+
+  // pass 2: write indices
+  runParallel([&](uint32_t block) {
+    uint32_t blockBegin = begin + block * CPULOD_BLOCKSIZE;
+    uint32_t blockEnd   = std::min(end, blockBegin + CPULOD_BLOCKSIZE);
+    scatterBlock(blockBegin, blockEnd, &m_blockCounts[size_t(block) * NUM_BANDS]);
+  });
+}
+
+}  // namespace dynlod
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "common.h"
+
+namespace dynlod {
+
+// CPU implementation of the classification done in lodcontent.vert.glsl.
+// Particles are kept as SoA copy (x,y,z,size) and processed with SSE/AVX
+// in blocks that are distributed across threads.
+// The resulting lists are ordered by particle index, independent of the
+// number of threads used.
+
+class CpuLodClassifier
+{
+public:
+  // bands are the lod levels, BAND_FAR (points) to scene.lodLevels-1
+  enum Band
+  {
+    BAND_FAR    = 0,
+    NUM_BANDS   = LOD_MAX_LEVELS,
+    BAND_CULLED = 0xFF,
+  };
+
+  // particles are expected decoded, see decodeParticles
+  void init(const Particle* particles, size_t count);
+  void deinit();
+  // refreshes the copy of particles within [begin,end) after they moved
+  void update(const Particle* particles, size_t begin, size_t end);
+  // changes the particle count, added particles need an update
+  void resize(size_t count);
+
+  // classifies particles within [begin,end) using the frustum and lod
+  // table of the scene, numThreads 0 means all hardware threads
+  void classify(const SceneData& scene, uint32_t begin, uint32_t end, uint32_t numThreads = 0);
+
+  const std::vector<uint32_t>& getList(int band) const { return m_lists[band]; }
+  size_t                       getCount() const { return m_count; }
+  bool                         isValid() const { return m_count != 0; }
+
+  static const char* getSimdName();
+
+private:
+  struct Setup
+  {
+    float planes[6][4];
+    float wRow[4];
+    float viewpixelsize[2];
+    float    lodPixels[LOD_MAX_LEVELS];
+    uint32_t lodLevels;
+  };
+
+  void classifyBlock(const Setup& setup, uint32_t begin, uint32_t end, uint32_t counts[NUM_BANDS]);
+  void scatterBlock(uint32_t begin, uint32_t end, const uint32_t offsets[NUM_BANDS]);
+
+  size_t m_count = 0;
+
+  std::vector<float>    m_posX;
+  std::vector<float>    m_posY;
+  std::vector<float>    m_posZ;
+  std::vector<float>    m_size;
+  std::vector<uint8_t>  m_bands;
+  std::vector<uint32_t> m_blockCounts;
+  std::vector<uint32_t> m_lists[NUM_BANDS];
+};
+
+}  // namespace dynlod
@@ -34,9 +34,25 @@
 #include <nvgl/appwindowprofiler_gl.hpp>
 #include <nvgl/base_gl.hpp>
 #include <nvgl/error_gl.hpp>
-#include <nvgl/programmanager_gl.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <float.h>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+
+#include "benchmark.hpp"
 #include "common.h"
+#include "cpulod.hpp"
+#include "lodbudget.hpp"
+#include "particlefile.hpp"
+#include "particleformat.hpp"
+#include "particlesim.hpp"
+#include "particleslots.hpp"
+#include "pointcloud.hpp"
+#include "programcache.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
 namespace dynlod {
@@ -45,6 +61,14 @@ int const SAMPLE_SIZE_HEIGHT(768);
 int const SAMPLE_MAJOR_VERSION(4);
 int const SAMPLE_MINOR_VERSION(5);
 
+#define PROFILE_SECTION_CONCAT(a, b) a##b
+#define PROFILE_SECTION_SCOPE(name, line)                                                                              \
+  NV_PROFILE_GL_SECTION(name);                                                                                         \
+  SectionTimers::Scope PROFILE_SECTION_CONCAT(benchScope, line)(m_benchTimers, name)
+// records the section in the profiler, as well as in the per-frame
+// timers used by the sweep benchmark
+#define PROFILE_SECTION(name) PROFILE_SECTION_SCOPE(name, __LINE__)
+
 class Frustum
 {
 public:
@@ -111,32 +135,111 @@ public:
   float m_planes[NUM_PLANES][4];
 };
 
+enum AppendMode
+{
+  APPEND_ATOMIC,
+  APPEND_WORKGROUP,
+  APPEND_ORDERED,
+};
+
+// the pipelined modes alternate between two sets of lists and commands,
+// so a frame's classification does not have to wait for the previous
+// draws. The deferred mode draws the lists one frame later, after which
+// the next classification can run behind the rasterization.
+enum PipelineMode
+{
+  PIPELINE_OFF,
+  PIPELINE_PINGPONG,
+  PIPELINE_DEFERRED,
+};
+
+// every mesh type is batched separately, so each can use its own batch
+// size
+enum BatchMesh
+{
+  BATCH_ICOSPHERE,  // + subdivision
+  BATCH_IMPOSTOR = BATCH_ICOSPHERE + LOD_MAX_SUBDIV + 1,
+  BATCH_TESS,
+  NUM_BATCH_MESHES,
+};
+static_assert(NUM_BATCH_MESHES == 5, "update the batch size defaults and names");
+
+enum GuiEnums
+{
+  GUI_APPEND,
+  GUI_FORMAT,
+  GUI_BUDGET,
+  GUI_PIPELINE,
+};
+
 class Sample : public nvgl::AppWindowProfilerGL
 {
-  struct
+  struct Programs
   {
-    nvgl::ProgramID draw_sphere_point, draw_sphere, draw_sphere_tess, lodcontent, lodcmds, lodcontent_comp, lodcmds_comp;
-  } programs;
+    GLuint draw_sphere_point, draw_sphere, draw_sphere_tess, draw_sphere_mdi, draw_sphere_tess_mdi,
+        draw_sphere_impostor, draw_sphere_impostor_mdi, lodcontent,
+        lodcmds, lodcontent_comp, lodcmds_comp, lodcmds_mdi, lodcmds_mdi_comp,
+        lodcontent_cluster_comp, lodcontent_incr_comp, lodcontent_incr_prep_comp, lodcontent_incr_mark_comp,
+        lodcontent_incr_keep_comp, lodcontent_wg_comp, lodcontent_count_comp, lodcontent_scatter_comp, lodscan_comp,
+        hiz_copy_comp, hiz_reduce_comp, lodbin_comp[4], lodviews_comp, particleslots_scatter_comp, particleslots_compact_comp;
+  };
+
+  // one set per combination of the global defines, USE_INDICES and
+  // PARTICLE_FORMAT, programs points to the one of the current settings
+  Programs programs = {};
+  Programs m_programVariants[2][NUM_PARTICLE_FORMATS] = {};
+  bool     m_programsValid = false;
 
   struct
   {
-    GLuint sphere_vbo      = 0;
-    GLuint sphere_ibo      = 0;
+    GLuint sphere_vbo[NUM_BATCH_MESHES] = {};
+    GLuint sphere_ibo[NUM_BATCH_MESHES] = {};
     GLuint scene_ubo       = 0;
+    GLuint views_ubo       = 0;
     GLuint particles       = 0;
     GLuint particleindices = 0;
-    GLuint lodparticles0   = 0;
-    GLuint lodparticles1   = 0;
-    GLuint lodparticles2   = 0;
+    GLuint clusters        = 0;
+    GLuint clustercache    = 0;
+    GLuint incrstate       = 0;
+    GLuint velocities      = 0;
+    GLuint groupcounts     = 0;
+    GLuint lodlists        = 0;
+    GLuint lodscratch      = 0;
+    GLuint lodbins         = 0;
     GLuint lodcmds;
+    GLuint lodmultidraw = 0;
+    GLuint lodstats     = 0;
+    GLuint lodstatsread = 0;
   } buffers;
 
+  // buffers.lodlists/lodcmds/lodmultidraw name the set in use, the second
+  // set only exists when pipelined
+  struct LodSet
+  {
+    GLuint lodlists     = 0;
+    GLuint lodcmds      = 0;
+    GLuint lodmultidraw = 0;
+  };
+  // without multi draw the jobs cycle through m_jobSlots list ranges
+  int      m_jobSlots = 1;
+  LodSet   m_lodSets[2];
+  uint32_t m_lodSetDrawn = 0;  // set with the latest lists
+  bool     m_lodSetValid = false;
+
   struct
   {
     GLuint particles    = 0;
     GLuint lodparticles = 0;
+    GLuint sceneColor   = 0;
+    GLuint sceneDepth   = 0;
+    GLuint hiz          = 0;
   } textures;
 
+  struct
+  {
+    GLuint scene = 0;
+  } framebuffers;
+
   struct Tweak
   {
     int   particleCount = 0xFFFFF;
@@ -145,12 +248,37 @@ class Sample : public nvgl::AppWindowProfilerGL
     bool  pause         = false;
     bool  uselod        = true;
     bool  nolodtess     = false;
+    int   lodLevels     = 3;
     bool  wireframe     = false;
     bool  useindices    = true;
     bool  usecompute    = true;
+    bool  useclusters   = false;
+    bool  incremental   = false;
+    bool  multidraw     = false;
+    int   pipeline      = PIPELINE_OFF;
+    int   listMemoryMB  = 0;  // for the lists of several jobs, 0 one job
+    int   views         = 1;
+    float viewSeparation = 0.02f;  // of the scene dimension
+    int   appendMode    = APPEND_ATOMIC;
+    int   particleFormat = PARTICLE_FORMAT_FULL;
+    bool  simulate      = false;
+    float simulateStep  = 1.0f / 60.0f;
+    bool  occlusion     = false;
+    bool  usecpu        = false;
+    int   cpuThreads    = 0;
+    bool  morton        = false;
+    bool  depthBins     = false;
+    int   budgetMode    = BUDGET_OFF;
+    float budgetMs      = 8.0f;
+    float budgetMTris   = 20.0f;
+    int   churn         = 0;  // particles killed and spawned per frame
+    int   compactInterval = 64;  // frames, 0 never
+    int   batchSizes[NUM_BATCH_MESHES] = {PARTICLE_BATCHSIZE, PARTICLE_BATCHSIZE, PARTICLE_BATCHSIZE, PARTICLE_BATCHSIZE,
+                                          PARTICLE_BATCHSIZE};
   };
 
-  nvgl::ProgramManager m_progManager;
+  ProgramCache         m_programCache;
+  std::string          m_programCacheFile;
 
   ImGuiH::Registry m_ui;
   double           m_uiTime;
@@ -160,6 +288,154 @@ class Sample : public nvgl::AppWindowProfilerGL
 
   GLuint    m_workGroupSize[3];
   SceneData m_sceneUbo;
+  // with several views m_sceneUbo is view 0, every view has its own range
+  // of the scene ubo
+  SceneData m_viewScenes[LOD_MAX_VIEWS];
+  ViewData  m_viewData[LOD_MAX_VIEWS];
+  int       m_clusterCount = 0;
+
+  // depth range of the projection
+  float m_nearPlane = 0.1f;
+  float m_farPlane  = 1000.0f;
+
+  // lod chain, the edited thresholds are scaled by the budget
+  // controller into m_sceneUbo.lodTable. Mesh levels use the icosphere
+  // of m_lodSubdiv, or impostors for LOD_IMPOSTOR.
+  static const int LOD_IMPOSTOR = -1;
+  float    m_lodPixels[LOD_MAX_LEVELS] = {};
+  float    m_tessPixels                = 10.0f;
+  int      m_lodSubdiv[LOD_MAX_LEVELS] = {};
+  uint32_t m_sphereVertices[NUM_BATCH_MESHES];
+  uint32_t m_sphereIndices[NUM_BATCH_MESHES];
+  // unbatched meshes, the impostor has a single vertex and no triangles
+  nvh::geometry::Mesh<vec4> m_batchMeshes[NUM_BATCH_MESHES];
+
+  // batch sizes can be tuned per mesh type, based on the time of the
+  // sections drawing them
+  Autotuner m_autotuner;
+  bool      m_autotune = false;
+
+  // incremental classification, relative to the scene of the last run
+  SceneData m_incrScene;
+  bool      m_incrValid = false;
+  bool      m_incrReset = false;
+  vec4      m_incrDelta[7];
+  float     m_incrScale = 0.0f;
+  // the lists of the last run were kept, their counters are still set
+  bool      m_incrListsKept = false;
+
+  // larger relative changes of the lod thresholds reset the cache
+  static constexpr float INCR_MAX_SCALE = 0.25f;
+
+  SectionTimers  m_benchTimers;
+  SweepBenchmark m_sweep;
+  std::string    m_sweepSpec;
+  std::string    m_sweepOutput = "sweep.csv";
+  int            m_sweepWarmup = 32;
+  int            m_sweepFrames = 128;
+  bool           m_offscreen   = false;
+
+  // the cpu classifier works on decoded particles, lists are filled
+  // from the encoded ones (m_cpuSource, particle format stride)
+  CpuLodClassifier     m_cpuLod;
+  std::vector<uint8_t> m_cpuEncoded;
+  std::vector<uint8_t> m_cpuGather;
+  const uint8_t*       m_cpuSource = nullptr;
+  // simulation state of the cpu reference
+  std::vector<Particle> m_cpuDecoded;
+  std::vector<vec4>     m_cpuVelocities;
+
+  // depth pyramid of the previous frame for occlusion culling
+  bool m_hizValid  = false;
+  int  m_hizLevels = 0;
+  mat4 m_hizViewProj;
+  vec4 m_hizEyePos;
+
+  // lod statistics are read back a few frames later without stalling,
+  // culled = processed - accepted - occluded
+  static const uint32_t STATS_FRAMES = 4;
+  struct StatsReadback
+  {
+    GLsync   fence     = nullptr;
+    uint32_t processed = 0;
+  };
+  StatsReadback m_statsReadback[STATS_FRAMES];
+  uint32_t      m_statsFrame     = 0;
+  LodStats      m_lodStats       = {};
+  uint32_t      m_lodProcessed   = 0;
+  uint32_t      m_lodStatsRead   = 0;
+  // persistent mapping of buffers.lodstatsread, one LodStats per slot
+  const LodStats* m_lodStatsMapping = nullptr;
+  // logs the statistics every n readbacks, 0 never
+  int m_statsLog = 0;
+
+  // -validate compares the gpu classification and commands against the
+  // cpu classifier for every camera pose and classification path, then
+  // closes the application
+  static const int VALIDATE_POSES = 4;
+  static const int VALIDATE_PATHS = 5;
+  bool             m_validate        = false;
+  int              m_validateStep    = -1;
+  bool             m_validatePending = false;
+  uint32_t         m_validateErrors  = 0;
+
+  uint32_t getLodCulled() const
+  {
+    return m_lodProcessed - std::min(m_lodProcessed, m_lodStats.accepted + m_lodStats.occluded);
+  }
+
+  // adjusts the lod thresholds once new timings or statistics arrived
+  LodBudget         m_budget;
+  LodBudget::Config m_budgetConfig;
+  LodCostModel      m_costModel;
+  uint32_t          m_budgetSample = 0;
+
+  // particles from file are streamed in chunks, only the loaded ones
+  // are classified
+  std::string          m_particleFile;
+  std::string          m_exportFile;
+  std::string          m_importFile;
+  float                m_importSize = 0;
+  ParticleFile         m_file;
+  StagingRing          m_staging;
+  size_t               m_streamLoaded = 0;
+  // leading entries of particleindices that hold their index
+  size_t                m_particleIndicesValid = 0;
+  // grid of the generated particles, kept while their count changes within it
+  struct
+  {
+    int    cube  = 0;
+    size_t count = 0;
+  } m_generated;
+  std::vector<int>      m_streamIndices;
+  std::vector<Cluster>  m_streamClusters;
+  std::vector<Particle> m_streamDecoded;
+  std::vector<uint8_t>  m_streamEncoded;
+
+  // particles added and removed at runtime, the slots in use form the
+  // active range that is classified
+  ParticleSlots                      m_slots;
+  uint32_t                           m_slotsFrame = 0;
+  std::vector<ParticleSlots::Handle> m_churnHandles;
+  std::vector<Particle>              m_churnParticles;
+  std::vector<vec4>                  m_churnVelocities;
+  std::vector<Cluster>               m_slotClusters;
+
+  // particles that are streamed in, afterwards the active range of the
+  // slots, which may grow beyond the particle count
+  int getActiveCount() const
+  {
+    return int(m_streamLoaded < size_t(m_tweak.particleCount) ? m_streamLoaded : m_slots.getSlotCount());
+  }
+  // slots the particle buffers and the jobs cover, churn spawns more
+  // particles than the count while the population swings
+  int getParticleCapacity() const
+  {
+    return m_tweak.churn > 0 ? m_tweak.particleCount + m_tweak.particleCount / 2 : m_tweak.particleCount;
+  }
+  // the slots keep a host copy that the clusters and the cpu classifier are
+  // rebuilt from, simulated particles only move on the gpu
+  bool keepsSlotParticles() const { return m_tweak.churn > 0 && !m_tweak.simulate; }
 
   nvh::CameraControl m_control;
 
@@ -168,14 +444,59 @@ class Sample : public nvgl::AppWindowProfilerGL
   void think(double time);
   void resize(int width, int height);
   void drawLod();
+  void drawLodViews();
+  void beginLodStats(uint32_t slot);
+  void endLodStats(uint32_t slot);
+  void classifyCpu(int offset, int cnt, size_t cmdOffset, size_t listOffset, size_t levelStride);
+  void classifyGpu(int offset, int cnt, size_t cmdOffset, size_t listOffset, size_t listSize, size_t levelStride, bool keepLists);
+  void binLodLists(int cnt, size_t cmdOffset, size_t listOffset, size_t listSize, size_t levelStride);
+  void useLodSet(uint32_t set);
+  void drawLodLists(bool multi, int i, int jobs, size_t jobSize, size_t levelStride, GLenum itemFormat, size_t itemSize, size_t listBase = 0);
+  void drawLodLevel(bool multi, int level, int i, int jobs, size_t jobSize, size_t levelStride, GLenum itemFormat, size_t listBase);
+  bool prepareIncremental();
+  bool keepsIncrementalLists() const;
 
-  void updateProgramDefines();
   bool initProgram();
+  bool initProgramVariants();
+  bool initProgramVariant(Programs& progs, bool useIndices, int particleFormat);
+  void selectPrograms();
   bool initParticleBuffer();
+  void generateParticles(size_t begin, size_t end, Particle* particles, vec4* velocities) const;
+  void resizeParticleBuffer();
+  bool initParticleFile();
+  void initParticleIndices(size_t count);
+  void initVelocities(std::vector<vec4>& velocities);
+  void streamParticles();
+  void updateParticleSlots();
+  void rebuildSlotParticles();
+  void churnParticles();
   bool initLodBuffers();
   bool initScene();
-
-  void end() { ImGui::ShutdownGL(); }
+  void initLodTable();
+  void updateLodTable();
+  void initBatchedMesh(int mesh);
+  int  getLevelMesh(int level) const;
+  void startAutotune();
+  void updateVertexFormat();
+  void setParticleAttribs(bool enabled);
+  bool initFramebuffers(int width, int height);
+  void buildHiz(int width, int height);
+  void readLodStats(uint32_t slot);
+  void updateBudget();
+  void initSweep();
+  void beginValidateStep();
+  void endValidateStep();
+  bool validateFrustum();
+
+  void end()
+  {
+    m_staging.deinit();
+    m_slots.deinit();
+    m_file.close();
+    m_programCache.deinit();
+    m_benchTimers.deinit();
+    ImGui::ShutdownGL();
+  }
   // return true to prevent m_windowState updates
   bool mouse_pos(int x, int y) { return ImGuiH::mouse_pos(x, y); }
   bool mouse_button(int button, int action) { return ImGuiH::mouse_button(button, action); }
@@ -184,6 +505,8 @@ class Sample : public nvgl::AppWindowProfilerGL
   bool key_button(int button, int action, int mods) { return ImGuiH::key_button(button, action, mods); }
 
 public:
+  uint32_t getValidateErrors() const { return m_validateErrors; }
+
   Sample()
   {
     m_parameterList.add("jobcount", &m_tweak.jobCount);
@@ -191,7 +514,43 @@ public:
     m_parameterList.add("uselod", &m_tweak.uselod);
     m_parameterList.add("usecompute", &m_tweak.usecompute);
     m_parameterList.add("useindices", &m_tweak.useindices);
+    m_parameterList.add("useclusters", &m_tweak.useclusters);
+    m_parameterList.add("incremental", &m_tweak.incremental);
+    m_parameterList.add("multidraw", &m_tweak.multidraw);
+    m_parameterList.add("pipeline", &m_tweak.pipeline);
+    m_parameterList.add("listmemory", &m_tweak.listMemoryMB);
+    m_parameterList.add("statslog", &m_statsLog);
+    m_parameterList.add("validate", &m_validate);
+    m_parameterList.add("views", &m_tweak.views);
+    m_parameterList.add("viewseparation", &m_tweak.viewSeparation);
+    m_parameterList.add("appendmode", &m_tweak.appendMode);
+    m_parameterList.add("particleformat", &m_tweak.particleFormat);
+    m_parameterList.add("simulate", &m_tweak.simulate);
+    m_parameterList.add("simulatestep", &m_tweak.simulateStep);
+    m_parameterList.add("occlusion", &m_tweak.occlusion);
     m_parameterList.add("nolodtess", &m_tweak.nolodtess);
+    m_parameterList.add("lodlevels", &m_tweak.lodLevels);
+    m_parameterList.add("morton", &m_tweak.morton);
+    m_parameterList.add("depthbins", &m_tweak.depthBins);
+    m_parameterList.add("batchsizes", m_tweak.batchSizes, nullptr, NUM_BATCH_MESHES);
+    m_parameterList.add("autotune", &m_autotune);
+    m_parameterList.add("budget", &m_tweak.budgetMode);
+    m_parameterList.add("budgetms", &m_tweak.budgetMs);
+    m_parameterList.add("budgetmtris", &m_tweak.budgetMTris);
+    m_parameterList.add("usecpu", &m_tweak.usecpu);
+    m_parameterList.add("cputhreads", &m_tweak.cpuThreads);
+    m_parameterList.add("churn", &m_tweak.churn);
+    m_parameterList.add("compactinterval", &m_tweak.compactInterval);
+    m_parameterList.add("offscreen", &m_offscreen);
+    m_parameterList.add("sweep", &m_sweepSpec);
+    m_parameterList.add("sweepoutput", &m_sweepOutput);
+    m_parameterList.add("sweepwarmup", &m_sweepWarmup);
+    m_parameterList.add("sweepframes", &m_sweepFrames);
+    m_parameterList.add("particlefile", &m_particleFile);
+    m_parameterList.add("exportparticles", &m_exportFile);
+    m_parameterList.add("importpoints", &m_importFile);
+    m_parameterList.add("importsize", &m_importSize);
+    m_parameterList.add("programcache", &m_programCacheFile);
     m_parameterList.add("fov", &m_tweak.fov);
   }
 };
@@ -206,53 +565,379 @@ static size_t snapsize(size_t input, size_t align)
   return ((input + align - 1) / align) * align;
 }
 
-void Sample::updateProgramDefines()
+// indirect commands are written by std430 shaders and read by std140 ones
+static_assert(sizeof(DrawElements) == 32 && sizeof(DrawCounters) % 16 == 0, "unexpected DrawIndirects layout");
+
+// Buffers that change with the particle or job count grow geometrically and
+// are never shrunk, the callers keep track of the sizes in use. When growing,
+// preserve copies the old contents to the new buffer. Returns true if a new
+// buffer was created.
+static bool reserveBuffer(GLuint& buffer, size_t size, GLenum usage, bool preserve = false)
+{
+  GLint64 capacity = 0;
+  if(buffer)
+  {
+    glGetNamedBufferParameteri64v(buffer, GL_BUFFER_SIZE, &capacity);
+    if(size_t(capacity) >= size)
+    {
+      return false;
+    }
+  }
+
+  GLuint grown;
+  glCreateBuffers(1, &grown);
+  glNamedBufferData(grown, std::max(size, size_t(capacity) + size_t(capacity) / 2), NULL, usage);
+  if(buffer)
+  {
+    if(preserve)
+    {
+      glCopyNamedBufferSubData(buffer, grown, 0, 0, GLsizeiptr(capacity));
+    }
+    glDeleteBuffers(1, &buffer);
+  }
+  buffer = grown;
+  return true;
+}
+
+// counter based random numbers (pcg hash), every value only depends on
+// the particle index and the stream, so the results do not depend on the
+// number of threads used for generation
+static inline uint32_t hashIndex(uint32_t index)
+{
+  uint32_t state = index * 747796405u + 2891336453u;
+  uint32_t word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+static inline float hashFloat(uint32_t index, uint32_t stream)
+{
+  return float(hashIndex(hashIndex(index) + stream) >> 8) * (1.0f / 16777216.0f);
+}
+
+// runs fn(begin,end) for blocks of [0,count) on all hardware threads
+static void parallelRange(size_t count, size_t blockSize, const std::function<void(size_t, size_t)>& fn)
+{
+  size_t   numBlocks  = snapdiv(count, blockSize);
+  uint32_t numThreads = uint32_t(std::min(size_t(std::max(1u, std::thread::hardware_concurrency())), numBlocks));
+
+  std::atomic_size_t nextBlock(0);
+  auto               worker = [&]() {
+    size_t block;
+    while((block = nextBlock++) < numBlocks)
+    {
+      fn(block * blockSize, std::min(count, (block + 1) * blockSize));
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for(uint32_t t = 1; t < numThreads; t++)
+  {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for(auto& thread : threads)
+  {
+    thread.join();
+  }
+}
+
+// encodes the particles in the given format and replaces them with the
+// decoded result, so that clusters and the cpu classifier see exactly
+// what the shaders see
+static void encodeParticlesParallel(int format, const SceneData& scene, Particle* particles, size_t count, uint8_t* encoded)
+{
+  size_t stride = getParticleStride(format);
+  parallelRange(count, 64 * 1024, [&](size_t begin, size_t end) {
+    encodeParticles(format, scene, particles + begin, end - begin, encoded + stride * begin);
+    decodeParticles(format, scene, encoded + stride * begin, end - begin, particles + begin);
+  });
+}
+
+// interleaves the lower 21 bits of v with two zero bits each
+static uint64_t mortonSpread(uint32_t v)
+{
+  uint64_t x = v & 0x1fffff;
+  x          = (x | x << 32) & 0x1f00000000ffffull;
+  x          = (x | x << 16) & 0x1f0000ff0000ffull;
+  x          = (x | x << 8) & 0x100f00f00f00f00full;
+  x          = (x | x << 4) & 0x10c30c30c30c30c3ull;
+  x          = (x | x << 2) & 0x1249249249249249ull;
+  return x;
+}
+
+// reorders the particles (and their velocities) along a z-order curve
+// within their bounding box, so particles that are close in space are
+// close in memory, which helps the texel fetches of the draws as well as
+// the clusters built from consecutive particles
+static void sortParticlesMorton(std::vector<Particle>& particles, std::vector<vec4>& velocities)
+{
+  vec3 bboxMin = vec3(FLT_MAX);
+  vec3 bboxMax = vec3(-FLT_MAX);
+  for(const Particle& particle : particles)
+  {
+    bboxMin = glm::min(bboxMin, vec3(particle.posSize));
+    bboxMax = glm::max(bboxMax, vec3(particle.posSize));
+  }
+  vec3 scale = float((1 << 21) - 1) / glm::max(bboxMax - bboxMin, vec3(FLT_MIN));
+
+  std::vector<std::pair<uint64_t, uint32_t>> keys(particles.size());
+  parallelRange(particles.size(), 64 * 1024, [&](size_t begin, size_t end) {
+    for(size_t i = begin; i < end; i++)
+    {
+      uvec3 cell = uvec3((vec3(particles[i].posSize) - bboxMin) * scale);
+      keys[i]    = {mortonSpread(cell.x) | mortonSpread(cell.y) << 1 | mortonSpread(cell.z) << 2, uint32_t(i)};
+    }
+  });
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<Particle> sorted(particles.size());
+  std::vector<vec4>     sortedVelocities(velocities.size());
+  parallelRange(particles.size(), 64 * 1024, [&](size_t begin, size_t end) {
+    for(size_t i = begin; i < end; i++)
+    {
+      sorted[i] = particles[keys[i].second];
+      if(!velocities.empty())
+      {
+        sortedVelocities[i] = velocities[keys[i].second];
+      }
+    }
+  });
+  particles.swap(sorted);
+  velocities.swap(sortedVelocities);
+}
+
+// builds the clusters of the particles within [begin,end), begin must be
+// a multiple of PARTICLE_CLUSTERSIZE
+static void buildClusters(const Particle* particles, size_t begin, size_t end, Cluster* clusters)
+{
+  size_t numClusters = snapdiv(end - begin, PARTICLE_CLUSTERSIZE);
+
+  for(size_t c = 0; c < numClusters; c++)
+  {
+    Cluster& cluster = clusters[c];
+    cluster.first    = uint(begin + c * PARTICLE_CLUSTERSIZE);
+    cluster.count    = uint(std::min(end - cluster.first, size_t(PARTICLE_CLUSTERSIZE)));
+    cluster.sizeMin  = FLT_MAX;
+    cluster.sizeMax  = 0;
+
+    vec3 bboxMin = vec3(FLT_MAX);
+    vec3 bboxMax = vec3(-FLT_MAX);
+    for(uint i = cluster.first; i < cluster.first + cluster.count; i++)
+    {
+      vec3  pos  = vec3(particles[i].posSize);
+      float size = particles[i].posSize.w;
+      bboxMin         = glm::min(bboxMin, pos);
+      bboxMax         = glm::max(bboxMax, pos);
+      cluster.sizeMin = std::min(cluster.sizeMin, size);
+      cluster.sizeMax = std::max(cluster.sizeMax, size);
+    }
+
+    vec3  center = (bboxMin + bboxMax) * 0.5f;
+    float radius = 0;
+    for(uint i = cluster.first; i < cluster.first + cluster.count; i++)
+    {
+      radius = std::max(radius, glm::distance(center, vec3(particles[i].posSize)));
+    }
+
+    // slightly enlarged so rounding can not flip the conservative tests
+    cluster.bounds = vec4(center, radius * 1.001f + 0.0001f);
+  }
+}
+
+// splits every triangle into four, the new vertices are moved onto the
+// unit sphere
+static void subdivideSphere(const nvh::geometry::Mesh<vec4>& mesh, nvh::geometry::Mesh<vec4>& subdivided)
 {
-  m_progManager.m_prepend = std::string("");
-  m_progManager.m_prepend += nvgl::ProgramManager::format("#define USE_INDICES %d\n", m_tweak.useindices ? 1 : 0);
+  std::unordered_map<uint64_t, uint32_t> midpoints;
+
+  subdivided.m_vertices = mesh.m_vertices;
+  subdivided.m_indicesTriangles.clear();
+
+  auto midpoint = [&](uint32_t a, uint32_t b) {
+    uint64_t key = (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+    auto     it  = midpoints.find(key);
+    if(it != midpoints.end())
+    {
+      return it->second;
+    }
+    uint32_t index = uint32_t(subdivided.m_vertices.size());
+    vec3     pos   = glm::normalize(vec3(mesh.m_vertices[a]) + vec3(mesh.m_vertices[b]));
+    subdivided.m_vertices.push_back(vec4(pos, 1.0f));
+    midpoints[key] = index;
+    return index;
+  };
+
+  for(const glm::uvec3& tri : mesh.m_indicesTriangles)
+  {
+    uint32_t ab = midpoint(tri.x, tri.y);
+    uint32_t bc = midpoint(tri.y, tri.z);
+    uint32_t ca = midpoint(tri.z, tri.x);
+    subdivided.m_indicesTriangles.push_back(glm::uvec3(tri.x, ab, ca));
+    subdivided.m_indicesTriangles.push_back(glm::uvec3(ab, tri.y, bc));
+    subdivided.m_indicesTriangles.push_back(glm::uvec3(ca, bc, tri.z));
+    subdivided.m_indicesTriangles.push_back(glm::uvec3(ab, bc, ca));
+  }
 }
 
 bool Sample::initProgram()
 {
-  bool validated(true);
-  m_progManager.m_filetype = nvh::ShaderFileManager::FILETYPE_GLSL;
-  m_progManager.addDirectory(std::string("GLSL_" PROJECT_NAME));
-  m_progManager.addDirectory(exePath() + std::string(PROJECT_RELDIRECTORY));
+  m_programCache.m_filetype = nvh::ShaderFileManager::FILETYPE_GLSL;
+  m_programCache.addDirectory(std::string("GLSL_" PROJECT_NAME));
+  m_programCache.addDirectory(exePath() + std::string(PROJECT_RELDIRECTORY));
+
+  m_programCache.registerInclude("common.h");
+
+  if(m_programCacheFile.empty())
+  {
+    m_programCacheFile = exePath() + std::string(PROJECT_NAME "_programs.bin");
+  }
+  m_programCache.init(m_programCacheFile);
+
+  return initProgramVariants();
+}
+
+// all variants are built up front, from the cache this is fast, so that
+// switching "use indexing" or the particle format only selects another set
+bool Sample::initProgramVariants()
+{
+  auto begin = std::chrono::steady_clock::now();
+
+  m_programsValid = true;
+  for(int i = 0; i < 2; i++)
+  {
+    for(int f = 0; f < NUM_PARTICLE_FORMATS; f++)
+    {
+      m_programsValid = initProgramVariant(m_programVariants[i][f], i != 0, f) && m_programsValid;
+    }
+  }
+  m_programCache.save();
+
+  std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - begin;
+  LOGI("programs: %u linked from cache, %u compiled, %.1f ms\n", m_programCache.getLoaded(),
+       m_programCache.getCompiled(), duration.count());
+
+  selectPrograms();
+  return m_programsValid;
+}
+
+void Sample::selectPrograms()
+{
+  programs = m_programVariants[m_tweak.useindices ? 1 : 0][m_tweak.particleFormat];
+  if(programs.lodcontent_comp)
+  {
+    glGetProgramiv(programs.lodcontent_comp, GL_COMPUTE_WORK_GROUP_SIZE, (GLint*)m_workGroupSize);
+  }
+}
+
+bool Sample::initProgramVariant(Programs& progs, bool useIndices, int particleFormat)
+{
+  m_programCache.m_prepend = std::string("#define USE_INDICES ") + (useIndices ? "1" : "0") + "\n";
+  m_programCache.m_prepend += std::string("#define PARTICLE_FORMAT ") + std::to_string(particleFormat) + "\n";
+
+  progs.draw_sphere_point =
+      m_programCache.createProgram(ProgramCache::Definition(GL_VERTEX_SHADER, "spherepoint.vert.glsl"),
+                                   ProgramCache::Definition(GL_FRAGMENT_SHADER, "spherepoint.frag.glsl"));
+  progs.draw_sphere = m_programCache.createProgram(ProgramCache::Definition(GL_VERTEX_SHADER, "sphere.vert.glsl"),
+                                                   ProgramCache::Definition(GL_FRAGMENT_SHADER, "sphere.frag.glsl"));
+
+  progs.draw_sphere_tess =
+      m_programCache.createProgram(ProgramCache::Definition(GL_VERTEX_SHADER, "spheretess.vert.glsl"),
+                                   ProgramCache::Definition(GL_TESS_CONTROL_SHADER, "spheretess.tctrl.glsl"),
+                                   ProgramCache::Definition(GL_TESS_EVALUATION_SHADER, "spheretess.teval.glsl"),
+                                   ProgramCache::Definition(GL_FRAGMENT_SHADER, "sphere.frag.glsl"));
+
+  // use gl_BaseInstanceARB instead of UNI_USE_CMDOFFSET
+  progs.draw_sphere_mdi = m_programCache.createProgram(
+      ProgramCache::Definition(GL_VERTEX_SHADER, "#define USE_BASEINSTANCE 1\n", "sphere.vert.glsl"),
+      ProgramCache::Definition(GL_FRAGMENT_SHADER, "sphere.frag.glsl"));
 
-  m_progManager.registerInclude("common.h");
+  progs.draw_sphere_tess_mdi = m_programCache.createProgram(
+      ProgramCache::Definition(GL_VERTEX_SHADER, "#define USE_BASEINSTANCE 1\n", "spheretess.vert.glsl"),
+      ProgramCache::Definition(GL_TESS_CONTROL_SHADER, "spheretess.tctrl.glsl"),
+      ProgramCache::Definition(GL_TESS_EVALUATION_SHADER, "spheretess.teval.glsl"),
+      ProgramCache::Definition(GL_FRAGMENT_SHADER, "sphere.frag.glsl"));
 
-  updateProgramDefines();
+  progs.draw_sphere_impostor =
+      m_programCache.createProgram(ProgramCache::Definition(GL_VERTEX_SHADER, "sphereimpostor.vert.glsl"),
+                                   ProgramCache::Definition(GL_FRAGMENT_SHADER, "sphereimpostor.frag.glsl"));
 
-  programs.draw_sphere_point =
-      m_progManager.createProgram(nvgl::ProgramManager::Definition(GL_VERTEX_SHADER, "spherepoint.vert.glsl"),
-                                  nvgl::ProgramManager::Definition(GL_FRAGMENT_SHADER, "spherepoint.frag.glsl"));
-  programs.draw_sphere = m_progManager.createProgram(nvgl::ProgramManager::Definition(GL_VERTEX_SHADER, "sphere.vert.glsl"),
-                                                     nvgl::ProgramManager::Definition(GL_FRAGMENT_SHADER, "sphere.frag.glsl"));
+  progs.draw_sphere_impostor_mdi = m_programCache.createProgram(
+      ProgramCache::Definition(GL_VERTEX_SHADER, "#define USE_BASEINSTANCE 1\n", "sphereimpostor.vert.glsl"),
+      ProgramCache::Definition(GL_FRAGMENT_SHADER, "sphereimpostor.frag.glsl"));
 
-  programs.draw_sphere_tess =
-      m_progManager.createProgram(nvgl::ProgramManager::Definition(GL_VERTEX_SHADER, "spheretess.vert.glsl"),
-                                  nvgl::ProgramManager::Definition(GL_TESS_CONTROL_SHADER, "spheretess.tctrl.glsl"),
-                                  nvgl::ProgramManager::Definition(GL_TESS_EVALUATION_SHADER, "spheretess.teval.glsl"),
-                                  nvgl::ProgramManager::Definition(GL_FRAGMENT_SHADER, "sphere.frag.glsl"));
+  progs.lodcontent = m_programCache.createProgram(ProgramCache::Definition(GL_VERTEX_SHADER, "lodcontent.vert.glsl"));
 
-  programs.lodcontent = m_progManager.createProgram(nvgl::ProgramManager::Definition(GL_VERTEX_SHADER, "lodcontent.vert.glsl"));
+  progs.lodcmds = m_programCache.createProgram(ProgramCache::Definition(GL_VERTEX_SHADER, "lodcmds.vert.glsl"));
 
-  programs.lodcmds = m_progManager.createProgram(nvgl::ProgramManager::Definition(GL_VERTEX_SHADER, "lodcmds.vert.glsl"));
+  progs.lodcontent_comp = m_programCache.createProgram(
+      ProgramCache::Definition(GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n", "lodcontent.vert.glsl"));
 
-  programs.lodcontent_comp = m_progManager.createProgram(
-      nvgl::ProgramManager::Definition(GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n", "lodcontent.vert.glsl"));
+  progs.lodcontent_cluster_comp = m_programCache.createProgram(ProgramCache::Definition(
+      GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n#define USE_CLUSTERS 1\n", "lodcontent.vert.glsl"));
 
-  programs.lodcmds_comp = m_progManager.createProgram(
-      nvgl::ProgramManager::Definition(GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n", "lodcmds.vert.glsl"));
+  progs.lodcontent_incr_comp = m_programCache.createProgram(ProgramCache::Definition(
+      GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n#define USE_CLUSTERS 1\n#define USE_INCREMENTAL 1\n", "lodcontent.vert.glsl"));
 
-  validated = m_progManager.areProgramsValid();
+  progs.lodcontent_incr_prep_comp = m_programCache.createProgram(
+      ProgramCache::Definition(GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n#define USE_CLUSTERS 1\n#define USE_INCREMENTAL 2\n#define INCR_PASS 0\n",
+                               "lodcontent.vert.glsl"));
 
-  if(validated)
+  progs.lodcontent_incr_mark_comp = m_programCache.createProgram(
+      ProgramCache::Definition(GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n#define USE_CLUSTERS 1\n#define USE_INCREMENTAL 2\n#define INCR_PASS 1\n",
+                               "lodcontent.vert.glsl"));
+
+  progs.lodcontent_incr_keep_comp = m_programCache.createProgram(
+      ProgramCache::Definition(GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n#define USE_CLUSTERS 1\n#define USE_INCREMENTAL 2\n#define INCR_PASS 2\n",
+                               "lodcontent.vert.glsl"));
+
+  progs.lodcontent_wg_comp = m_programCache.createProgram(ProgramCache::Definition(
+      GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n#define APPEND_MODE 1\n", "lodcontent.vert.glsl"));
+
+  progs.lodcontent_count_comp = m_programCache.createProgram(ProgramCache::Definition(
+      GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n#define APPEND_MODE 2\n#define ORDERED_PASS 0\n", "lodcontent.vert.glsl"));
+
+  progs.lodcontent_scatter_comp = m_programCache.createProgram(ProgramCache::Definition(
+      GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n#define APPEND_MODE 2\n#define ORDERED_PASS 1\n", "lodcontent.vert.glsl"));
+
+  progs.lodscan_comp = m_programCache.createProgram(ProgramCache::Definition(GL_COMPUTE_SHADER, "lodscan.comp.glsl"));
+
+  for(int pass = 0; pass < 4; pass++)
   {
-    glGetProgramiv(m_progManager.get(programs.lodcontent_comp), GL_COMPUTE_WORK_GROUP_SIZE, (GLint*)m_workGroupSize);
+    std::string defines     = std::string("#define BIN_PASS ") + std::to_string(pass) + "\n";
+    progs.lodbin_comp[pass] = m_programCache.createProgram(ProgramCache::Definition(GL_COMPUTE_SHADER, defines, "lodbin.comp.glsl"));
   }
 
-  return validated;
+  progs.hiz_copy_comp = m_programCache.createProgram(
+      ProgramCache::Definition(GL_COMPUTE_SHADER, "#define HIZ_COPY 1\n", "hiz.comp.glsl"));
+
+  progs.hiz_reduce_comp = m_programCache.createProgram(ProgramCache::Definition(GL_COMPUTE_SHADER, "hiz.comp.glsl"));
+
+  progs.lodcmds_comp = m_programCache.createProgram(
+      ProgramCache::Definition(GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n", "lodcmds.vert.glsl"));
+
+  progs.lodcmds_mdi = m_programCache.createProgram(
+      ProgramCache::Definition(GL_VERTEX_SHADER, "#define USE_MULTIDRAW 1\n", "lodcmds.vert.glsl"));
+
+  progs.lodcmds_mdi_comp = m_programCache.createProgram(ProgramCache::Definition(
+      GL_COMPUTE_SHADER, "#define USE_COMPUTE 1\n#define USE_MULTIDRAW 1\n", "lodcmds.vert.glsl"));
+
+  progs.lodviews_comp = m_programCache.createProgram(ProgramCache::Definition(GL_COMPUTE_SHADER, "lodviews.comp.glsl"));
+
+  progs.particleslots_scatter_comp = m_programCache.createProgram(
+      ProgramCache::Definition(GL_COMPUTE_SHADER, "#define SLOTS_SCATTER 1\n", "particleslots.comp.glsl"));
+
+  progs.particleslots_compact_comp = m_programCache.createProgram(
+      ProgramCache::Definition(GL_COMPUTE_SHADER, "#define SLOTS_SCATTER 0\n", "particleslots.comp.glsl"));
+
+  // a zero program failed to build
+  static_assert(sizeof(Programs) % sizeof(GLuint) == 0, "Programs must only contain GLuint");
+  const GLuint* ids = (const GLuint*)&progs;
+  for(size_t i = 0; i < sizeof(Programs) / sizeof(GLuint); i++)
+  {
+    if(!ids[i])
+      return false;
+  }
+  return true;
 }
 
 bool Sample::initScene()
@@ -283,219 +968,1891 @@ bool Sample::initScene()
 
     icosahedron.flipWinding();
 
-    nvh::geometry::Mesh<vec4> batched;
-    for(int i = 0; i < PARTICLE_BATCHSIZE; i++)
+    // the mesh levels use icospheres, subdivision 0 is the icosahedron
+    // itself, which is also used for the tessellated level
+    nvh::geometry::Mesh<vec4> sphere = icosahedron;
+    for(int s = 0; s <= LOD_MAX_SUBDIV; s++)
     {
-      batched.append(icosahedron);
+      if(s > 0)
+      {
+        nvh::geometry::Mesh<vec4> subdivided;
+        subdivideSphere(sphere, subdivided);
+        sphere = subdivided;
+      }
+      m_batchMeshes[BATCH_ICOSPHERE + s] = sphere;
     }
+    m_batchMeshes[BATCH_TESS] = icosahedron;
+    m_batchMeshes[BATCH_IMPOSTOR].m_vertices.assign(1, vec4(0.0f));
+    m_batchMeshes[BATCH_IMPOSTOR].m_indicesTriangles.clear();
 
-    nvgl::newBuffer(buffers.sphere_ibo);
-    glNamedBufferData(buffers.sphere_ibo, batched.getTriangleIndicesSize(), &batched.m_indicesTriangles[0], GL_STATIC_DRAW);
-
-    nvgl::newBuffer(buffers.sphere_vbo);
-    glNamedBufferData(buffers.sphere_vbo, batched.getVerticesSize(), &batched.m_vertices[0], GL_STATIC_DRAW);
+    for(int m = 0; m < NUM_BATCH_MESHES; m++)
+    {
+      initBatchedMesh(m);
+    }
 
-#if USE_COMPACT_PARTICLE
-    glVertexAttribFormat(VERTEX_POS, 3, GL_FLOAT, GL_FALSE, 0);
-    glVertexAttribFormat(VERTEX_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(Particle, posColor.w));
-#else
-    glVertexAttribFormat(VERTEX_POS, 4, GL_FLOAT, GL_FALSE, 0);
-    glVertexAttribFormat(VERTEX_COLOR, 4, GL_FLOAT, GL_FALSE, offsetof(Particle, color));
-#endif
-    glVertexAttribBinding(VERTEX_POS, 0);
-    glVertexAttribBinding(VERTEX_COLOR, 0);
+    updateVertexFormat();
   }
 
 
   {  // Scene UBO
     nvgl::newBuffer(buffers.scene_ubo);
-    glNamedBufferData(buffers.scene_ubo, sizeof(SceneData), NULL, GL_DYNAMIC_DRAW);
+    glNamedBufferData(buffers.scene_ubo, snapsize(sizeof(SceneData), 256) * LOD_MAX_VIEWS, NULL, GL_DYNAMIC_DRAW);
+
+    nvgl::newBuffer(buffers.views_ubo);
+    glNamedBufferData(buffers.views_ubo, sizeof(ViewData) * LOD_MAX_VIEWS, NULL, GL_DYNAMIC_DRAW);
   }
 
   return true;
 }
-bool Sample::initParticleBuffer()
+
+// replicates the mesh batch size times, instance i of a draw covers the
+// particles [i * batch, (i + 1) * batch) of a list
+void Sample::initBatchedMesh(int mesh)
 {
-  {
-    std::vector<Particle> particles(m_tweak.particleCount);
-    std::vector<int>      particleindices(m_tweak.particleCount);
+  nvh::geometry::Mesh<vec4>& single = m_batchMeshes[mesh];
 
-    int cube = 1;
-    while(cube * cube * (cube / 4) < m_tweak.particleCount)
+  int& batchSize = m_tweak.batchSizes[mesh];
+  batchSize      = std::max(1, std::min(8192, batchSize));
+
+  std::vector<vec4>     vertices;
+  std::vector<uint32_t> indices;
+  if(mesh == BATCH_IMPOSTOR)
+  {
+    // one point per particle
+    vertices.resize(batchSize, vec4(0.0f));
+    for(int i = 0; i < batchSize; i++)
+    {
+      indices.push_back(uint32_t(i));
+    }
+    m_sphereVertices[mesh] = 1;
+    m_sphereIndices[mesh]  = 1;
+  }
+  else
+  {
+    nvh::geometry::Mesh<vec4> batched;
+    for(int i = 0; i < batchSize; i++)
     {
-      cube++;
+      batched.append(single);
     }
+    vertices = batched.m_vertices;
+    indices.assign((const uint32_t*)batched.m_indicesTriangles.data(),
+                   (const uint32_t*)batched.m_indicesTriangles.data() + batched.m_indicesTriangles.size() * 3);
+    m_sphereVertices[mesh] = uint32_t(single.m_vertices.size());
+    m_sphereIndices[mesh]  = uint32_t(single.m_indicesTriangles.size() * 3);
+  }
 
-    float scale             = 128.0f / float(cube);
-    m_sceneUbo.particleSize = scale * 0.375f;
+  nvgl::newBuffer(buffers.sphere_ibo[mesh]);
+  glNamedBufferData(buffers.sphere_ibo[mesh], sizeof(uint32_t) * indices.size(), indices.data(), GL_STATIC_DRAW);
 
-    srand(47345356);
+  nvgl::newBuffer(buffers.sphere_vbo[mesh]);
+  glNamedBufferData(buffers.sphere_vbo[mesh], sizeof(vec4) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+}
 
-    for(int i = 0; i < m_tweak.particleCount; i++)
-    {
-      int x = i % cube;
-      int z = (i / cube) % (cube);
-      int y = i / (cube * cube);
+int Sample::getLevelMesh(int level) const
+{
+  if(level == m_tweak.lodLevels - 1)
+  {
+    return BATCH_TESS;
+  }
+  return m_lodSubdiv[level] == LOD_IMPOSTOR ? BATCH_IMPOSTOR : BATCH_ICOSPHERE + m_lodSubdiv[level];
+}
 
-      vec3 pos = (vec3(0, nvh::frand(), 0) - 0.5f) * 0.1f;
-      pos += vec3(x, y, z);
-      pos -= vec3(cube, cube / 4, cube) * 0.5f;
-      pos *= vec3(1, 4, 1);
-      float size = (1.0f + nvh::frand() * 1.0f) * 0.25f;
+// default chain for the current number of levels, the thresholds are
+// spread geometrically between the far and near pixel sizes of the
+// classic point / icosahedron / tessellation setup. From 4 levels on
+// the first level after the points uses impostors.
+void Sample::initLodTable()
+{
+  const float farPixels  = 1.5f;
+  const float nearPixels = 10.0f;
 
-      vec4 color = vec4(nvh::frand(), nvh::frand(), nvh::frand(), 1.0f);
-#if USE_COMPACT_PARTICLE
-      union
-      {
-        GLubyte color[4];
-        float   rawFloat;
-      } packed;
-      packed.color[0] = GLubyte(color.x * 255.0);
-      packed.color[1] = GLubyte(color.y * 255.0);
-      packed.color[2] = GLubyte(color.z * 255.0);
-      packed.color[3] = GLubyte(color.w * 255.0);
+  m_tweak.lodLevels = std::max(2, std::min(LOD_MAX_LEVELS, m_tweak.lodLevels));
+  int levels        = m_tweak.lodLevels;
 
-      particles[i].posColor = vec4(pos * scale, packed.rawFloat);
-#else
-      particles[i].posSize = vec4(pos, size) * scale;
-      particles[i].color   = color;
-#endif
-      particleindices[i] = i;
+  for(int l = 0; l < LOD_MAX_LEVELS; l++)
+  {
+    float t = levels > 2 ? float(l - 1) / float(levels - 2) : 0.0f;
+    m_lodPixels[l] = l ? farPixels * powf(nearPixels / farPixels, t) : 0.0f;
+    if(levels >= 4)
+    {
+      m_lodSubdiv[l] = l == 1 ? LOD_IMPOSTOR : std::max(0, std::min(l - 2, LOD_MAX_SUBDIV));
     }
+    else
+    {
+      m_lodSubdiv[l] = std::max(0, std::min(l - 1, LOD_MAX_SUBDIV));
+    }
+  }
+  updateLodTable();
+}
 
-    nvgl::newBuffer(buffers.particles);
-    glNamedBufferData(buffers.particles, sizeof(Particle) * m_tweak.particleCount, &particles[0], GL_STATIC_DRAW);
-
-    nvgl::newBuffer(buffers.particleindices);
-    glNamedBufferData(buffers.particleindices, sizeof(int) * m_tweak.particleCount, &particleindices[0], GL_STATIC_DRAW);
-
-    nvgl::newTexture(textures.particles, GL_TEXTURE_BUFFER);
-    glTextureBuffer(textures.particles, GL_RGBA32F, buffers.particles);
+void Sample::updateLodTable()
+{
+  int   levels          = m_tweak.lodLevels;
+  float scale           = m_budget.getScale();
+  m_sceneUbo.lodLevels  = uint(levels);
+  m_sceneUbo.tessPixels = m_tessPixels * scale;
 
-    GLint maxtexels = 1;
-    GLint texels    = m_tweak.particleCount * (sizeof(Particle) / sizeof(vec4));
-    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxtexels);
-    if(texels > maxtexels)
+  for(int l = 1; l < LOD_MAX_LEVELS; l++)
+  {
+    LodLevel& level = m_sceneUbo.lodTable[l];
+    // the classification expects ascending thresholds
+    m_lodPixels[l] = std::max(m_lodPixels[l], m_lodPixels[l - 1]);
+    level.pixels   = m_lodPixels[l] * scale;
+    if(l >= levels)
+    {
+      level.indices = 0;
+      level.batch   = 1;
+    }
+    else
     {
-      LOGI("\nWARNING: buffer size too big for texturebuffer: %d max %d\n", texels, maxtexels);
+      int mesh      = getLevelMesh(l);
+      level.indices = m_sphereIndices[mesh];
+      level.batch   = uint(m_tweak.batchSizes[mesh]);
     }
   }
-
-  return true;
+  m_sceneUbo.lodTable[0].pixels  = 0;
+  m_sceneUbo.lodTable[0].indices = 0;
+  m_sceneUbo.lodTable[0].batch   = 1;
 }
 
-bool Sample::initLodBuffers()
+void Sample::updateVertexFormat()
 {
-  size_t itemSize;
-  GLenum itemFormat;
-  int    itemTexels;
+  // VERTEX_POS is shared with the sphere mesh (vec4 per vertex), the
+  // quantized particles use their own integer attribute
+  switch(m_tweak.particleFormat)
+  {
+    case PARTICLE_FORMAT_COMPACT:
+      glVertexAttribFormat(VERTEX_POS, 3, GL_FLOAT, GL_FALSE, 0);
+      glVertexAttribFormat(VERTEX_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(ParticleCompact, posColor.w));
+      break;
+    case PARTICLE_FORMAT_QUANT:
+      glVertexAttribFormat(VERTEX_POS, 4, GL_FLOAT, GL_FALSE, 0);
+      glVertexAttribIFormat(VERTEX_PARTICLE, 2, GL_UNSIGNED_INT, 0);
+      break;
+    default:
+      glVertexAttribFormat(VERTEX_POS, 4, GL_FLOAT, GL_FALSE, 0);
+      glVertexAttribFormat(VERTEX_COLOR, 4, GL_FLOAT, GL_FALSE, offsetof(Particle, color));
+      break;
+  }
+  glVertexAttribBinding(VERTEX_POS, 0);
+  glVertexAttribBinding(VERTEX_COLOR, 0);
+  glVertexAttribBinding(VERTEX_PARTICLE, 0);
+}
 
-  if(m_tweak.useindices)
+void Sample::setParticleAttribs(bool enabled)
+{
+  if(m_tweak.particleFormat == PARTICLE_FORMAT_QUANT)
   {
-    itemSize   = sizeof(int);
-    itemFormat = GL_R32I;
-    itemTexels = 1;
+    if(enabled)
+      glEnableVertexAttribArray(VERTEX_PARTICLE);
+    else
+      glDisableVertexAttribArray(VERTEX_PARTICLE);
   }
   else
   {
-    itemSize   = sizeof(Particle);
-    itemFormat = GL_RGBA32F;
-    itemTexels = sizeof(Particle) / sizeof(vec4);
+    if(enabled)
+    {
+      glEnableVertexAttribArray(VERTEX_POS);
+      glEnableVertexAttribArray(VERTEX_COLOR);
+    }
+    else
+    {
+      glDisableVertexAttribArray(VERTEX_POS);
+      glDisableVertexAttribArray(VERTEX_COLOR);
+    }
   }
-  //size_t size   = snapsize(itemSize * tweak.particleCount, 256);
-  size_t size = snapsize(itemSize * (m_tweak.particleCount / m_tweak.jobCount), 256);
+}
 
-  GLint maxtexels = 1;
-  GLint texels    = int(size / itemSize) * itemTexels;
-  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxtexels);
-  if(texels > maxtexels)
-  {
-    LOGI("\nWARNING: buffer size too big for texturebuffer: %d max %d\n", texels, maxtexels);
-  }
+bool Sample::initFramebuffers(int width, int height)
+{
+  nvgl::newTexture(textures.sceneColor, GL_TEXTURE_2D);
+  glTextureStorage2D(textures.sceneColor, 1, GL_RGBA8, width, height);
 
-  nvgl::newBuffer(buffers.lodparticles0);
-  glNamedBufferData(buffers.lodparticles0, size, NULL, GL_DYNAMIC_COPY);
-  nvgl::newBuffer(buffers.lodparticles1);
-  glNamedBufferData(buffers.lodparticles1, size, NULL, GL_DYNAMIC_COPY);
-  nvgl::newBuffer(buffers.lodparticles2);
-  glNamedBufferData(buffers.lodparticles2, size, NULL, GL_DYNAMIC_COPY);
+  nvgl::newTexture(textures.sceneDepth, GL_TEXTURE_2D);
+  glTextureStorage2D(textures.sceneDepth, 1, GL_DEPTH24_STENCIL8, width, height);
 
-  nvgl::newTexture(textures.lodparticles, GL_TEXTURE_BUFFER);
-  glTextureBuffer(textures.lodparticles, itemFormat, buffers.lodparticles0);
+  nvgl::newFramebuffer(framebuffers.scene);
+  glNamedFramebufferTexture(framebuffers.scene, GL_COLOR_ATTACHMENT0, textures.sceneColor, 0);
+  glNamedFramebufferTexture(framebuffers.scene, GL_DEPTH_STENCIL_ATTACHMENT, textures.sceneDepth, 0);
 
-  nvgl::newBuffer(buffers.lodcmds);
-  glNamedBufferData(buffers.lodcmds, snapsize(sizeof(DrawIndirects), 256) * m_tweak.jobCount, NULL, GL_DYNAMIC_COPY);
-  glClearNamedBufferData(buffers.lodcmds, GL_RGBA32F, GL_RGBA, GL_FLOAT, NULL);
+  m_hizLevels = 1;
+  while((std::max(width, height) >> m_hizLevels) > 0)
+  {
+    m_hizLevels++;
+  }
+  nvgl::newTexture(textures.hiz, GL_TEXTURE_2D);
+  glTextureStorage2D(textures.hiz, m_hizLevels, GL_R32F, width, height);
+  m_hizValid = false;
 
-  return true;
+  return glCheckNamedFramebufferStatus(framebuffers.scene, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
 }
 
-bool Sample::begin()
+void Sample::buildHiz(int width, int height)
 {
-  ImGuiH::Init(m_windowState.m_winSize[0], m_windowState.m_winSize[1], this);
-  ImGui::InitGL();
+  PROFILE_SECTION("HiZ");
 
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  glEnable(GL_CULL_FACE);
-  glEnable(GL_DEPTH_TEST);
+  // level 0 copies the depth, every further level reduces the previous
+  glUseProgram(programs.hiz_copy_comp);
+  nvgl::bindMultiTexture(GL_TEXTURE0, GL_TEXTURE_2D, textures.sceneDepth);
+  glBindImageTexture(0, textures.hiz, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+  glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
 
-  bool validated(true);
+  glUseProgram(programs.hiz_reduce_comp);
+  nvgl::bindMultiTexture(GL_TEXTURE0, GL_TEXTURE_2D, textures.hiz);
+  for(int level = 1; level < m_hizLevels; level++)
+  {
+    int levelWidth  = std::max(1, width >> level);
+    int levelHeight = std::max(1, height >> level);
 
-  GLuint defaultVAO;
-  glGenVertexArrays(1, &defaultVAO);
-  glBindVertexArray(defaultVAO);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glUniform1i(UNI_HIZ_LEVEL, level - 1);
+    glBindImageTexture(0, textures.hiz, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute((levelWidth + 15) / 16, (levelHeight + 15) / 16, 1);
+  }
 
-  validated = validated && initProgram();
-  validated = validated && initScene();
-  validated = validated && initParticleBuffer();
-  validated = validated && initLodBuffers();
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+  nvgl::bindMultiTexture(GL_TEXTURE0, GL_TEXTURE_2D, 0);
+}
 
-  m_sceneUbo.nearPixels = 10.0f;
-  m_sceneUbo.farPixels  = 1.5f;
-  m_sceneUbo.tessPixels = 10.0f;
+void Sample::initSweep()
+{
+  m_sweep.addVariable("jobcount", [&](int value) { m_tweak.jobCount = value; });
+  m_sweep.addVariable("particlecount", [&](int value) { m_tweak.particleCount = value; });
+  m_sweep.addVariable("uselod", [&](int value) { m_tweak.uselod = value != 0; });
+  m_sweep.addVariable("usecompute", [&](int value) { m_tweak.usecompute = value != 0; });
+  m_sweep.addVariable("useindices", [&](int value) { m_tweak.useindices = value != 0; });
+  m_sweep.addVariable("nolodtess", [&](int value) { m_tweak.nolodtess = value != 0; });
+  m_sweep.addVariable("lodlevels", [&](int value) { m_tweak.lodLevels = value; });
+  m_sweep.addVariable("budget", [&](int value) { m_tweak.budgetMode = value; });
+  m_sweep.addVariable("morton", [&](int value) { m_tweak.morton = value != 0; });
+  m_sweep.addVariable("depthbins", [&](int value) { m_tweak.depthBins = value != 0; });
+  m_sweep.addVariable("batchsize", [&](int value) {
+    for(int& batchSize : m_tweak.batchSizes)
+    {
+      batchSize = value;
+    }
+  });
+  m_sweep.addVariable("useclusters", [&](int value) { m_tweak.useclusters = value != 0; });
+  m_sweep.addVariable("incremental", [&](int value) { m_tweak.incremental = value != 0; });
+  m_sweep.addVariable("multidraw", [&](int value) { m_tweak.multidraw = value != 0; });
+  m_sweep.addVariable("pipeline", [&](int value) { m_tweak.pipeline = value; });
+  m_sweep.addVariable("listmemory", [&](int value) { m_tweak.listMemoryMB = value; });
+  m_sweep.addVariable("views", [&](int value) { m_tweak.views = value; });
+  m_sweep.addVariable("appendmode", [&](int value) { m_tweak.appendMode = value; });
+  m_sweep.addVariable("particleformat", [&](int value) { m_tweak.particleFormat = value; });
+  m_sweep.addVariable("simulate", [&](int value) { m_tweak.simulate = value != 0; });
+  m_sweep.addVariable("occlusion", [&](int value) { m_tweak.occlusion = value != 0; });
+  m_sweep.addVariable("usecpu", [&](int value) { m_tweak.usecpu = value != 0; });
+  m_sweep.addVariable("cputhreads", [&](int value) { m_tweak.cpuThreads = value; });
+  m_sweep.addVariable("churn", [&](int value) { m_tweak.churn = value; });
+  m_sweep.addVariable("compactinterval", [&](int value) { m_tweak.compactInterval = value; });
+
+  // the statistics of the recorded frames, they lag a few frames behind
+  for(int l = 0; l < LOD_MAX_LEVELS; l++)
+  {
+    std::string name = std::string("level") + std::to_string(l);
+    m_sweep.addCounter(name.c_str(), [this, l]() { return double(m_lodStats.levelCnt[l / 4][l % 4]); });
+  }
+  m_sweep.addCounter("occluded", [this]() { return double(m_lodStats.occluded); });
+  m_sweep.addCounter("culled", [this]() { return double(getLodCulled()); });
 
-  m_control.m_sceneOrbit     = vec3(0.0f);
+  if(!m_sweepSpec.empty() && m_sweep.setup(m_sweepSpec, m_sweepWarmup, m_sweepFrames, m_sweepOutput))
+  {
+    m_benchTimers.setEnabled(true);
+  }
+}
+
+// particles whose classification depends on rounding, a plane distance or
+// the coverage is within a relative epsilon of a decision
+static bool isNearBoundary(const SceneData& scene, const Particle& particle)
+{
+  const float eps   = 1e-4f;
+  vec3        pos   = vec3(particle.posSize);
+  float       size  = particle.posSize.w;
+  float       scale = 1.0f + glm::length(pos) + size;
+
+  for(int i = 0; i < 6; i++)
+  {
+    if(fabsf(glm::dot(scene.frustum[i], vec4(pos, 1.0f)) + size) <= eps * scale)
+      return true;
+  }
+
+  float w        = (scene.viewProjMatrix * vec4(pos, 1.0f)).w;
+  float coverage = size * (scene.viewpixelsize.x + scene.viewpixelsize.y) / w;
+  for(uint l = 1; l < scene.lodLevels; l++)
+  {
+    if(fabsf(coverage - scene.lodTable[l].pixels) <= eps * std::max(1.0f, scene.lodTable[l].pixels))
+      return true;
+  }
+  return false;
+}
+
+// forces the settings the cpu classifier can reproduce and selects the
+// camera pose and classification path of the step
+void Sample::beginValidateStep()
+{
+  m_tweak.jobCount    = 1;
+  m_tweak.views       = 1;
+  m_tweak.pipeline    = PIPELINE_OFF;
+  m_tweak.useindices  = true;
+  m_tweak.uselod      = true;
+  m_tweak.usecpu      = false;
+  m_tweak.simulate    = false;
+  m_tweak.occlusion   = false;
+  m_tweak.incremental = false;
+  m_tweak.pause       = false;
+  m_tweak.budgetMode  = BUDGET_OFF;
+  m_tweak.multidraw   = false;
+  m_tweak.depthBins   = false;
+
+  if(m_validateStep < 0)
+  {
+    // the settings must have been applied, and all particles loaded
+    bool ready = m_lastTweak.jobCount == 1 && m_lastTweak.useindices && !m_lastTweak.simulate && !m_lastTweak.usecpu
+                 && !m_lastTweak.multidraw && m_lastTweak.views == 1 && m_lastTweak.pipeline == PIPELINE_OFF
+                 && !m_lastTweak.incremental && m_cpuLod.isValid() && m_streamLoaded >= size_t(m_tweak.particleCount);
+    if(!ready)
+      return;
+
+    LOGI("validate: %d particles, %d levels, %d poses x %d paths\n", m_tweak.particleCount, m_tweak.lodLevels,
+         VALIDATE_POSES, VALIDATE_PATHS);
+    if(!validateFrustum())
+    {
+      m_validateErrors++;
+    }
+    m_validateStep = 0;
+  }
+
+  static const vec3 poses[VALIDATE_POSES] = {
+      vec3(0.27f, 0.27f, 0.3f),
+      vec3(-0.6f, 0.3f, 0.12f),
+      vec3(0.03f, 0.2f, -0.08f),
+      vec3(1.2f, 0.2f, -1.2f),
+  };
+
+  int pose = m_validateStep / VALIDATE_PATHS;
+  int path = m_validateStep % VALIDATE_PATHS;
+
+  m_control.m_viewMatrix = glm::lookAt(m_control.m_sceneOrbit + poses[pose] * m_control.m_sceneDimension,
+                                       m_control.m_sceneOrbit, vec3(0, 1, 0));
+
+  m_tweak.usecompute  = path != 0;
+  m_tweak.appendMode  = path == 2 ? APPEND_WORKGROUP : path == 3 ? APPEND_ORDERED : APPEND_ATOMIC;
+  m_tweak.useclusters = path == 4;
+
+  m_validatePending = true;
+}
+
+// compares this frame's lists and commands with the cpu reference, the
+// readback waits for the gpu
+void Sample::endValidateStep()
+{
+  static const char* paths[VALIDATE_PATHS] = {"vertex", "compute", "workgroup", "ordered", "clusters"};
+
+  m_validatePending = false;
+
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+  size_t count    = size_t(m_tweak.particleCount);
+  size_t listSize = snapsize(sizeof(uint32_t) * count, 256);
+  int    levels   = m_tweak.lodLevels;
+  char   name[64];
+  snprintf(name, sizeof(name), "pose %d %s", m_validateStep / VALIDATE_PATHS, paths[m_validateStep % VALIDATE_PATHS]);
+
+  DrawIndirects cmd;
+  glGetNamedBufferSubData(buffers.lodcmds, 0, sizeof(DrawIndirects), &cmd);
+
+  std::vector<uint8_t> encoded(getParticleStride(m_tweak.particleFormat) * count);
+  std::vector<Particle> particles(count);
+  glGetNamedBufferSubData(buffers.particles, 0, encoded.size(), encoded.data());
+  decodeParticles(m_tweak.particleFormat, m_sceneUbo, encoded.data(), count, particles.data());
+
+  m_cpuLod.classify(m_sceneUbo, 0, uint32_t(count));
+
+  uint32_t errors = 0;
+  uint32_t total  = 0;
+  uint32_t near   = 0;
+  std::vector<uint32_t> list;
+  for(int l = 0; l < levels; l++)
+  {
+    // the count is spread across the batched full and the rest draw, the
+    // rest starts at instanceCount * batch (UNI_USE_CMDOFFSET)
+    uint32_t gpuCount = cmd.farArray.count;
+    if(l > 0)
+    {
+      const LodLevel&     level = m_sceneUbo.lodTable[l];
+      const DrawElements& full  = cmd.levelFull[l];
+      const DrawElements& rest  = cmd.levelRest[l];
+      uint32_t            batch = std::max(level.batch, 1u);
+      uint32_t            cntRest = level.indices ? rest.count / level.indices : 0;
+
+      gpuCount = full.instanceCount * batch + cntRest;
+      if(full.count != batch * level.indices || rest.instanceCount != 1 || cntRest >= batch
+         || (level.indices && rest.count % level.indices))
+      {
+        LOGE("validate: %s level %d commands: full %u x %u rest %u x %u, batch %u indices %u\n", name, l, full.count,
+             full.instanceCount, rest.count, rest.instanceCount, batch, level.indices);
+        errors++;
+      }
+    }
+
+    // lists are compared as sets, their order depends on the path
+    const std::vector<uint32_t>& reference = m_cpuLod.getList(l);
+    list.resize(std::min(size_t(gpuCount), count));
+    glGetNamedBufferSubData(buffers.lodlists, listSize * l, sizeof(uint32_t) * list.size(), list.data());
+    std::sort(list.begin(), list.end());
+    total += uint32_t(reference.size());
+
+    std::vector<uint32_t> diff;
+    std::set_symmetric_difference(list.begin(), list.end(), reference.begin(), reference.end(), std::back_inserter(diff));
+    for(uint32_t idx : diff)
+    {
+      if(idx < count && isNearBoundary(m_sceneUbo, particles[idx]))
+      {
+        near++;
+      }
+      else
+      {
+        if(errors < 16)
+        {
+          LOGE("validate: %s level %d particle %u %s\n", name, l, idx,
+               std::binary_search(list.begin(), list.end(), idx) ? "not expected" : "missing");
+        }
+        errors++;
+      }
+    }
+  }
+
+  LOGI("validate: %s: %u particles in levels, %u at boundaries, %s\n", name, total, near, errors ? "FAILED" : "ok");
+  m_validateErrors += errors;
+
+  if(++m_validateStep == VALIDATE_POSES * VALIDATE_PATHS)
+  {
+    LOGI("validate: %s\n", m_validateErrors ? "FAILED" : "passed");
+    m_validate = false;
+    close();
+  }
+}
+
+// Frustum::init against the clip volume, the unprojected corners must be
+// inside all planes and on their side planes
+bool Sample::validateFrustum()
+{
+  bool valid = true;
+  for(int c = 0; c < 8; c++)
+  {
+    vec4 ndc    = vec4((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : 0.0f, 1.0f);
+    vec4 corner = m_sceneUbo.viewProjMatrixI * ndc;
+    corner /= corner.w;
+    float scale = 1e-3f * (1.0f + glm::length(vec3(corner)));
+
+    const int sides[4]  = {Frustum::PLANE_LEFT, Frustum::PLANE_RIGHT, Frustum::PLANE_BOTTOM, Frustum::PLANE_TOP};
+    const bool onSide[4] = {ndc.x < 0, ndc.x > 0, ndc.y < 0, ndc.y > 0};
+    for(int i = 0; i < Frustum::NUM_PLANES; i++)
+    {
+      float dist = glm::dot(m_sceneUbo.frustum[i], corner);
+      if(dist < -scale)
+      {
+        LOGE("validate: frustum corner %d outside plane %d by %f\n", c, i, dist);
+        valid = false;
+      }
+    }
+    for(int s = 0; s < 4; s++)
+    {
+      float dist = glm::dot(m_sceneUbo.frustum[sides[s]], corner);
+      if(onSide[s] && fabsf(dist) > scale)
+      {
+        LOGE("validate: frustum corner %d off plane %d by %f\n", c, sides[s], dist);
+        valid = false;
+      }
+    }
+  }
+
+  // jobs cover all particles with lists that keep the 256 byte alignment
+  size_t count = size_t(m_tweak.particleCount);
+  for(size_t jobCount = 1; jobCount <= std::min(count, size_t(8)); jobCount++)
+  {
+    size_t perJob = snapsize(sizeof(uint32_t) * (count / jobCount), 256) / sizeof(uint32_t);
+    size_t jobs   = snapdiv(count, perJob);
+    if(jobs * perJob < count || (jobs - 1) * perJob >= count || (perJob * sizeof(uint32_t)) % 256)
+    {
+      LOGE("validate: job split of %zu particles into %zu jobs of %zu\n", count, jobs, perJob);
+      valid = false;
+    }
+  }
+  return valid;
+}
+
+// times the batch sizes of the mesh types the current chain draws, the
+// camera should stay still meanwhile
+void Sample::startAutotune()
+{
+  if(m_sweep.isActive() || !m_tweak.uselod)
+    return;
+
+  static const char* names[NUM_BATCH_MESHES] = {"icosphere 0", "icosphere 1", "icosphere 2", "impostor", "tess"};
+
+  const std::vector<int> candidates = {64, 128, 256, 512, 1024, 2048, 4096};
+
+  bool used[NUM_BATCH_MESHES] = {};
+  for(int l = 1; l < m_tweak.lodLevels; l++)
+  {
+    used[getLevelMesh(l)] = true;
+  }
+
+  m_autotuner.clearTasks();
+  for(int m = 0; m < NUM_BATCH_MESHES; m++)
+  {
+    if(!used[m])
+      continue;
+
+    int section = m == BATCH_TESS ? SectionTimers::SECTION_TESS :
+                  m == BATCH_IMPOSTOR ? SectionTimers::SECTION_IMPOSTOR : SectionTimers::SECTION_MESH;
+    m_autotuner.addTask(names[m], section, candidates, [this, m](int value) { m_tweak.batchSizes[m] = value; });
+  }
+
+  if(m_autotuner.start(16, 64))
+  {
+    m_benchTimers.setEnabled(true);
+  }
+}
+
+// The brick grid for count particles. It only steps to the next size when
+// the count outgrows it, the capacity about doubles per step. All counts
+// within a step get the same grid, so a scene resized within it matches one
+// that is generated for its count from scratch.
+static int getParticleGridCube(size_t count)
+{
+  int cube = 8;
+  while(size_t(cube) * size_t(cube) * size_t(cube / 4) < count)
+  {
+    cube = int(snapsize(cube + cube / 4, 8));
+  }
+  return cube;
+}
+
+// particle i of the brick grid of m_generated.cube, the result does not
+// depend on the particle count, so a larger count only appends bricks
+void Sample::generateParticles(size_t begin, size_t end, Particle* particles, vec4* velocities) const
+{
+  int   cube  = m_generated.cube;
+  float scale = 128.0f / float(cube);
+
+  // the grid is filled brick by brick, so that each cluster of
+  // PARTICLE_CLUSTERSIZE consecutive particles is spatially compact
+  const int brickX = 8;
+  const int brickY = PARTICLE_CLUSTERSIZE / 64;
+  const int brickZ = 8;
+  int       bricksX = int(snapdiv(cube, brickX));
+  int       bricksZ = int(snapdiv(cube, brickZ));
+
+  const uint32_t seed = 47345356;
+
+  parallelRange(end - begin, 64 * 1024, [&](size_t blockBegin, size_t blockEnd) {
+    for(size_t b = blockBegin; b < blockEnd; b++)
+    {
+      int i     = int(begin + b);
+      int brick = i / PARTICLE_CLUSTERSIZE;
+      int local = i % PARTICLE_CLUSTERSIZE;
+
+      int x = (brick % bricksX) * brickX + local % brickX;
+      int z = ((brick / bricksX) % bricksZ) * brickZ + (local / brickX) % brickZ;
+      int y = (brick / (bricksX * bricksZ)) * brickY + local / (brickX * brickZ);
+
+      uint32_t rnd = uint32_t(i) ^ seed;
+
+      vec3 pos = (vec3(0, hashFloat(rnd, 0), 0) - 0.5f) * 0.1f;
+      pos += vec3(x, y, z);
+      pos -= vec3(cube, cube / 4, cube) * 0.5f;
+      pos *= vec3(1, 4, 1);
+      float size = (1.0f + hashFloat(rnd, 1) * 1.0f) * 0.25f;
+
+      vec4 color = vec4(hashFloat(rnd, 2), hashFloat(rnd, 3), hashFloat(rnd, 4), 1.0f);
+
+      particles[b].posSize = vec4(pos, size) * scale;
+      particles[b].color   = color;
+
+      if(velocities)
+      {
+        vec3 velocity = vec3(hashFloat(rnd, 5), hashFloat(rnd, 6), hashFloat(rnd, 7)) - 0.5f;
+        velocities[b] = vec4(velocity * 16.0f * scale, 0.0f);
+      }
+    }
+  });
+}
+
+// changes the count of the generated particles within the grid of
+// m_generated.cube. The buffers keep their contents, growing uploads only the
+// new particles, shrinking only lowers the count. In both cases the cluster
+// at the smaller end is rebuilt with its new members.
+void Sample::resizeParticleBuffer()
+{
+  size_t oldCount     = m_generated.count;
+  size_t count        = size_t(m_tweak.particleCount);
+  size_t capacity     = size_t(getParticleCapacity());
+  size_t stride       = getParticleStride(m_tweak.particleFormat);
+  size_t clusterBegin = std::min(oldCount, count) / PARTICLE_CLUSTERSIZE;
+  size_t first        = clusterBegin * PARTICLE_CLUSTERSIZE;
+  size_t added        = count > oldCount ? count - oldCount : 0;
+
+  std::vector<Particle> particles(count - first);
+  std::vector<vec4>     velocities(m_tweak.simulate ? count - first : 0);
+  generateParticles(first, count, particles.data(), velocities.empty() ? nullptr : velocities.data());
+
+  // clusters are built from what the shaders decode, like for a fresh scene
+  std::vector<uint8_t> encoded(stride * particles.size());
+  encodeParticlesParallel(m_tweak.particleFormat, m_sceneUbo, particles.data(), particles.size(), encoded.data());
+
+  if(added)
+  {
+    reserveBuffer(buffers.particles, stride * capacity, GL_STATIC_DRAW, true);
+    glNamedBufferSubData(buffers.particles, stride * oldCount, stride * added, encoded.data() + stride * (oldCount - first));
+    if(!velocities.empty())
+    {
+      reserveBuffer(buffers.velocities, sizeof(vec4) * capacity, GL_DYNAMIC_COPY, true);
+      glNamedBufferSubData(buffers.velocities, sizeof(vec4) * oldCount, sizeof(vec4) * added,
+                           velocities.data() + (oldCount - first));
+    }
+    initParticleIndices(capacity);
+  }
+  LOGI("particles: %d %s, %.1f MB, %zu appended\n", m_tweak.particleCount, getParticleFormatName(m_tweak.particleFormat),
+       double(stride * count) / (1024.0 * 1024.0), added);
+
+  std::vector<Cluster> clusters(snapdiv(count - first, PARTICLE_CLUSTERSIZE));
+  buildClusters(particles.data(), 0, count - first, clusters.data());
+  for(Cluster& cluster : clusters)
+  {
+    cluster.first += uint(first);
+  }
+  m_clusterCount = int(snapdiv(count, PARTICLE_CLUSTERSIZE));
+  reserveBuffer(buffers.clusters, sizeof(Cluster) * snapdiv(capacity, PARTICLE_CLUSTERSIZE), GL_STATIC_DRAW, true);
+  glNamedBufferSubData(buffers.clusters, sizeof(Cluster) * clusterBegin, sizeof(Cluster) * clusters.size(), clusters.data());
+
+  m_generated.count = count;
+}
+
+bool Sample::initParticleBuffer()
+{
+  if(!m_particleFile.empty())
+  {
+    return initParticleFile();
+  }
+
+  size_t count    = size_t(m_tweak.particleCount);
+  size_t capacity = size_t(getParticleCapacity());
+  size_t stride   = getParticleStride(m_tweak.particleFormat);
+
+  // a count within the same grid keeps the generated particles, the existing
+  // ones (possibly simulated) stay in place and only the difference is
+  // handled. Everything that needs all particles on the host, morton order
+  // and the host copy of the slots, regenerate.
+  int  cube    = getParticleGridCube(count);
+  bool resize  = m_lastTweak.particleFormat == m_tweak.particleFormat && m_lastTweak.simulate == m_tweak.simulate
+                && m_lastTweak.morton == m_tweak.morton && m_lastTweak.usecpu == m_tweak.usecpu
+                && m_generated.count > 0 && count != m_generated.count && cube == m_generated.cube
+                && !m_tweak.morton && !m_tweak.usecpu && !m_validate && m_exportFile.empty() && !m_slots.isModified()
+                && !keepsSlotParticles();
+
+  std::vector<Particle> particles;
+  if(resize)
+  {
+    resizeParticleBuffer();
+  }
+  else
+  {
+    particles.resize(count);
+    std::vector<vec4> velocities(m_tweak.simulate ? m_tweak.particleCount : 0);
+
+    m_generated.cube  = cube;
+    m_generated.count = count;
+
+    float scale             = 128.0f / float(cube);
+    m_sceneUbo.particleSize = scale * 0.375f;
+
+    generateParticles(0, count, particles.data(), velocities.empty() ? nullptr : velocities.data());
+
+    if(m_tweak.morton)
+    {
+      sortParticlesMorton(particles, velocities);
+    }
+
+    if(!m_exportFile.empty() && ParticleFile::write(m_exportFile.c_str(), particles.data(), particles.size(), m_sceneUbo.particleSize))
+    {
+      LOGI("exported %d particles to \"%s\"\n", m_tweak.particleCount, m_exportFile.c_str());
+    }
+
+    // the box of the whole grid, so that it does not change with the count
+    // and the quantized format can be resized as well
+    vec3 bboxMin = vec3(-0.5f * float(cube) - 0.05f, -0.5f * float(cube) - 0.2f, -0.5f * float(cube) - 0.05f) * scale;
+    vec3 bboxMax = vec3(0.5f * float(cube) - 1.0f, 0.5f * float(cube) - 3.8f, 0.5f * float(cube) - 1.0f) * scale;
+    setParticleBox(m_sceneUbo, bboxMin, bboxMax, 0.25f * scale, 0.5f * scale);
+
+    std::vector<uint8_t> encoded(stride * particles.size());
+    encodeParticlesParallel(m_tweak.particleFormat, m_sceneUbo, particles.data(), particles.size(), encoded.data());
+
+    reserveBuffer(buffers.particles, stride * capacity, GL_STATIC_DRAW);
+    glNamedBufferSubData(buffers.particles, 0, encoded.size(), encoded.data());
+    LOGI("particles: %d %s, %.1f MB\n", m_tweak.particleCount, getParticleFormatName(m_tweak.particleFormat),
+         double(encoded.size()) / (1024.0 * 1024.0));
+
+    initParticleIndices(capacity);
+
+    std::vector<Cluster> clusters(snapdiv(particles.size(), PARTICLE_CLUSTERSIZE));
+    parallelRange(clusters.size(), 1024, [&](size_t begin, size_t end) {
+      buildClusters(particles.data(), begin * PARTICLE_CLUSTERSIZE, std::min(end * PARTICLE_CLUSTERSIZE, particles.size()),
+                    &clusters[begin]);
+    });
+    m_clusterCount = int(clusters.size());
+
+    reserveBuffer(buffers.clusters, sizeof(Cluster) * snapdiv(capacity, PARTICLE_CLUSTERSIZE), GL_STATIC_DRAW);
+    glNamedBufferSubData(buffers.clusters, 0, sizeof(Cluster) * clusters.size(), clusters.data());
+
+    // the cpu classifier keeps its own copy, as well as the encoded
+    // particles for filling the lists when not using indices
+    m_cpuGather  = std::vector<uint8_t>();
+    m_cpuDecoded = std::vector<Particle>();
+    if(m_tweak.usecpu || m_validate)
+    {
+      m_cpuLod.init(particles.data(), particles.size());
+      m_cpuEncoded.swap(encoded);
+      m_cpuSource = m_cpuEncoded.data();
+      if(m_tweak.simulate)
+      {
+        m_cpuDecoded.swap(particles);
+      }
+    }
+    else
+    {
+      m_cpuLod.deinit();
+      m_cpuEncoded = std::vector<uint8_t>();
+      m_cpuSource  = nullptr;
+    }
+    initVelocities(velocities);
+  }
+
+  // the buffer may be larger than the slots, which can be larger than
+  // the particles in use
+  nvgl::newTexture(textures.particles, GL_TEXTURE_BUFFER);
+  glTextureBufferRange(textures.particles, getParticleTextureFormat(m_tweak.particleFormat), buffers.particles, 0,
+                       stride * capacity);
+
+  // content is written on the first incremental run
+  size_t clusterCapacity = snapdiv(capacity, PARTICLE_CLUSTERSIZE);
+  reserveBuffer(buffers.clustercache, sizeof(ClusterCache) * clusterCapacity, GL_DYNAMIC_COPY);
+  reserveBuffer(buffers.incrstate, sizeof(IncrState) + sizeof(uint32_t) * clusterCapacity, GL_DYNAMIC_COPY);
+  m_incrValid    = false;
+  m_streamLoaded = count;
+
+  // all particles are live, the remaining slots are free
+  m_slots.init(uint32_t(capacity), uint32_t(count), keepsSlotParticles());
+  if(keepsSlotParticles())
+  {
+    m_slots.setParticles(0, particles.data(), uint32_t(count));
+  }
+
+  GLint maxtexels = 1;
+  GLint texels    = GLint(capacity) * getParticleTexels(m_tweak.particleFormat);
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxtexels);
+  if(texels > maxtexels)
+  {
+    LOGI("\nWARNING: buffer size too big for texturebuffer: %d max %d\n", texels, maxtexels);
+  }
+
+  return true;
+}
+
+bool Sample::initParticleFile()
+{
+  if(!m_file.isOpen() && !m_file.open(m_particleFile.c_str()))
+  {
+    return false;
+  }
+
+  size_t count = m_file.getCount();
+  if(count > size_t(1024 * 1024 * 1024))
+  {
+    LOGI("\nWARNING: particle file has %zu particles, only the first 1G are used\n", count);
+    count = size_t(1024 * 1024 * 1024);
+  }
+  const ParticleFileHeader& header = m_file.getHeader();
+
+  m_tweak.particleCount   = int(count);
+  m_sceneUbo.particleSize = header.particleSize;
+  m_generated.count       = 0;
+
+  // files without a size range quantize to the uniform size
+  float sizeMin = header.sizeMax > 0 ? header.sizeMin : header.particleSize;
+  float sizeMax = header.sizeMax > 0 ? header.sizeMax : header.particleSize;
+  setParticleBox(m_sceneUbo, vec3(header.bboxMin[0], header.bboxMin[1], header.bboxMin[2]),
+                 vec3(header.bboxMax[0], header.bboxMax[1], header.bboxMax[2]), sizeMin, sizeMax);
+
+  size_t stride          = getParticleStride(m_tweak.particleFormat);
+  size_t capacity        = size_t(getParticleCapacity());
+  size_t clusterCapacity = snapdiv(capacity, PARTICLE_CLUSTERSIZE);
+
+  // device buffers are filled by streamParticles, that includes the indices.
+  // Slots behind the file's particles only get indices.
+  reserveBuffer(buffers.particles, stride * capacity, GL_STATIC_DRAW);
+  reserveBuffer(buffers.particleindices, sizeof(int) * capacity, GL_STATIC_DRAW);
+  m_particleIndicesValid = 0;
+  if(capacity > count)
+  {
+    std::vector<int> indices(capacity - count);
+    for(size_t i = 0; i < indices.size(); i++)
+    {
+      indices[i] = int(count + i);
+    }
+    glNamedBufferSubData(buffers.particleindices, sizeof(int) * count, sizeof(int) * indices.size(), indices.data());
+  }
+
+  nvgl::newTexture(textures.particles, GL_TEXTURE_BUFFER);
+  glTextureBufferRange(textures.particles, getParticleTextureFormat(m_tweak.particleFormat), buffers.particles, 0,
+                       stride * capacity);
+
+  m_clusterCount = int(snapdiv(count, PARTICLE_CLUSTERSIZE));
+
+  reserveBuffer(buffers.clusters, sizeof(Cluster) * clusterCapacity, GL_STATIC_DRAW);
+  reserveBuffer(buffers.clustercache, sizeof(ClusterCache) * clusterCapacity, GL_DYNAMIC_COPY);
+  reserveBuffer(buffers.incrstate, sizeof(IncrState) + sizeof(uint32_t) * clusterCapacity, GL_DYNAMIC_COPY);
+  m_incrValid = false;
+
+  // the cpu classifier reads from the mapping directly, which pulls the
+  // whole file into host memory. Other formats need an encoded copy.
+  m_cpuEncoded = std::vector<uint8_t>();
+  m_cpuGather  = std::vector<uint8_t>();
+  m_cpuDecoded = std::vector<Particle>();
+  if((m_tweak.usecpu || m_validate) && m_tweak.particleFormat == PARTICLE_FORMAT_FULL && !m_tweak.simulate)
+  {
+    m_cpuLod.init(m_file.getParticles(), count);
+    m_cpuSource = (const uint8_t*)m_file.getParticles();
+  }
+  else if(m_tweak.usecpu || m_validate)
+  {
+    std::vector<Particle> decoded(m_file.getParticles(), m_file.getParticles() + count);
+    m_cpuEncoded.resize(stride * count);
+    encodeParticlesParallel(m_tweak.particleFormat, m_sceneUbo, decoded.data(), count, m_cpuEncoded.data());
+    m_cpuLod.init(decoded.data(), count);
+    m_cpuSource = m_cpuEncoded.data();
+    if(m_tweak.simulate)
+    {
+      m_cpuDecoded.swap(decoded);
+    }
+  }
+  else
+  {
+    m_cpuLod.deinit();
+    m_cpuSource = nullptr;
+  }
+
+  // particles from files start at rest
+  std::vector<vec4> velocities(m_tweak.simulate ? count : 0, vec4(0));
+  initVelocities(velocities);
+
+  // 4 x 16 MB in flight
+  m_staging.init(16 * 1024 * 1024, 4);
+  m_streamLoaded = 0;
+
+  // the host copy of the slots is filled while streaming
+  m_slots.init(uint32_t(capacity), uint32_t(count), keepsSlotParticles());
+
+  LOGI("streaming %zu particles from \"%s\" (%s, %.1f MB)\n", count, m_particleFile.c_str(),
+       getParticleFormatName(m_tweak.particleFormat), double(stride * count) / (1024.0 * 1024.0));
+
+  return true;
+}
+
+// the indices only depend on the count, growing keeps the existing ones
+// and uploads the new tail
+void Sample::initParticleIndices(size_t count)
+{
+  reserveBuffer(buffers.particleindices, sizeof(int) * count, GL_STATIC_DRAW, true);
+  if(count > m_particleIndicesValid)
+  {
+    std::vector<int> indices(count - m_particleIndicesValid);
+    for(size_t i = 0; i < indices.size(); i++)
+    {
+      indices[i] = int(m_particleIndicesValid + i);
+    }
+    glNamedBufferSubData(buffers.particleindices, sizeof(int) * m_particleIndicesValid, sizeof(int) * indices.size(),
+                         indices.data());
+    m_particleIndicesValid = count;
+  }
+}
+
+void Sample::initVelocities(std::vector<vec4>& velocities)
+{
+  if(velocities.empty())
+  {
+    nvgl::deleteBuffer(buffers.velocities);
+    m_cpuVelocities = std::vector<vec4>();
+    return;
+  }
+
+  // spawned particles bring their velocity
+  reserveBuffer(buffers.velocities, sizeof(vec4) * std::max(velocities.size(), size_t(getParticleCapacity())), GL_DYNAMIC_COPY);
+  glNamedBufferSubData(buffers.velocities, 0, sizeof(vec4) * velocities.size(), velocities.data());
+
+  if(m_tweak.usecpu)
+  {
+    m_cpuVelocities.swap(velocities);
+  }
+  else
+  {
+    m_cpuVelocities = std::vector<vec4>();
+  }
+}
+
+void Sample::streamParticles()
+{
+  const Particle* particles = m_file.getParticles();
+  size_t          count     = size_t(m_tweak.particleCount);
+  size_t          stride    = getParticleStride(m_tweak.particleFormat);
+
+  // chunks cover whole clusters
+  size_t chunkSize = (m_staging.getSegmentSize() / stride) / PARTICLE_CLUSTERSIZE * PARTICLE_CLUSTERSIZE;
+
+  while(m_streamLoaded < count)
+  {
+    size_t begin = m_streamLoaded;
+    size_t end   = std::min(begin + chunkSize, count);
+
+    // clusters are built from what the shaders decode
+    m_streamDecoded.assign(particles + begin, particles + end);
+    m_streamEncoded.resize(stride * (end - begin));
+    encodeParticlesParallel(m_tweak.particleFormat, m_sceneUbo, m_streamDecoded.data(), end - begin, m_streamEncoded.data());
+
+    if(!m_staging.copy(buffers.particles, stride * begin, m_streamEncoded.data(), m_streamEncoded.size()))
+    {
+      // all segments in flight, continue next frame
+      break;
+    }
+
+    m_slots.setParticles(uint32_t(begin), m_streamDecoded.data(), uint32_t(end - begin));
+
+    m_streamIndices.resize(end - begin);
+    for(size_t i = begin; i < end; i++)
+    {
+      m_streamIndices[i - begin] = int(i);
+    }
+    glNamedBufferSubData(buffers.particleindices, sizeof(int) * begin, sizeof(int) * (end - begin), m_streamIndices.data());
+
+    m_streamClusters.resize(snapdiv(end - begin, PARTICLE_CLUSTERSIZE));
+    buildClusters(m_streamDecoded.data(), 0, end - begin, m_streamClusters.data());
+    for(Cluster& cluster : m_streamClusters)
+    {
+      cluster.first += uint(begin);
+    }
+    glNamedBufferSubData(buffers.clusters, sizeof(Cluster) * (begin / PARTICLE_CLUSTERSIZE),
+                         sizeof(Cluster) * m_streamClusters.size(), m_streamClusters.data());
+
+    if(m_cpuSource != (const uint8_t*)particles)
+    {
+      m_file.release(begin, end);
+    }
+
+    m_streamLoaded = end;
+    // new clusters have no cache content
+    m_incrValid = false;
+  }
+}
+
+// applies the additions and removals of the frame, the active range is
+// compacted every compactInterval frames. Drawing without lod does not
+// test the liveness mask, so then the holes are closed every frame.
+void Sample::updateParticleSlots()
+{
+  if(!m_slots.isValid())
+    return;
+
+  // particles are only spawned and killed once everything is streamed in
+  bool streamed = m_streamLoaded == size_t(m_tweak.particleCount);
+  if(m_tweak.churn > 0 && streamed && !m_tweak.pause && !m_validate)
+  {
+    churnParticles();
+  }
+
+  PROFILE_SECTION("Slots");
+
+  bool changed = m_slots.upload(programs.particleslots_scatter_comp, m_tweak.particleFormat, m_sceneUbo,
+                                buffers.particles, buffers.velocities);
+
+  m_slotsFrame++;
+  bool interval = m_tweak.compactInterval > 0 && m_slotsFrame % uint32_t(m_tweak.compactInterval) == 0;
+  if(interval || !m_tweak.uselod)
+  {
+    changed = m_slots.compact(programs.particleslots_compact_comp, buffers.particles, buffers.velocities) || changed;
+  }
+
+  if(changed)
+  {
+    m_incrValid = false;
+  }
+
+  // once the range is dense again, the clusters and the cpu copy follow
+  // the changes, which makes them usable until the next removal
+  if(m_slots.isModified() && m_slots.hasHostCopy() && m_slots.getHoleCount() == 0)
+  {
+    rebuildSlotParticles();
+  }
+}
+
+// rebuilds the clusters and the cpu copy of the slots that changed since the
+// last rebuild from the host copy of the slots
+void Sample::rebuildSlotParticles()
+{
+  const Particle* particles = m_slots.getParticles();
+  size_t          count     = m_slots.getSlotCount();
+  size_t          stride    = getParticleStride(m_tweak.particleFormat);
+
+  // whole clusters, the one at the end of the range may have lost particles
+  size_t begin        = std::min(size_t(m_slots.getChangedBegin()), count) / PARTICLE_CLUSTERSIZE * PARTICLE_CLUSTERSIZE;
+  size_t end          = std::min(size_t(m_slots.getChangedEnd()), count);
+  size_t clusterBegin = begin / PARTICLE_CLUSTERSIZE;
+  size_t clusterEnd   = snapdiv(end, PARTICLE_CLUSTERSIZE);
+
+  if(clusterEnd > clusterBegin)
+  {
+    m_slotClusters.resize(clusterEnd - clusterBegin);
+    parallelRange(m_slotClusters.size(), 1024, [&](size_t blockBegin, size_t blockEnd) {
+      buildClusters(particles, (clusterBegin + blockBegin) * PARTICLE_CLUSTERSIZE,
+                    std::min((clusterBegin + blockEnd) * PARTICLE_CLUSTERSIZE, count), &m_slotClusters[blockBegin]);
+    });
+    glNamedBufferSubData(buffers.clusters, sizeof(Cluster) * clusterBegin, sizeof(Cluster) * m_slotClusters.size(),
+                         m_slotClusters.data());
+  }
+  m_clusterCount = int(snapdiv(count, PARTICLE_CLUSTERSIZE));
+
+  if(m_tweak.usecpu)
+  {
+    m_cpuLod.resize(count);
+    m_cpuLod.update(particles, begin, end);
+
+    // the classifier of a file may still read from its mapping, the encoded
+    // copy is then made once for all slots
+    bool   copied = !m_cpuEncoded.empty() && m_cpuSource == m_cpuEncoded.data();
+    size_t first  = copied ? begin : 0;
+    size_t last   = copied ? end : count;
+    m_cpuEncoded.resize(stride * count);
+    parallelRange(last - first, 64 * 1024, [&](size_t blockBegin, size_t blockEnd) {
+      encodeParticles(m_tweak.particleFormat, m_sceneUbo, particles + first + blockBegin, blockEnd - blockBegin,
+                      m_cpuEncoded.data() + stride * (first + blockBegin));
+    });
+    m_cpuSource = m_cpuEncoded.data();
+  }
+
+  m_slots.clearModified();
+}
+
+// exercises the slots: every frame churn random particles die and as many
+// are spawned within the particle box. The population also swings between
+// half and all of the capacity, so that holes remain while it shrinks.
+void Sample::churnParticles()
+{
+  const uint32_t period = 1024;
+
+  uint32_t capacity = m_slots.getCapacity();
+  uint32_t live     = m_slots.getLiveCount();
+  float    phase    = float(m_slotsFrame % period) * (6.2831853f / float(period));
+  uint32_t target   = uint32_t(double(capacity) * (0.75 + 0.25 * cosf(phase)));
+  uint32_t churn    = uint32_t(m_tweak.churn);
+  uint32_t kills    = std::min(live, churn + (live > target ? live - target : 0));
+  uint32_t spawns   = churn + (target > live ? target - live : 0);
+
+  // random slots, dead ones are skipped, so a few less may die
+  uint32_t slotCount = m_slots.getSlotCount();
+  uint32_t frameSeed = hashIndex(m_slotsFrame);
+  m_churnHandles.clear();
+  for(uint32_t i = 0; i < kills * 2 && m_churnHandles.size() < kills; i++)
+  {
+    ParticleSlots::Handle handle = m_slots.getHandle(hashIndex(frameSeed + i) % slotCount);
+    if(handle != ParticleSlots::INVALID)
+    {
+      m_churnHandles.push_back(handle);
+    }
+  }
+  m_slots.remove(m_churnHandles.data(), uint32_t(m_churnHandles.size()));
+
+  // the box and size range of the particle format, so nothing gets clamped
+  vec3  boxMin  = vec3(m_sceneUbo.particleBoxMin);
+  vec3  boxSize = vec3(m_sceneUbo.particleBoxScale) * 65535.0f;
+  float sizeMin = m_sceneUbo.particleBoxMin.w;
+  float sizeMax = sizeMin + m_sceneUbo.particleBoxScale.w * 255.0f;
+  if(m_tweak.particleFormat == PARTICLE_FORMAT_COMPACT)
+  {
+    sizeMin = sizeMax = m_sceneUbo.particleSize;
+  }
+
+  m_churnParticles.resize(spawns);
+  m_churnVelocities.resize(m_tweak.simulate ? spawns : 0);
+  for(uint32_t i = 0; i < spawns; i++)
+  {
+    uint32_t rnd = frameSeed ^ hashIndex(i);
+    vec3     pos = boxMin + vec3(hashFloat(rnd, 0), hashFloat(rnd, 1), hashFloat(rnd, 2)) * boxSize;
+
+    m_churnParticles[i].posSize = vec4(pos, sizeMin + hashFloat(rnd, 3) * (sizeMax - sizeMin));
+    m_churnParticles[i].color   = vec4(hashFloat(rnd, 4), hashFloat(rnd, 5), hashFloat(rnd, 6), 1.0f);
+    if(m_tweak.simulate)
+    {
+      vec3 velocity         = vec3(hashFloat(rnd, 7), hashFloat(rnd, 8), hashFloat(rnd, 9)) - 0.5f;
+      m_churnVelocities[i] = vec4(velocity * boxSize * 0.125f, 0.0f);
+    }
+  }
+  m_slots.add(m_churnParticles.data(), m_tweak.simulate ? m_churnVelocities.data() : nullptr, spawns, nullptr);
+}
+
+bool Sample::initLodBuffers()
+{
+  size_t itemSize;
+  GLenum itemFormat;
+  int    itemTexels;
+
+  if(m_tweak.useindices)
+  {
+    itemSize   = sizeof(int);
+    itemFormat = GL_R32I;
+    itemTexels = 1;
+  }
+  else
+  {
+    itemSize   = getParticleStride(m_tweak.particleFormat);
+    itemFormat = getParticleTextureFormat(m_tweak.particleFormat);
+    itemTexels = getParticleTexels(m_tweak.particleFormat);
+  }
+  // jobs cover all slots, the ones behind the active range skip classification
+  int    capacity = getParticleCapacity();
+  size_t size     = snapsize(itemSize * (capacity / m_tweak.jobCount), 256);
+  int    jobs     = (int)snapdiv(capacity, size / itemSize);
+  if(keepsIncrementalLists())
+  {
+    // room for the moved particles until the lists are rebuilt
+    size *= 2;
+  }
+
+  // multi draw keeps the lists of all jobs, multiple views have their own
+  // lists (and commands) and draw without multi draw
+  int views = m_tweak.views;
+  m_jobSlots = 1;
+  if(views > 1)
+  {
+    size *= views;
+  }
+  else if(m_tweak.multidraw)
+  {
+    size *= jobs;
+  }
+  else if(m_tweak.listMemoryMB > 0)
+  {
+    // disjoint lists let a job classify while the previous ones still draw
+    size_t slotSize = size * m_tweak.lodLevels;
+    m_jobSlots      = int(std::max(size_t(1), std::min(size_t(jobs), (size_t(m_tweak.listMemoryMB) << 20) / slotSize)));
+    size *= m_jobSlots;
+  }
+
+  GLint maxtexels = 1;
+  GLint texels    = int(size / itemSize) * itemTexels;
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxtexels);
+  if(texels > maxtexels)
+  {
+    LOGI("\nWARNING: buffer size too big for texturebuffer: %d max %d\n", texels, maxtexels);
+  }
+
+  // pipelining needs lists that outlive the frame
+  bool listsKept = jobs == 1 || m_tweak.multidraw;
+  int  sets      = m_tweak.pipeline != PIPELINE_OFF && listsKept && views == 1 ? 2 : 1;
+
+  for(int s = 0; s < 2; s++)
+  {
+    LodSet& set = m_lodSets[s];
+    if(s >= sets)
+    {
+      nvgl::deleteBuffer(set.lodlists);
+      nvgl::deleteBuffer(set.lodcmds);
+      nvgl::deleteBuffer(set.lodmultidraw);
+      continue;
+    }
+
+    // one list per lod level, each level is drawn through a view of its range.
+    // The contents are rewritten every frame, so nothing is preserved.
+    reserveBuffer(set.lodlists, size * m_tweak.lodLevels, GL_DYNAMIC_COPY);
+
+    // full & rest of every level above 0, points per job
+    reserveBuffer(set.lodmultidraw, sizeof(DrawElements) * ((LOD_MAX_LEVELS - 1) * 2 + 1) * jobs, GL_DYNAMIC_COPY);
+
+    size_t cmdsSize = snapsize(sizeof(DrawIndirects), 256) * std::max(m_tweak.jobCount, views);
+    reserveBuffer(set.lodcmds, cmdsSize, GL_DYNAMIC_COPY);
+    glClearNamedBufferSubData(set.lodcmds, GL_RGBA32F, 0, cmdsSize, GL_RGBA, GL_FLOAT, NULL);
+  }
+  useLodSet(0);
+  m_lodSetDrawn = 0;
+  m_lodSetValid = false;
+
+  nvgl::newTexture(textures.lodparticles, GL_TEXTURE_BUFFER);
+  glTextureBufferRange(textures.lodparticles, itemFormat, buffers.lodlists, 0, size * m_tweak.lodLevels);
+
+  // depth binning sorts a job's lists above level 0 through scratch lists
+  if(m_tweak.depthBins)
+  {
+    reserveBuffer(buffers.lodscratch, size * (m_tweak.lodLevels - 1), GL_DYNAMIC_COPY);
+    reserveBuffer(buffers.lodbins, sizeof(uint32_t) * 2 * LOD_MAX_LEVELS * LOD_DEPTH_BINS, GL_DYNAMIC_COPY);
+    glClearNamedBufferData(buffers.lodbins, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+  }
+  else
+  {
+    nvgl::deleteBuffer(buffers.lodscratch);
+    nvgl::deleteBuffer(buffers.lodbins);
+  }
+
+  // per-workgroup counts/offsets of the ordered append mode
+  reserveBuffer(buffers.groupcounts,
+                sizeof(uvec4) * (LOD_MAX_LEVELS / 4) * (snapdiv(capacity, m_workGroupSize[0]) + 1), GL_DYNAMIC_COPY);
+
+  reserveBuffer(buffers.lodstats, sizeof(LodStats), GL_DYNAMIC_COPY);
+  // the copies are read through a persistent mapping once their fence passed
+  if(!buffers.lodstatsread)
+  {
+    GLbitfield readFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    nvgl::newBuffer(buffers.lodstatsread);
+    glNamedBufferStorage(buffers.lodstatsread, sizeof(LodStats) * STATS_FRAMES, NULL, readFlags);
+    m_lodStatsMapping = (const LodStats*)glMapNamedBufferRange(buffers.lodstatsread, 0, sizeof(LodStats) * STATS_FRAMES, readFlags);
+  }
+  for(StatsReadback& readback : m_statsReadback)
+  {
+    if(readback.fence)
+    {
+      glDeleteSync(readback.fence);
+      readback.fence = nullptr;
+    }
+  }
+
+  // lists are lost, as well as the job boundaries the cache was built with
+  m_incrValid = false;
+
+  return true;
+}
+
+bool Sample::begin()
+{
+  ImGuiH::Init(m_windowState.m_winSize[0], m_windowState.m_winSize[1], this);
+  ImGui::InitGL();
+
+  m_ui.enumAdd(GUI_APPEND, APPEND_ATOMIC, "per particle");
+  m_ui.enumAdd(GUI_APPEND, APPEND_WORKGROUP, "per workgroup");
+  m_ui.enumAdd(GUI_APPEND, APPEND_ORDERED, "ordered");
+  for(int i = 0; i < NUM_PARTICLE_FORMATS; i++)
+  {
+    m_ui.enumAdd(GUI_FORMAT, i, getParticleFormatName(i));
+  }
+  m_ui.enumAdd(GUI_BUDGET, BUDGET_OFF, "off");
+  m_ui.enumAdd(GUI_BUDGET, BUDGET_GPUTIME, "gpu frame time");
+  m_ui.enumAdd(GUI_BUDGET, BUDGET_TRIANGLES, "triangles");
+  m_ui.enumAdd(GUI_BUDGET, BUDGET_MODEL, "cost model (cpu)");
+
+  m_ui.enumAdd(GUI_PIPELINE, PIPELINE_OFF, "off");
+  m_ui.enumAdd(GUI_PIPELINE, PIPELINE_PINGPONG, "ping-pong");
+  m_ui.enumAdd(GUI_PIPELINE, PIPELINE_DEFERRED, "ping-pong, 1 frame late");
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glEnable(GL_CULL_FACE);
+  glEnable(GL_DEPTH_TEST);
+
+  bool validated(true);
+
+  GLuint defaultVAO;
+  glGenVertexArrays(1, &defaultVAO);
+  glBindVertexArray(defaultVAO);
+
+  // point clouds are converted once, then streamed as particle file
+  if(!m_importFile.empty())
+  {
+    if(m_particleFile.empty())
+    {
+      m_particleFile = m_importFile + ".particles";
+    }
+    validated = importPointCloud(m_importFile.c_str(), m_particleFile.c_str(), m_importSize);
+  }
+
+  validated = validated && initProgram();
+  validated = validated && initScene();
+  initLodTable();
+  validated = validated && initParticleBuffer();
+  validated = validated && initLodBuffers();
+  validated = validated && (!m_offscreen || initFramebuffers(m_windowState.m_winSize[0], m_windowState.m_winSize[1]));
+
+  m_benchTimers.init();
+  initSweep();
+  if(m_autotune)
+  {
+    startAutotune();
+  }
+
+  m_control.m_sceneOrbit     = vec3(0.0f);
   m_control.m_sceneDimension = 256.0f;
+  if(m_file.isOpen())
+  {
+    const ParticleFileHeader& header = m_file.getHeader();
+    vec3 bboxMin                     = vec3(header.bboxMin[0], header.bboxMin[1], header.bboxMin[2]);
+    vec3 bboxMax                     = vec3(header.bboxMax[0], header.bboxMax[1], header.bboxMax[2]);
+    m_control.m_sceneOrbit           = (bboxMin + bboxMax) * 0.5f;
+    m_control.m_sceneDimension       = std::max(glm::length(bboxMax - bboxMin), 1.0f);
+  }
   m_control.m_viewMatrix = glm::lookAt(m_control.m_sceneOrbit + vec3(0.9, 0.9, 1) * m_control.m_sceneDimension * 0.3f,
                                        m_control.m_sceneOrbit, vec3(0, 1, 0));
 
-  return validated;
+  return validated;
+}
+
+void Sample::processUI(double time)
+{
+  int width  = m_windowState.m_winSize[0];
+  int height = m_windowState.m_winSize[1];
+
+  // Update imgui configuration
+  auto& imgui_io       = ImGui::GetIO();
+  imgui_io.DeltaTime   = static_cast<float>(time - m_uiTime);
+  imgui_io.DisplaySize = ImVec2(width, height);
+
+  m_uiTime = time;
+
+  ImGui::NewFrame();
+  ImGui::SetNextWindowSize(ImGuiH::dpiScaled(350, 0), ImGuiCond_FirstUseEver);
+  if(ImGui::Begin("NVIDIA " PROJECT_NAME, nullptr))
+  {
+    ImGui::Checkbox("use lod", &m_tweak.uselod);
+    ImGui::Checkbox("use tess (if no lod)", &m_tweak.nolodtess);
+    ImGui::Checkbox("wireframe", &m_tweak.wireframe);
+    ImGui::Checkbox("use indexing", &m_tweak.useindices);
+    ImGui::Checkbox("use compute", &m_tweak.usecompute);
+    ImGui::Checkbox("use clusters (compute)", &m_tweak.useclusters);
+    ImGui::Checkbox("incremental (clusters)", &m_tweak.incremental);
+    ImGui::Checkbox("multi draw indirect", &m_tweak.multidraw);
+    m_ui.enumCombobox(GUI_PIPELINE, "pipeline (1 job or mdi)", &m_tweak.pipeline);
+    ImGuiH::InputIntClamped("views", &m_tweak.views, 1, LOD_MAX_VIEWS, 1, 1, ImGuiInputTextFlags_EnterReturnsTrue);
+    if(m_tweak.views > 1)
+    {
+      ImGui::SliderFloat("view separation", &m_tweak.viewSeparation, 0.0f, 0.2f);
+    }
+    m_ui.enumCombobox(GUI_APPEND, "append (compute)", &m_tweak.appendMode);
+    m_ui.enumCombobox(GUI_FORMAT, "particle format", &m_tweak.particleFormat);
+    if(!m_tweak.multidraw && m_tweak.jobCount > 1)
+    {
+      ImGuiH::InputIntClamped("job lists MB (0 reuse)", &m_tweak.listMemoryMB, 0, 4096, 16, 128,
+                              ImGuiInputTextFlags_EnterReturnsTrue);
+      ImGui::Text("job list slots: %d", m_jobSlots);
+    }
+    ImGui::Text("particle memory: %.1f MB",
+                double(getParticleStride(m_tweak.particleFormat) * m_tweak.particleCount) / (1024.0 * 1024.0));
+    ImGui::Checkbox("use cpu classifier", &m_tweak.usecpu);
+    if(m_tweak.usecpu)
+    {
+      ImGuiH::InputIntClamped("cpu threads (0 all)", &m_tweak.cpuThreads, 0, 256, 1, 4, ImGuiInputTextFlags_EnterReturnsTrue);
+      ImGui::Text("cpu simd: %s", CpuLodClassifier::getSimdName());
+    }
+    ImGui::Checkbox("simulate (compute or cpu)", &m_tweak.simulate);
+    ImGui::Checkbox("occlusion culling (gpu)", &m_tweak.occlusion);
+    ImGui::Checkbox("morton order particles", &m_tweak.morton);
+    ImGui::Checkbox("depth binned lists", &m_tweak.depthBins);
+    ImGuiH::InputIntClamped("churn (particles/frame)", &m_tweak.churn, 0, 1024 * 1024, 256, 4096,
+                            ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGuiH::InputIntClamped("compact interval (frames)", &m_tweak.compactInterval, 0, 4096, 1, 16,
+                            ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::Text("live %u slots %u holes %u", m_slots.getLiveCount(), m_slots.getSlotCount(), m_slots.getHoleCount());
+    ImGui::Text("accepted %u occluded %u culled %u", m_lodStats.accepted, m_lodStats.occluded, getLodCulled());
+    for(int l = 0; l < m_tweak.lodLevels; l++)
+    {
+      ImGui::Text("lod %d: %u", l, m_lodStats.levelCnt[l / 4][l % 4]);
+      if(l % 4 != 3 && l + 1 < m_tweak.lodLevels)
+      {
+        ImGui::SameLine();
+      }
+    }
+    ImGui::Checkbox("pause lod", &m_tweak.pause);
+    ImGuiH::InputIntClamped("num partices", &m_tweak.particleCount, 1, 1024 * 1024 * 1024, 1024 * 512, 1024 * 1024,
+                            ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::Separator();
+    ImGui::PushItemWidth(ImGui::GetWindowWidth() * 0.585f);
+    ImGuiH::InputIntClamped("lod levels", &m_tweak.lodLevels, 2, LOD_MAX_LEVELS, 1, 1, ImGuiInputTextFlags_EnterReturnsTrue);
+    for(int l = 1; l < m_tweak.lodLevels; l++)
+    {
+      bool tess = l == m_tweak.lodLevels - 1;
+      char label[64];
+      snprintf(label, sizeof(label), "lod %d pixelsize (%s)", l,
+               tess ? "tess" : m_lodSubdiv[l] == LOD_IMPOSTOR ? "impostor" : "mesh");
+      ImGui::DragFloat(label, &m_lodPixels[l], 0.1f, 1, 1000);
+      if(!tess)
+      {
+        snprintf(label, sizeof(label), "lod %d subdivisions", l);
+        ImGui::SliderInt(label, &m_lodSubdiv[l], LOD_IMPOSTOR, LOD_MAX_SUBDIV,
+                         m_lodSubdiv[l] == LOD_IMPOSTOR ? "impostor" : "%d");
+      }
+    }
+    ImGui::DragFloat("tess pixelsize", &m_tessPixels, 0.1f, 1, 1000);
+    for(int l = 1; l < m_tweak.lodLevels; l++)
+    {
+      char label[64];
+      snprintf(label, sizeof(label), "lod %d batch size", l);
+      ImGuiH::InputIntClamped(label, &m_tweak.batchSizes[getLevelMesh(l)], 1, 8192, 64, 256,
+                              ImGuiInputTextFlags_EnterReturnsTrue);
+    }
+    if(m_autotuner.isActive())
+    {
+      ImGui::Text("autotuning batch sizes...");
+    }
+    else if(ImGui::Button("autotune batch sizes"))
+    {
+      startAutotune();
+    }
+    ImGui::Separator();
+    m_ui.enumCombobox(GUI_BUDGET, "lod budget", &m_tweak.budgetMode);
+    if(m_tweak.budgetMode == BUDGET_TRIANGLES)
+    {
+      ImGui::DragFloat("budget mtris", &m_tweak.budgetMTris, 0.1f, 0.1f, 1000.0f);
+    }
+    else if(m_tweak.budgetMode != BUDGET_OFF)
+    {
+      ImGui::DragFloat("budget ms", &m_tweak.budgetMs, 0.05f, 0.1f, 100.0f);
+    }
+    if(m_tweak.budgetMode != BUDGET_OFF)
+    {
+      ImGui::Text("threshold scale %.2f", m_budget.getScale());
+    }
+    ImGui::Separator();
+    ImGui::SliderFloat("fov", &m_tweak.fov, 1, 90.0f);
+    ImGui::PopItemWidth();
+  }
+  ImGui::End();
+}
+
+void Sample::classifyCpu(int offset, int cnt, size_t cmdOffset, size_t listOffset, size_t levelStride)
+{
+  if(m_tweak.simulate && !m_cpuDecoded.empty())
+  {
+    // reference integrator, the result replaces the gpu's particles
+    size_t stride = getParticleStride(m_tweak.particleFormat);
+    parallelRange(cnt, 64 * 1024, [&](size_t begin, size_t end) {
+      simulateParticles(m_tweak.particleFormat, m_sceneUbo, m_tweak.simulateStep, m_cpuEncoded.data(),
+                        m_cpuVelocities.data(), offset + begin, offset + end, m_cpuDecoded.data());
+      m_cpuLod.update(m_cpuDecoded.data(), offset + begin, offset + end);
+    });
+    glNamedBufferSubData(buffers.particles, stride * offset, stride * cnt, m_cpuEncoded.data() + stride * offset);
+  }
+
+  m_cpuLod.classify(m_sceneUbo, offset, offset + cnt, m_tweak.cpuThreads);
+
+  // lodcmds builds the indirect commands from these
+  DrawCounters counters = {};
+
+  for(int b = 0; b < m_tweak.lodLevels; b++)
+  {
+    const std::vector<uint32_t>& list = m_cpuLod.getList(b);
+    counters.levelCnt[b / 4][b % 4]   = uint(list.size());
+    if(list.empty())
+      continue;
+
+    size_t dstOffset = levelStride * b + listOffset;
+    if(m_tweak.useindices)
+    {
+      glNamedBufferSubData(buffers.lodlists, dstOffset, sizeof(uint32_t) * list.size(), list.data());
+    }
+    else
+    {
+      size_t stride = getParticleStride(m_tweak.particleFormat);
+      m_cpuGather.resize(stride * list.size());
+      for(size_t i = 0; i < list.size(); i++)
+      {
+        memcpy(&m_cpuGather[stride * i], m_cpuSource + stride * list[i], stride);
+      }
+      glNamedBufferSubData(buffers.lodlists, dstOffset, m_cpuGather.size(), m_cpuGather.data());
+    }
+  }
+
+  glNamedBufferSubData(buffers.lodcmds, cmdOffset, sizeof(DrawCounters), &counters);
+}
+
+void Sample::classifyGpu(int offset, int cnt, size_t cmdOffset, size_t listOffset, size_t listSize, size_t levelStride, bool keepLists)
+{
+  // clusters are static, moving particles and the slots until their clusters
+  // were rebuilt are classified one by one, occlusion culling is only done
+  // per particle
+  bool useClusters = m_tweak.usecompute && m_tweak.useclusters && !m_tweak.simulate && !m_tweak.occlusion
+                     && !m_slots.isModified();
+  bool simulate    = m_tweak.usecompute && m_tweak.simulate && buffers.velocities;
+  int  appendMode  = m_tweak.usecompute && !useClusters ? m_tweak.appendMode : APPEND_ATOMIC;
+  // holes of removed particles are skipped until compaction closed them
+  bool useLiveness = m_slots.getHoleCount() > 0;
+
+  glBindBufferRange(GL_ATOMIC_COUNTER_BUFFER, ABO_DATA_COUNTS, buffers.lodcmds, cmdOffset, sizeof(DrawCounters));
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_COUNTS, buffers.lodcmds, cmdOffset, sizeof(DrawCounters));
+  // the job's list of level l starts at listOffset + levelStride * l
+  size_t itemSize = m_tweak.useindices ? sizeof(int) : getParticleStride(m_tweak.particleFormat);
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_LISTS, buffers.lodlists, listOffset,
+                    levelStride * (m_tweak.lodLevels - 1) + listSize);
+
+  if(m_tweak.usecompute)
+  {
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.particles);
+  }
+  nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_HIZ, GL_TEXTURE_2D, m_tweak.occlusion ? textures.hiz : 0);
+
+  // uniforms are per program
+  auto useContentProgram = [&](GLuint program) {
+    glUseProgram(program);
+    glUniform1i(UNI_CONTENT_IDX_OFFSET, offset);
+    glUniform1ui(UNI_CONTENT_LIST_STRIDE, GLuint(levelStride / itemSize));
+    glUniform1i(UNI_CONTENT_LIVENESS, useLiveness ? 1 : 0);
+    if(m_tweak.usecompute)
+    {
+      glUniform1i(UNI_CONTENT_IDX_MAX, offset + cnt);
+    }
+  };
+  auto setSimulateStep = [&](bool enabled) {
+    glUniform1f(UNI_CONTENT_SIM_STEP, simulate && enabled ? m_tweak.simulateStep : 0.0f);
+  };
+
+  if(simulate)
+  {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_PARTICLES, buffers.particles);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_VELOCITIES, buffers.velocities);
+  }
+  if(useLiveness)
+  {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_LIVENESS, m_slots.getLivenessBuffer());
+  }
+
+  GLuint numGroups = (cnt + m_workGroupSize[0] - 1) / m_workGroupSize[0];
+
+  if(useClusters)
+  {
+    // one workgroup per cluster that overlaps the job's particles
+    int clusterBegin = offset / PARTICLE_CLUSTERSIZE;
+    int clusterEnd   = int(snapdiv(offset + cnt, PARTICLE_CLUSTERSIZE));
+
+    auto useClusterProgram = [&](GLuint program) {
+      useContentProgram(program);
+      glUniform1i(UNI_CONTENT_CLUSTER_OFFSET, clusterBegin);
+      if(m_tweak.incremental)
+      {
+        glUniform1i(UNI_CONTENT_INCR_RESET, m_incrReset ? 1 : 0);
+        glUniform4fv(UNI_CONTENT_INCR_DELTA, 7, &m_incrDelta[0].x);
+        glUniform1f(UNI_CONTENT_INCR_SCALE, m_incrScale);
+      }
+    };
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_CLUSTERS, buffers.clusters);
+    if(m_tweak.incremental)
+    {
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_CLUSTERCACHE, buffers.clustercache);
+    }
+
+    if(keepLists)
+    {
+      // only the clusters whose margin is used up are classified again,
+      // the counters of the previous run stay and their workgroups are
+      // dispatched indirectly
+      glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_INCRSTATE, buffers.incrstate);
+
+      useClusterProgram(programs.lodcontent_incr_prep_comp);
+      glDispatchCompute(1, 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+      useClusterProgram(programs.lodcontent_incr_mark_comp);
+      glDispatchCompute(GLuint(snapdiv(clusterEnd - clusterBegin, PARTICLE_CLUSTERSIZE)), 1, 1);
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+      useClusterProgram(programs.lodcontent_incr_keep_comp);
+      glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffers.incrstate);
+      glDispatchComputeIndirect(0);
+      glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    }
+    else
+    {
+      useClusterProgram(m_tweak.incremental ? programs.lodcontent_incr_comp : programs.lodcontent_cluster_comp);
+      glDispatchCompute(clusterEnd - clusterBegin, 1, 1);
+    }
+  }
+  else if(appendMode == APPEND_WORKGROUP)
+  {
+    useContentProgram(programs.lodcontent_wg_comp);
+    setSimulateStep(true);
+    glDispatchCompute(numGroups, 1, 1);
+  }
+  else if(appendMode == APPEND_ORDERED)
+  {
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_GROUPS, buffers.groupcounts, 0,
+                      sizeof(uvec4) * (LOD_MAX_LEVELS / 4) * numGroups);
+
+    // the counting pass simulates, the second pass reads the result
+    useContentProgram(programs.lodcontent_count_comp);
+    setSimulateStep(true);
+    glDispatchCompute(numGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    glUseProgram(programs.lodscan_comp);
+    glUniform1ui(UNI_SCAN_GROUPS, numGroups);
+    glDispatchCompute(LOD_MAX_LEVELS / 4, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    useContentProgram(programs.lodcontent_scatter_comp);
+    setSimulateStep(false);
+    glDispatchCompute(numGroups, 1, 1);
+  }
+  else if(m_tweak.usecompute)
+  {
+    useContentProgram(programs.lodcontent_comp);
+    setSimulateStep(true);
+    glDispatchCompute(numGroups, 1, 1);
+  }
+  else
+  {
+    useContentProgram(programs.lodcontent);
+
+    setParticleAttribs(true);
+
+    size_t stride = getParticleStride(m_tweak.particleFormat);
+    glBindVertexBuffer(0, buffers.particles, stride * offset, GLsizei(stride));
+    glDrawArrays(GL_POINTS, 0, cnt);
+
+    setParticleAttribs(false);
+  }
+}
+
+// sorts the job's lists above level 0 coarsely front to back, the
+// counts are taken from the job's commands before lodcmds resets them
+void Sample::binLodLists(int cnt, size_t cmdOffset, size_t listOffset, size_t listSize, size_t levelStride)
+{
+  size_t itemSize = m_tweak.useindices ? sizeof(int) : getParticleStride(m_tweak.particleFormat);
+  GLuint levels   = GLuint(m_tweak.lodLevels - 1);
+  GLuint groups   = std::min(GLuint(snapdiv(cnt, LODBIN_WORKGROUP_SIZE)), 64u);
+
+  // logarithmic bins over the hPos.w range of the particle box, as far as
+  // it lies between the near and far plane. w is linear, so the extremes
+  // are at the box's corners.
+  const mat4& viewProj = m_sceneUbo.viewProjMatrix;
+  vec3        boxMin   = vec3(m_sceneUbo.particleBoxMin);
+  vec3        boxMax   = boxMin + vec3(m_sceneUbo.particleBoxScale) * 65535.0f;
+  vec3        wRow     = vec3(viewProj[0][3], viewProj[1][3], viewProj[2][3]);
+  float       wCenter  = glm::dot(wRow, (boxMin + boxMax) * 0.5f) + viewProj[3][3];
+  float       wExtent  = glm::dot(glm::abs(wRow), (boxMax - boxMin) * 0.5f);
+  float       nearW    = std::min(std::max(wCenter - wExtent, m_nearPlane), m_farPlane * 0.5f);
+  float       farW     = std::min(std::max(wCenter + wExtent, nearW * 2.0f), m_farPlane);
+  vec2        binRange = vec2(log2f(nearW), float(LOD_DEPTH_BINS) / log2f(farW / nearW));
+
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_INDIRECTS, buffers.lodcmds, cmdOffset, sizeof(DrawIndirects));
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_LISTS, buffers.lodlists, listOffset,
+                    levelStride * (m_tweak.lodLevels - 1) + listSize);
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_SCRATCH, buffers.lodscratch, 0, listSize * levels);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_BINS, buffers.lodbins);
+  nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.particles);
+
+  for(int pass = 0; pass < 4; pass++)
+  {
+    glUseProgram(programs.lodbin_comp[pass]);
+    glUniform1ui(UNI_BIN_LIST_STRIDE, GLuint(levelStride / itemSize));
+    glUniform1ui(UNI_BIN_SCRATCH_STRIDE, GLuint(listSize / itemSize));
+    glUniform2fv(UNI_BIN_RANGE, 1, &binRange.x);
+    glDispatchCompute(pass == 1 ? 1 : groups, levels, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  }
+}
+
+// Computes how much the classification inputs changed since the last
+// incremental run. Returns true if nothing changed at all, which means
+// the previous lists are still exact.
+bool Sample::prepareIncremental()
+{
+  const SceneData& last = m_incrScene;
+  const SceneData& cur  = m_sceneUbo;
+
+  // small relative changes of the thresholds, e.g. by the budget
+  // controller, widen the margins instead of resetting the cache
+  bool  levelsChanged = last.lodLevels != cur.lodLevels;
+  float scale         = 0.0f;
+  for(uint32_t l = 1; l < cur.lodLevels && !levelsChanged; l++)
+  {
+    scale = std::max(scale, std::abs(last.lodTable[l].pixels / cur.lodTable[l].pixels - 1.0f));
+  }
+  m_incrScale = scale;
+
+  m_incrReset = !m_incrValid || last.viewpixelsize != cur.viewpixelsize || levelsChanged || scale > INCR_MAX_SCALE
+                || last.particleSize != cur.particleSize;
+
+  // meshes and batch sizes only change the commands
+  bool unchanged = !m_incrReset && memcmp(last.lodTable, cur.lodTable, sizeof(cur.lodTable)) == 0;
+  for(int i = 0; i < 6; i++)
+  {
+    m_incrDelta[i] = cur.frustum[i] - last.frustum[i];
+    unchanged      = unchanged && m_incrDelta[i] == vec4(0);
+  }
+  // hPos.w
+  m_incrDelta[6] = glm::transpose(cur.viewProjMatrix)[3] - glm::transpose(last.viewProjMatrix)[3];
+  unchanged      = unchanged && m_incrDelta[6] == vec4(0);
+
+  return unchanged;
+}
+
+// Incremental classification keeps the lists of the previous run and only
+// moves the particles of clusters whose classification may have changed.
+// That needs index lists at a fixed place, so a single job without depth
+// binning, pipelining or multiple views. The lists get twice the room,
+// see initLodBuffers.
+bool Sample::keepsIncrementalLists() const
+{
+  return m_tweak.incremental && m_tweak.useindices && m_tweak.jobCount == 1 && m_tweak.views == 1
+         && !m_tweak.depthBins && m_tweak.pipeline == PIPELINE_OFF;
+}
+
+void Sample::useLodSet(uint32_t set)
+{
+  buffers.lodlists     = m_lodSets[set].lodlists;
+  buffers.lodcmds      = m_lodSets[set].lodcmds;
+  buffers.lodmultidraw = m_lodSets[set].lodmultidraw;
+}
+
+// draws the lists of job i, or with multi the lists of all jobs at once
+void Sample::drawLodLists(bool multi, int i, int jobs, size_t jobSize, size_t levelStride, GLenum itemFormat, size_t itemSize, size_t listBase)
+{
+  PROFILE_SECTION("Draw");
+  // the following drawcalls all source the amount of works from drawindirect buffers
+  // generated above
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, multi ? buffers.lodmultidraw : buffers.lodcmds);
+
+  int levels = m_tweak.lodLevels;
+  //glEnable(GL_RASTERIZER_DISCARD);
+  if(m_tweak.useindices)
+  {
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.particles);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLEINDICES, GL_TEXTURE_BUFFER, textures.lodparticles);
+  }
+  else
+  {
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.lodparticles);
+    nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLEINDICES, GL_TEXTURE_BUFFER, 0);
+  }
+  if(!multi)
+  {
+    glBindBufferRange(GL_UNIFORM_BUFFER, UBO_CMDS, buffers.lodcmds, (i * jobSize), jobSize);
+  }
+  glEnableVertexAttribArray(VERTEX_POS);
+
+  {
+    PROFILE_SECTION("Tess");
+
+    glUseProgram(multi ? programs.draw_sphere_tess_mdi : programs.draw_sphere_tess);
+    glPatchParameteri(GL_PATCH_VERTICES, 3);
+
+    drawLodLevel(multi, levels - 1, i, jobs, jobSize, levelStride, itemFormat, listBase);
+  }
+
+  {
+    PROFILE_SECTION("Mesh");
+
+    glUseProgram(multi ? programs.draw_sphere_mdi : programs.draw_sphere);
+
+    for(int l = levels - 2; l > 0; l--)
+    {
+      if(m_lodSubdiv[l] != LOD_IMPOSTOR)
+      {
+        drawLodLevel(multi, l, i, jobs, jobSize, levelStride, itemFormat, listBase);
+      }
+    }
+  }
+
+  {
+    PROFILE_SECTION("Impo");
+
+    glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+    glUseProgram(multi ? programs.draw_sphere_impostor_mdi : programs.draw_sphere_impostor);
+
+    for(int l = levels - 2; l > 0; l--)
+    {
+      if(m_lodSubdiv[l] == LOD_IMPOSTOR)
+      {
+        drawLodLevel(multi, l, i, jobs, jobSize, levelStride, itemFormat, listBase);
+      }
+    }
+
+    glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+  }
+
+  glDisableVertexAttribArray(VERTEX_POS);
+  glBindVertexBuffer(0, 0, 0, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, UBO_CMDS, 0);
+
+  {
+    PROFILE_SECTION("Pnts");
+
+    glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+
+    glUseProgram(programs.draw_sphere_point);
+
+    if(m_tweak.useindices)
+    {
+      glTextureBufferRange(textures.lodparticles, itemFormat, buffers.lodlists, listBase, levelStride);
+    }
+    else
+    {
+      setParticleAttribs(true);
+      glBindVertexBuffer(0, buffers.lodlists, listBase, (GLsizei)itemSize);
+    }
+
+    if(multi)
+    {
+      glMultiDrawArraysIndirect(GL_POINTS, NV_BUFFER_OFFSET(sizeof(DrawElements) * (LOD_MAX_LEVELS - 1) * jobs * 2), jobs,
+                                sizeof(DrawElements));
+    }
+    else
+    {
+      glDrawArraysIndirect(GL_POINTS, NV_BUFFER_OFFSET(offsetof(DrawIndirects, farArray) + (i * jobSize)));
+    }
+
+    if(!m_tweak.useindices)
+    {
+      setParticleAttribs(false);
+    }
+
+    glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+
+    glBindVertexBuffer(0, 0, 0, 0);
+  }
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  //glDisable(GL_RASTERIZER_DISCARD);
 }
 
-void Sample::processUI(double time)
+// draws one mesh or impostor level, or the tessellated last level, with
+// the draw program already bound
+void Sample::drawLodLevel(bool multi, int level, int i, int jobs, size_t jobSize, size_t levelStride, GLenum itemFormat, size_t listBase)
 {
-  int width  = m_windowState.m_winSize[0];
-  int height = m_windowState.m_winSize[1];
+  int    mesh = getLevelMesh(level);
+  GLenum prim = mesh == BATCH_TESS ? GL_PATCHES : mesh == BATCH_IMPOSTOR ? GL_POINTS : GL_TRIANGLES;
 
-  // Update imgui configuration
-  auto& imgui_io       = ImGui::GetIO();
-  imgui_io.DeltaTime   = static_cast<float>(time - m_uiTime);
-  imgui_io.DisplaySize = ImVec2(width, height);
+  glBindVertexBuffer(0, buffers.sphere_vbo[mesh], 0, sizeof(vec4));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.sphere_ibo[mesh]);
+  glTextureBufferRange(textures.lodparticles, itemFormat, buffers.lodlists, listBase + levelStride * level, levelStride);
 
-  m_uiTime = time;
+  glUniform1i(UNI_BATCH_SIZE, m_tweak.batchSizes[mesh]);
+  if(prim == GL_TRIANGLES)
+  {
+    glUniform1i(UNI_MESH_VERTICES, GLint(m_sphereVertices[mesh]));
+  }
 
-  ImGui::NewFrame();
-  ImGui::SetNextWindowSize(ImGuiH::dpiScaled(350, 0), ImGuiCond_FirstUseEver);
-  if(ImGui::Begin("NVIDIA " PROJECT_NAME, nullptr))
+  if(multi)
   {
-    ImGui::Checkbox("use lod", &m_tweak.uselod);
-    ImGui::Checkbox("use tess (if no lod)", &m_tweak.nolodtess);
-    ImGui::Checkbox("wireframe", &m_tweak.wireframe);
-    ImGui::Checkbox("use indexing", &m_tweak.useindices);
-    ImGui::Checkbox("use compute", &m_tweak.usecompute);
-    ImGui::Checkbox("pause lod", &m_tweak.pause);
-    ImGuiH::InputIntClamped("num partices", &m_tweak.particleCount, 1, 1024 * 1024 * 1024, 1024 * 512, 1024 * 1024,
-                            ImGuiInputTextFlags_EnterReturnsTrue);
-    ImGui::Separator();
-    ImGui::PushItemWidth(ImGui::GetWindowWidth() * 0.585f);
-    ImGui::DragFloat("lod near pixelsize", &m_sceneUbo.nearPixels, 0.1f, 1, 1000);
-    ImGui::DragFloat("lod far pixelsize", &m_sceneUbo.farPixels, 0.1f, 1, 1000);
-    ImGui::DragFloat("tess pixelsize", &m_sceneUbo.tessPixels, 0.1f, 1, 1000);
-    ImGui::Separator();
-    ImGui::SliderFloat("fov", &m_tweak.fov, 1, 90.0f);
-    ImGui::PopItemWidth();
+    glMultiDrawElementsIndirect(prim, GL_UNSIGNED_INT, NV_BUFFER_OFFSET(sizeof(DrawElements) * (level - 1) * jobs * 2),
+                                jobs * 2, sizeof(DrawElements));
+  }
+  else
+  {
+    size_t cmdOffset = sizeof(DrawElements) * level + (i * jobSize);
+
+    glUniform1i(UNI_LOD_LEVEL, level);
+    glUniform1i(UNI_USE_CMDOFFSET, 0);
+    glDrawElementsIndirect(prim, GL_UNSIGNED_INT, NV_BUFFER_OFFSET(offsetof(DrawIndirects, levelFull) + cmdOffset));
+
+    glUniform1i(UNI_USE_CMDOFFSET, 1);
+    glDrawElementsIndirect(prim, GL_UNSIGNED_INT, NV_BUFFER_OFFSET(offsetof(DrawIndirects, levelRest) + cmdOffset));
   }
-  ImGui::End();
 }
 
 void Sample::drawLod()
@@ -514,72 +2871,138 @@ void Sample::drawLod()
   }
   else
   {
-    itemSize   = sizeof(Particle);
-    itemFormat = GL_RGBA32F;
+    itemSize   = getParticleStride(m_tweak.particleFormat);
+    itemFormat = getParticleTextureFormat(m_tweak.particleFormat);
   }
 
+  int    capacity  = getParticleCapacity();
   size_t jobSize   = snapsize(sizeof(DrawIndirects), 256);
-  int    jobCount  = (int)(snapsize(itemSize * (m_tweak.particleCount / m_tweak.jobCount), 256) / itemSize);
-  size_t jobOffset = snapsize(itemSize * m_tweak.particleCount, 256);
-  int    jobs      = (int)snapdiv(m_tweak.particleCount, jobCount);
-  int    jobRest   = m_tweak.particleCount - (jobs - 1) * jobCount;
+  int    jobCount  = (int)(snapsize(itemSize * (capacity / m_tweak.jobCount), 256) / itemSize);
+  int    jobs      = (int)snapdiv(capacity, jobCount);
+  int    jobRest   = capacity - (jobs - 1) * jobCount;
+
+  // with multi draw every job keeps its own lists, they are all drawn at
+  // once after classification
+  bool   multi       = m_tweak.multidraw;
+  bool   keepable    = keepsIncrementalLists();
+  size_t listSize    = itemSize * jobCount * (keepable ? 2 : 1);
+  int    slots       = multi ? jobs : m_jobSlots;
+  size_t levelStride = listSize * slots;
+  bool   listsKept   = jobs == 1 || multi;
+  // no job's lists are overwritten
+  bool   slotsKept   = slots == jobs;
+
+  // the cpu classifier and the clusters follow the slots only once they
+  // are dense
+  bool useCpu         = m_tweak.usecpu && m_cpuLod.isValid() && !m_slots.isModified();
+  bool useIncremental = m_tweak.incremental && m_tweak.usecompute && m_tweak.useclusters && !useCpu && !m_tweak.simulate
+                        && !m_tweak.occlusion && !m_slots.isModified();
+  bool classify       = !m_tweak.pause || !slotsKept;
+  bool keepLists      = useIncremental && keepable;
+
+  if(classify && keepLists != m_incrListsKept)
+  {
+    // the kept lists have no ranges in the cache yet, or their counters
+    // were left set for the next run
+    m_incrValid = m_incrValid && !keepLists;
+    if(!keepLists)
+    {
+      glClearNamedBufferSubData(buffers.lodcmds, GL_R32UI, 0, sizeof(DrawCounters), GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    }
+  }
+
+  if(classify && useIncremental)
+  {
+    // the previous frame's lists are still exact if nothing changed
+    classify = !prepareIncremental() || !slotsKept;
+  }
+
+  bool pipelined = m_lodSets[1].lodlists && listsKept;
+  bool deferred  = pipelined && m_tweak.pipeline == PIPELINE_DEFERRED;
+  bool drawn     = false;
+  if(pipelined)
+  {
+    useLodSet(m_lodSetDrawn);
+
+    // the commands were completed at the end of the previous frame, the
+    // new classification goes to the other set and has no dependency on
+    // these draws
+    if(deferred && m_lodSetValid)
+    {
+      glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+      drawLodLists(multi, 0, jobs, jobSize, levelStride, itemFormat, itemSize);
+      drawn = true;
+    }
+    if(classify && m_lodSetValid)
+    {
+      m_lodSetDrawn ^= 1;
+      useLodSet(m_lodSetDrawn);
+    }
+    m_lodSetValid = m_lodSetValid || classify;
+  }
+
+  uint32_t statsSlot = m_statsFrame % STATS_FRAMES;
+  if(classify)
+  {
+    beginLodStats(statsSlot);
+  }
 
   int offset = 0;
   for(int i = 0; i < jobs; i++)
   {
-    int cnt = i == jobs - 1 ? jobRest : jobCount;
+    int    cnt        = i == jobs - 1 ? jobRest : jobCount;
+    size_t listOffset = listSize * (i % slots);
+    // particles that are still streamed in or behind the active range of
+    // the slots are skipped
+    int loadedCnt = std::max(0, std::min(cnt, getActiveCount() - offset));
 
-    if(!m_tweak.pause || jobs > 1)
+    if(classify)
     {
-      NV_PROFILE_GL_SECTION("Lod");
+      PROFILE_SECTION("Lod");
       glEnable(GL_RASTERIZER_DISCARD);
 
-      {
-        NV_PROFILE_GL_SECTION("Cont");
+      m_statsReadback[statsSlot].processed += uint32_t(loadedCnt);
 
-        glUseProgram(m_progManager.get(m_tweak.usecompute ? programs.lodcontent_comp : programs.lodcontent));
+      {
+        PROFILE_SECTION("Cont");
 
-        if(m_tweak.usecompute)
+        // without content the counters stay zero, lodcmds resets them
+        if(loadedCnt > 0 && useCpu)
         {
-          glUniform1i(UNI_CONTENT_IDX_MAX, offset + cnt);
-          nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.particles);
+          classifyCpu(offset, loadedCnt, jobSize * i, listOffset, levelStride);
         }
-        else
+        else if(loadedCnt > 0)
         {
-          glEnableVertexAttribArray(VERTEX_POS);
-          glEnableVertexAttribArray(VERTEX_COLOR);
-
-          glBindVertexBuffer(0, buffers.particles, sizeof(Particle) * offset, sizeof(Particle));
+          classifyGpu(offset, loadedCnt, jobSize * i, listOffset, listSize, levelStride, keepLists);
         }
+      }
+
+      if(loadedCnt > 0 && m_tweak.depthBins)
+      {
+        PROFILE_SECTION("Bin");
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT);
+        binLodLists(loadedCnt, jobSize * i, listOffset, listSize, levelStride);
+      }
 
-        glUniform1i(UNI_CONTENT_IDX_OFFSET, offset);
+      {
+        PROFILE_SECTION("Cmds");
 
-        glBindBufferRange(GL_ATOMIC_COUNTER_BUFFER, ABO_DATA_COUNTS, buffers.lodcmds, jobSize * i, sizeof(DrawCounters));
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_POINTS, buffers.lodparticles0);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_BASIC, buffers.lodparticles1);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_TESS, buffers.lodparticles2);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
 
-        if(m_tweak.usecompute)
+        if(multi)
         {
-          GLuint numGroups = (cnt + m_workGroupSize[0] - 1) / m_workGroupSize[0];
-
-          glDispatchCompute(numGroups, 1, 1);
+          glUseProgram(m_tweak.usecompute ? programs.lodcmds_mdi_comp : programs.lodcmds_mdi);
+          glUniform1ui(UNI_CMDS_JOB, i);
+          glUniform1ui(UNI_CMDS_JOBS, jobs);
+          glUniform1ui(UNI_CMDS_LISTBASE, GLuint(listOffset / itemSize));
+          glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_MULTIDRAW, buffers.lodmultidraw);
         }
         else
         {
-          glDrawArrays(GL_POINTS, 0, cnt);
-
-          glDisableVertexAttribArray(VERTEX_POS);
-          glDisableVertexAttribArray(VERTEX_COLOR);
+          glUseProgram(m_tweak.usecompute ? programs.lodcmds_comp : programs.lodcmds);
         }
-      }
-
-      {
-        NV_PROFILE_GL_SECTION("Cmds");
-
-        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
-
-        glUseProgram(m_progManager.get(m_tweak.usecompute ? programs.lodcmds_comp : programs.lodcmds));
+        glUniform1i(UNI_CMDS_KEEP, keepLists ? 1 : 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_INCRSTATE, buffers.incrstate);
 
         glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_INDIRECTS, buffers.lodcmds, jobSize * i, sizeof(DrawIndirects));
         if(m_tweak.usecompute)
@@ -591,185 +3014,374 @@ void Sample::drawLod()
           glDrawArrays(GL_POINTS, 0, 1);
         }
 
-        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT
-                        | GL_COMMAND_BARRIER_BIT);
+        // deferred draws wait for the last job's commands in the next frame
+        if(!drawn || i < jobs - 1)
+        {
+          glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT
+                          | GL_COMMAND_BARRIER_BIT);
+        }
       }
 
       glDisable(GL_RASTERIZER_DISCARD);
     }
 
+    if(!multi && !drawn)
     {
-      NV_PROFILE_GL_SECTION("Draw");
-      // the following drawcalls all source the amount of works from drawindirect buffers
-      // generated above
-      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers.lodcmds);
-      //glEnable(GL_RASTERIZER_DISCARD);
-      {
-        NV_PROFILE_GL_SECTION("Tess");
+      drawLodLists(false, i, jobs, jobSize, levelStride, itemFormat, itemSize, listOffset);
+    }
 
-        glUseProgram(m_progManager.get(programs.draw_sphere_tess));
-        glPatchParameteri(GL_PATCH_VERTICES, 3);
+    offset += cnt;
+  }
 
-        glBindVertexBuffer(0, buffers.sphere_vbo, 0, sizeof(vec4));
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.sphere_ibo);
-        glEnableVertexAttribArray(VERTEX_POS);
+  if(multi && !drawn)
+  {
+    drawLodLists(true, 0, jobs, jobSize, levelStride, itemFormat, itemSize);
+  }
 
-        if(m_tweak.useindices)
-        {
-          nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.particles);
-          nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLEINDICES, GL_TEXTURE_BUFFER, textures.lodparticles);
-        }
-        else
-        {
-          nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.lodparticles);
-          nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLEINDICES, GL_TEXTURE_BUFFER, 0);
-        }
+  if(classify)
+  {
+    m_incrValid     = useIncremental;
+    m_incrListsKept = keepLists;
+    m_incrScene     = m_sceneUbo;
 
-        glTextureBuffer(textures.lodparticles, itemFormat, buffers.lodparticles2);
+    endLodStats(statsSlot);
+  }
 
-        glBindBufferRange(GL_UNIFORM_BUFFER, UBO_CMDS, buffers.lodcmds, (i * jobSize), jobSize);
+  NV_PROFILE_GL_SPLIT();
+}
 
-        glUniform1i(UNI_USE_CMDOFFSET, 0);
-        glDrawElementsIndirect(GL_PATCHES, GL_UNSIGNED_INT, NV_BUFFER_OFFSET(offsetof(DrawIndirects, nearFull) + (i * jobSize)));
+// classifies the particles for all views with one pass, then every view
+// builds its commands and is drawn into its part of the viewport
+void Sample::drawLodViews()
+{
+  NV_PROFILE_GL_SPLIT();
 
-        glUniform1i(UNI_USE_CMDOFFSET, 1);
-        glDrawElementsIndirect(GL_PATCHES, GL_UNSIGNED_INT, NV_BUFFER_OFFSET(offsetof(DrawIndirects, nearRest) + (i * jobSize)));
+  size_t itemSize;
+  GLenum itemFormat;
 
-        glDisableVertexAttribArray(VERTEX_POS);
-        glBindVertexBuffer(0, 0, 0, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        glBindBufferBase(GL_UNIFORM_BUFFER, UBO_CMDS, 0);
-      }
+  if(m_tweak.useindices)
+  {
+    itemSize   = sizeof(int);
+    itemFormat = GL_R32I;
+  }
+  else
+  {
+    itemSize   = getParticleStride(m_tweak.particleFormat);
+    itemFormat = getParticleTextureFormat(m_tweak.particleFormat);
+  }
+
+  int    capacity = getParticleCapacity();
+  size_t jobSize  = snapsize(sizeof(DrawIndirects), 256);
+  int    jobCount = (int)(snapsize(itemSize * (capacity / m_tweak.jobCount), 256) / itemSize);
+  int    jobs     = (int)snapdiv(capacity, jobCount);
+  int    jobRest  = capacity - (jobs - 1) * jobCount;
+
+  // view v uses the commands of job slot v and lists after the previous views'
+  int    views      = m_tweak.views;
+  size_t listSize   = itemSize * jobCount;
+  size_t viewStride = listSize * m_tweak.lodLevels;
+  size_t sceneSize  = snapsize(sizeof(SceneData), 256);
+  bool   classify   = !m_tweak.pause || jobs > 1;
+
+  uint32_t statsSlot = m_statsFrame % STATS_FRAMES;
+  if(classify)
+  {
+    beginLodStats(statsSlot);
+  }
+
+  int offset = 0;
+  for(int i = 0; i < jobs; i++)
+  {
+    int cnt       = i == jobs - 1 ? jobRest : jobCount;
+    int loadedCnt = std::max(0, std::min(cnt, getActiveCount() - offset));
+
+    if(classify)
+    {
+      PROFILE_SECTION("Lod");
 
+      // the accepted counts are summed over the views, so is this
+      m_statsReadback[statsSlot].processed += uint32_t(loadedCnt * views);
+
+      if(loadedCnt > 0)
       {
-        NV_PROFILE_GL_SECTION("Mesh");
+        PROFILE_SECTION("Cont");
+
+        glUseProgram(programs.lodviews_comp);
+        glUniform1i(UNI_VIEWS_IDX_OFFSET, offset);
+        glUniform1i(UNI_VIEWS_IDX_MAX, offset + loadedCnt);
+        glUniform1ui(UNI_VIEWS_COUNT, GLuint(views));
+        glUniform1ui(UNI_VIEWS_LIST_STRIDE, GLuint(listSize / itemSize));
+        glUniform1ui(UNI_VIEWS_VIEW_STRIDE, GLuint(viewStride / itemSize));
+        glUniform1ui(UNI_VIEWS_CMD_STRIDE, GLuint(jobSize / sizeof(uint32_t)));
+        glUniform1i(UNI_VIEWS_LIVENESS, m_slots.getHoleCount() > 0 ? 1 : 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_LIVENESS, m_slots.getLivenessBuffer());
+
+        glBindBufferBase(GL_UNIFORM_BUFFER, UBO_VIEWS, buffers.views_ubo);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_INDIRECTS, buffers.lodcmds, 0, jobSize * views);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_LISTS, buffers.lodlists, 0, viewStride * views);
+        nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.particles);
+
+        glDispatchCompute(GLuint(snapdiv(loadedCnt, LODVIEWS_WORKGROUP_SIZE)), 1, 1);
+      }
 
-        glUseProgram(m_progManager.get(programs.draw_sphere));
+      {
+        PROFILE_SECTION("Cmds");
 
-        glBindVertexBuffer(0, buffers.sphere_vbo, 0, sizeof(vec4));
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.sphere_ibo);
-        glEnableVertexAttribArray(VERTEX_POS);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-        if(m_tweak.useindices)
-        {
-          nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.particles);
-          nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLEINDICES, GL_TEXTURE_BUFFER, textures.lodparticles);
-        }
-        else
+        glUseProgram(programs.lodcmds_comp);
+        glUniform1i(UNI_CMDS_KEEP, 0);
+        for(int v = 0; v < views; v++)
         {
-          nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.lodparticles);
-          nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLEINDICES, GL_TEXTURE_BUFFER, 0);
+          // every view adds to the same statistics
+          if(v > 0)
+          {
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+          }
+          glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_INDIRECTS, buffers.lodcmds, jobSize * v, sizeof(DrawIndirects));
+          glDispatchCompute(1, 1, 1);
         }
 
-        glTextureBuffer(textures.lodparticles, itemFormat, buffers.lodparticles1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_UNIFORM_BARRIER_BIT
+                        | GL_COMMAND_BARRIER_BIT);
+      }
+    }
 
-        glBindBufferRange(GL_UNIFORM_BUFFER, UBO_CMDS, buffers.lodcmds, (i * jobSize), jobSize);
+    for(int v = 0; v < views; v++)
+    {
+      glViewport(GLint(m_sceneUbo.viewport.x) * v, 0, GLsizei(m_sceneUbo.viewport.x), GLsizei(m_sceneUbo.viewport.y));
+      glBindBufferRange(GL_UNIFORM_BUFFER, UBO_SCENE, buffers.scene_ubo, sceneSize * v, sizeof(SceneData));
+      drawLodLists(false, v, jobs, jobSize, listSize, itemFormat, itemSize, viewStride * v);
+    }
 
-        glUniform1i(UNI_USE_CMDOFFSET, 0);
-        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NV_BUFFER_OFFSET(offsetof(DrawIndirects, medFull) + (i * jobSize)));
+    offset += cnt;
+  }
 
-        glUniform1i(UNI_USE_CMDOFFSET, 1);
-        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NV_BUFFER_OFFSET(offsetof(DrawIndirects, medRest) + (i * jobSize)));
+  glViewport(0, 0, GLsizei(m_sceneUbo.viewport.x) * views, GLsizei(m_sceneUbo.viewport.y));
+  glBindBufferRange(GL_UNIFORM_BUFFER, UBO_SCENE, buffers.scene_ubo, 0, sizeof(SceneData));
+  glBindBufferBase(GL_UNIFORM_BUFFER, UBO_VIEWS, 0);
 
-        glDisableVertexAttribArray(VERTEX_POS);
-        glBindVertexBuffer(0, 0, 0, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        glBindBufferBase(GL_UNIFORM_BUFFER, UBO_CMDS, 0);
-      }
+  if(classify)
+  {
+    endLodStats(statsSlot);
+  }
 
-      {
-        NV_PROFILE_GL_SECTION("Pnts");
+  NV_PROFILE_GL_SPLIT();
+}
 
-        glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+// lodcmds accumulates the frame's statistics, read back a few frames later
+void Sample::beginLodStats(uint32_t slot)
+{
+  readLodStats(slot);
+  glClearNamedBufferData(buffers.lodstats, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_STATS, buffers.lodstats);
+  m_statsReadback[slot].processed = 0;
+}
 
-        glUseProgram(m_progManager.get(programs.draw_sphere_point));
+void Sample::endLodStats(uint32_t slot)
+{
+  glCopyNamedBufferSubData(buffers.lodstats, buffers.lodstatsread, 0, sizeof(LodStats) * slot, sizeof(LodStats));
+  m_statsReadback[slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  m_statsFrame++;
+}
 
-        if(m_tweak.useindices)
-        {
-          nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.particles);
-          nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLEINDICES, GL_TEXTURE_BUFFER, textures.lodparticles);
-        }
-        else
-        {
-          glEnableVertexAttribArray(VERTEX_POS);
-          glEnableVertexAttribArray(VERTEX_COLOR);
-        }
+// picks up the statistics of the slot's previous use, if the gpu is done
+// with them, otherwise they are dropped
+void Sample::readLodStats(uint32_t slot)
+{
+  StatsReadback& readback = m_statsReadback[slot];
+  if(!readback.fence)
+    return;
 
-        if(m_tweak.useindices)
-        {
-          glTextureBuffer(textures.lodparticles, itemFormat, buffers.lodparticles0);
-          glDrawArraysIndirect(GL_POINTS, NV_BUFFER_OFFSET(offsetof(DrawIndirects, farArray) + (i * jobSize)));
-        }
-        else
-        {
-          glBindVertexBuffer(0, buffers.lodparticles0, 0, (GLsizei)itemSize);
-          glDrawArraysIndirect(GL_POINTS, NV_BUFFER_OFFSET(offsetof(DrawIndirects, farArray) + (i * jobSize)));
-        }
+  if(glClientWaitSync(readback.fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+  {
+    m_lodStats     = m_lodStatsMapping[slot];
+    m_lodProcessed = readback.processed;
+    m_lodStatsRead++;
 
-        if(!m_tweak.useindices)
-        {
-          glDisableVertexAttribArray(VERTEX_POS);
-          glDisableVertexAttribArray(VERTEX_COLOR);
-        }
+    if(m_statsLog > 0 && m_lodStatsRead % uint32_t(m_statsLog) == 0)
+    {
+      std::string levels;
+      for(int l = 0; l < m_tweak.lodLevels; l++)
+      {
+        levels += " " + std::to_string(m_lodStats.levelCnt[l / 4][l % 4]);
+      }
+      LOGI("lodstats: processed %u levels%s occluded %u culled %u\n", m_lodProcessed, levels.c_str(),
+           m_lodStats.occluded, getLodCulled());
+    }
+  }
+  glDeleteSync(readback.fence);
+  readback.fence = nullptr;
+}
 
-        glDisable(GL_VERTEX_PROGRAM_POINT_SIZE);
+void Sample::updateBudget()
+{
+  if(m_lastTweak.budgetMode != m_tweak.budgetMode)
+  {
+    m_budget.reset();
+  }
+  // the thresholds have no effect on frozen or disabled lod
+  if(m_tweak.budgetMode == BUDGET_OFF || m_tweak.pause || !m_tweak.uselod || m_autotuner.isActive())
+    return;
 
-        glBindVertexBuffer(0, 0, 0, 0);
-      }
+  if(m_tweak.budgetMode == BUDGET_GPUTIME)
+  {
+    if(m_budgetSample == m_benchTimers.getCollected())
+      return;
+    m_budgetSample = m_benchTimers.getCollected();
 
-      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
-      //glDisable(GL_RASTERIZER_DISCARD);
-    }
+    double measured = m_benchTimers.getLatest().microseconds[SectionTimers::SECTION_FRAME];
+    m_budget.update(measured, double(m_tweak.budgetMs) * 1000.0, m_budgetConfig);
+    return;
+  }
 
-    offset += cnt;
+  if(m_budgetSample == m_lodStatsRead)
+    return;
+  m_budgetSample = m_lodStatsRead;
+
+  // the statistics refer to the thresholds at the time of classification,
+  // the controller's damping accounts for the delay
+  int      levels = m_tweak.lodLevels;
+  uint32_t counts[LOD_MAX_LEVELS];
+  float    triangles[LOD_MAX_LEVELS];
+  for(int l = 0; l < levels; l++)
+  {
+    counts[l]    = m_lodStats.levelCnt[l / 4][l % 4];
+    triangles[l] = float(m_sceneUbo.lodTable[l].indices / 3);
+    // a sprite rasterizes like a quad
+    if(l > 0 && l < levels - 1 && m_lodSubdiv[l] == LOD_IMPOSTOR)
+    {
+      triangles[l] = 2.0f;
+    }
   }
+  // tessellated particles get at least the factor at their threshold
+  float tess            = std::max(1.0f, m_sceneUbo.lodTable[levels - 1].pixels / m_sceneUbo.tessPixels);
+  triangles[levels - 1] = float(PARTICLE_BASICPRIMS) * tess * tess;
 
-  NV_PROFILE_GL_SPLIT();
+  if(m_tweak.budgetMode == BUDGET_TRIANGLES)
+  {
+    double measured = m_costModel.getTriangles(counts, triangles, levels);
+    m_budget.update(measured, double(m_tweak.budgetMTris) * 1000000.0, m_budgetConfig);
+  }
+  else
+  {
+    double measured = m_costModel.getMicroseconds(counts, triangles, levels);
+    m_budget.update(measured, double(m_tweak.budgetMs) * 1000.0, m_budgetConfig);
+  }
 }
 
 void Sample::think(double time)
 {
-  NV_PROFILE_GL_SECTION("Frame");
+  m_benchTimers.beginFrame();
+  PROFILE_SECTION("Frame");
 
   processUI(time);
 
+  if(m_sweep.isActive() && m_sweep.frame(m_benchTimers) == SweepBenchmark::ACTION_FINISHED)
+  {
+    m_benchTimers.setEnabled(false);
+    close();
+  }
+  else if(m_autotuner.isActive())
+  {
+    if(m_autotuner.frame(m_benchTimers) == SweepBenchmark::ACTION_FINISHED)
+    {
+      LOGI("autotune: -batchsizes %d %d %d %d %d\n", m_tweak.batchSizes[0], m_tweak.batchSizes[1],
+           m_tweak.batchSizes[2], m_tweak.batchSizes[3], m_tweak.batchSizes[4]);
+    }
+  }
+  else if(!m_sweep.isActive())
+  {
+    // only the controller uses the timers, it looks at the latest result
+    m_benchTimers.setEnabled(m_tweak.budgetMode == BUDGET_GPUTIME);
+    m_benchTimers.clearResults();
+  }
+
   m_control.processActions({m_windowState.m_winSize[0], m_windowState.m_winSize[1]},
                            glm::vec2(m_windowState.m_mouseCurrent[0], m_windowState.m_mouseCurrent[1]),
                            m_windowState.m_mouseButtonFlags, m_windowState.m_mouseWheel);
 
+  if(m_validate)
+  {
+    beginValidateStep();
+  }
+
   m_tweak.jobCount = std::min(m_tweak.particleCount, m_tweak.jobCount);
 
-  if(m_lastTweak.useindices != m_tweak.useindices)
+  m_tweak.particleFormat = std::max(0, std::min(NUM_PARTICLE_FORMATS - 1, m_tweak.particleFormat));
+
+  if(m_lastTweak.lodLevels != m_tweak.lodLevels)
+  {
+    initLodTable();
+  }
+
+  for(int m = 0; m < NUM_BATCH_MESHES; m++)
+  {
+    if(m_lastTweak.batchSizes[m] != m_tweak.batchSizes[m])
+    {
+      initBatchedMesh(m);
+    }
+  }
+
+  if(m_lastTweak.useindices != m_tweak.useindices || m_lastTweak.particleFormat != m_tweak.particleFormat)
+  {
+    selectPrograms();
+  }
+
+  if(m_lastTweak.particleFormat != m_tweak.particleFormat)
   {
-    updateProgramDefines();
-    m_progManager.reloadPrograms();
+    updateVertexFormat();
   }
 
-  if(m_lastTweak.particleCount != m_tweak.particleCount)
+  if(m_lastTweak.particleCount != m_tweak.particleCount || m_lastTweak.usecpu != m_tweak.usecpu
+     || m_lastTweak.particleFormat != m_tweak.particleFormat || m_lastTweak.simulate != m_tweak.simulate
+     || m_lastTweak.morton != m_tweak.morton || (m_lastTweak.churn > 0) != (m_tweak.churn > 0))
   {
     initParticleBuffer();
     initLodBuffers();
   }
 
-  if(m_lastTweak.jobCount != m_tweak.jobCount || m_lastTweak.useindices != m_tweak.useindices)
+  m_tweak.views = std::max(1, std::min(LOD_MAX_VIEWS, m_tweak.views));
+
+  if(m_lastTweak.jobCount != m_tweak.jobCount || m_lastTweak.useindices != m_tweak.useindices
+     || m_lastTweak.multidraw != m_tweak.multidraw || m_lastTweak.lodLevels != m_tweak.lodLevels
+     || m_lastTweak.depthBins != m_tweak.depthBins || m_lastTweak.pipeline != m_tweak.pipeline
+     || m_lastTweak.views != m_tweak.views || m_lastTweak.listMemoryMB != m_tweak.listMemoryMB
+     || m_lastTweak.incremental != m_tweak.incremental)
   {
     initLodBuffers();
   }
 
+  if(m_file.isOpen())
+  {
+    streamParticles();
+  }
+
   if(m_windowState.onPress(KEY_R))
   {
-    m_progManager.reloadPrograms();
-    glGetProgramiv(m_progManager.get(programs.lodcontent_comp), GL_COMPUTE_WORK_GROUP_SIZE, (GLint*)m_workGroupSize);
+    // only edited sources compile again
+    m_programCache.deletePrograms();
+    initProgramVariants();
   }
-  if(!m_progManager.areProgramsValid())
+  if(!m_programsValid)
   {
     waitEvents();
     return;
   }
 
+  updateParticleSlots();
+
   int width  = m_windowState.m_winSize[0];
   int height = m_windowState.m_winSize[1];
 
+  // occlusion culling needs the depth as texture
+  bool useFbo = m_offscreen || m_tweak.occlusion;
+  if(useFbo && !framebuffers.scene)
+  {
+    initFramebuffers(width, height);
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, useFbo ? framebuffers.scene : 0);
   glViewport(0, 0, width, height);
 
   glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
@@ -777,32 +3389,79 @@ void Sample::think(double time)
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
   {  // Update UBO
-    glBindBufferBase(GL_UNIFORM_BUFFER, UBO_SCENE, buffers.scene_ubo);
+    glBindBufferRange(GL_UNIFORM_BUFFER, UBO_SCENE, buffers.scene_ubo, 0, sizeof(SceneData));
+
+    // multiple views are side by side, each of the same size
+    int views     = m_tweak.uselod ? m_tweak.views : 1;
+    int viewWidth = std::max(1, width / views);
 
-    m_sceneUbo.viewport = uvec2(width, height);
+    m_sceneUbo.viewport = uvec2(viewWidth, height);
 
-    float farplane = 1000.0f;
+    float farplane = m_farPlane;
 
-    glm::mat4 projection = glm::perspectiveRH_ZO((m_tweak.fov), float(width) / float(height), 0.1f, farplane);
+    glm::mat4 projection = glm::perspectiveRH_ZO((m_tweak.fov), float(viewWidth) / float(height), m_nearPlane, farplane);
     glm::mat4 view       = m_control.m_viewMatrix;
 
     vec4 hPos                = projection * glm::vec4(1.0f, 1.0f, -1000.0f, 1.0f);
     vec2 hCoord              = vec2(hPos.x / hPos.w, hPos.y / hPos.w);
     vec2 dim                 = glm::abs(hCoord);
-    m_sceneUbo.viewpixelsize = dim * vec2(float(width), float(height)) * farplane * 0.5f;
+    m_sceneUbo.viewpixelsize = dim * vec2(float(viewWidth), float(height)) * farplane * 0.5f;
 
-    m_sceneUbo.viewProjMatrix = projection * view;
-    m_sceneUbo.viewMatrix     = view;
-    m_sceneUbo.viewMatrixIT   = glm::transpose(glm::inverse(view));
+    // the views are offset along the camera's x axis around the camera
+    float separation = m_tweak.viewSeparation * m_control.m_sceneDimension;
+    view = glm::translate(glm::mat4(1.0f), vec3(0.5f * float(views - 1) * separation, 0.0f, 0.0f)) * view;
+
+    m_sceneUbo.viewProjMatrix  = projection * view;
+    m_sceneUbo.viewMatrix      = view;
+    m_sceneUbo.viewMatrixIT    = glm::transpose(glm::inverse(view));
+    m_sceneUbo.viewProjMatrixI = glm::inverse(m_sceneUbo.viewProjMatrix);
 
     Frustum::init((float(*)[4]) & m_sceneUbo.frustum[0].x, glm::value_ptr(m_sceneUbo.viewProjMatrix));
 
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SceneData), &m_sceneUbo);
+    updateBudget();
+    updateLodTable();
+
+    bool useHiz                  = m_tweak.occlusion && m_hizValid;
+    m_sceneUbo.hizViewProjMatrix = m_hizViewProj;
+    m_sceneUbo.hizEyePos         = m_hizEyePos;
+    m_sceneUbo.hizSize           = vec4(float(width), float(height), float(m_hizLevels), useHiz ? 1.0f : 0.0f);
+
+    glNamedBufferSubData(buffers.scene_ubo, 0, sizeof(SceneData), &m_sceneUbo);
+
+    for(int v = 1; v < views; v++)
+    {
+      SceneData& viewScene = m_viewScenes[v];
+      viewScene            = m_sceneUbo;
+
+      glm::mat4 viewOffset      = glm::translate(glm::mat4(1.0f), vec3(-separation * float(v), 0.0f, 0.0f)) * view;
+      viewScene.viewProjMatrix  = projection * viewOffset;
+      viewScene.viewMatrix      = viewOffset;
+      viewScene.viewMatrixIT    = glm::transpose(glm::inverse(viewOffset));
+      viewScene.viewProjMatrixI = glm::inverse(viewScene.viewProjMatrix);
+      viewScene.hizSize.w       = 0.0f;
+      Frustum::init((float(*)[4]) & viewScene.frustum[0].x, glm::value_ptr(viewScene.viewProjMatrix));
+
+      glNamedBufferSubData(buffers.scene_ubo, snapsize(sizeof(SceneData), 256) * v, sizeof(SceneData), &viewScene);
+    }
+    if(views > 1)
+    {
+      m_viewScenes[0] = m_sceneUbo;
+      for(int v = 0; v < views; v++)
+      {
+        m_viewData[v].viewProjMatrix = m_viewScenes[v].viewProjMatrix;
+        memcpy(m_viewData[v].frustum, m_viewScenes[v].frustum, sizeof(m_viewData[v].frustum));
+      }
+      glNamedBufferSubData(buffers.views_ubo, 0, sizeof(ViewData) * views, m_viewData);
+    }
   }
 
   glPolygonMode(GL_FRONT_AND_BACK, m_tweak.wireframe ? GL_LINE : GL_FILL);
 
-  if(m_tweak.uselod)
+  if(m_tweak.uselod && m_tweak.views > 1)
+  {
+    drawLodViews();
+  }
+  else if(m_tweak.uselod)
   {
     drawLod();
   }
@@ -812,16 +3471,25 @@ void Sample::think(double time)
 
     bool useTess = m_tweak.nolodtess;
 
-    glUseProgram(m_progManager.get(useTess ? programs.draw_sphere_tess : programs.draw_sphere));
+    glUseProgram(useTess ? programs.draw_sphere_tess : programs.draw_sphere);
     glPatchParameteri(GL_PATCH_VERTICES, 3);
 
-    glBindVertexBuffer(0, buffers.sphere_vbo, 0, sizeof(vec4));
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.sphere_ibo);
+    int mesh      = useTess ? BATCH_TESS : BATCH_ICOSPHERE;
+    int batchSize = m_tweak.batchSizes[mesh];
+
+    glBindVertexBuffer(0, buffers.sphere_vbo[mesh], 0, sizeof(vec4));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.sphere_ibo[mesh]);
 
     glEnableVertexAttribArray(VERTEX_POS);
+    glUniform1i(UNI_BATCH_SIZE, batchSize);
+    if(!useTess)
+    {
+      glUniform1i(UNI_MESH_VERTICES, PARTICLE_BASICVERTICES);
+    }
 
-    int fullCnt = m_tweak.particleCount / PARTICLE_BATCHSIZE;
-    int restCnt = m_tweak.particleCount % PARTICLE_BATCHSIZE;
+    // the slots were compacted this frame, the active range has no holes
+    int fullCnt = getActiveCount() / batchSize;
+    int restCnt = getActiveCount() % batchSize;
 
     GLenum prim = useTess ? GL_PATCHES : GL_TRIANGLES;
     GLenum itemFormat;
@@ -839,20 +3507,24 @@ void Sample::think(double time)
     }
     else
     {
-      itemFormat = GL_RGBA32F;
-      itemSize   = sizeof(Particle);
+      itemFormat = getParticleTextureFormat(m_tweak.particleFormat);
+      itemSize   = int(getParticleStride(m_tweak.particleFormat));
       itemBuffer = buffers.particles;
 
       nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLES, GL_TEXTURE_BUFFER, textures.lodparticles);
       nvgl::bindMultiTexture(GL_TEXTURE0 + TEX_PARTICLEINDICES, GL_TEXTURE_BUFFER, 0);
     }
 
-    glTextureBuffer(textures.lodparticles, itemFormat, itemBuffer);
-    glDrawElementsInstanced(prim, PARTICLE_BATCHSIZE * PARTICLE_BASICINDICES, GL_UNSIGNED_INT, 0, fullCnt);
+    // the buffers may hold more than the active particles
+    if(fullCnt)
+    {
+      glTextureBufferRange(textures.lodparticles, itemFormat, itemBuffer, 0, itemSize * fullCnt * batchSize);
+      glDrawElementsInstanced(prim, batchSize * PARTICLE_BASICINDICES, GL_UNSIGNED_INT, 0, fullCnt);
+    }
 
     if(restCnt)
     {
-      glTextureBufferRange(textures.lodparticles, itemFormat, itemBuffer, itemSize * fullCnt * PARTICLE_BATCHSIZE, restCnt * itemSize);
+      glTextureBufferRange(textures.lodparticles, itemFormat, itemBuffer, itemSize * fullCnt * batchSize, restCnt * itemSize);
       glDrawElementsInstanced(prim, restCnt * PARTICLE_BASICINDICES, GL_UNSIGNED_INT, 0, 1);
     }
 
@@ -867,6 +3539,30 @@ void Sample::think(double time)
 
   glBindBufferBase(GL_UNIFORM_BUFFER, UBO_SCENE, 0);
 
+  if(m_validatePending)
+  {
+    endValidateStep();
+  }
+
+  if(m_tweak.occlusion)
+  {
+    // used by the next frame's classification
+    buildHiz(width, height);
+    m_hizViewProj = m_sceneUbo.viewProjMatrix;
+    m_hizEyePos   = vec4(glm::inverse(m_sceneUbo.viewMatrix)[3]);
+    m_hizValid    = true;
+  }
+  else
+  {
+    m_hizValid = false;
+  }
+
+  if(useFbo && !m_offscreen)
+  {
+    glBlitNamedFramebuffer(framebuffers.scene, 0, 0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
   {
     NV_PROFILE_GL_SECTION("GUI");
     ImGui::Render();
@@ -875,10 +3571,18 @@ void Sample::think(double time)
 
   ImGui::EndFrame();
 
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
   m_lastTweak = m_tweak;
 }
 
-void Sample::resize(int width, int height) {}
+void Sample::resize(int width, int height)
+{
+  if(framebuffers.scene)
+  {
+    initFramebuffers(width, height);
+  }
+}
 
 }  // namespace dynlod
 
@@ -889,5 +3593,6 @@ int main(int argc, const char** argv)
   NVPSystem system(PROJECT_NAME);
 
   Sample sample;
-  return sample.run(PROJECT_NAME, argc, argv, SAMPLE_SIZE_WIDTH, SAMPLE_SIZE_HEIGHT);
+  int    result = sample.run(PROJECT_NAME, argc, argv, SAMPLE_SIZE_WIDTH, SAMPLE_SIZE_HEIGHT);
+  return result ? result : sample.getValidateErrors() ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#version 430
+/**/
+
+#extension GL_ARB_shading_language_include : enable
+#include "common.h"
+
+// builds the depth pyramid for occlusion culling, every level stores the
+// maximum depth of the texels it covers in the level below.
+// HIZ_COPY: level 0 from the scene's depth buffer
+
+layout(local_size_x=16, local_size_y=16) in;
+
+layout(location=UNI_HIZ_LEVEL) uniform int srcLevel;
+
+layout(binding=0)       uniform sampler2D texSrc;
+layout(binding=0,r32f)  uniform writeonly image2D imgDst;
+
+void main()
+{
+  ivec2 dst     = ivec2(gl_GlobalInvocationID.xy);
+  ivec2 dstSize = imageSize(imgDst);
+  if (any(greaterThanEqual(dst, dstSize))) return;
+  
+#if HIZ_COPY
+  float depth = texelFetch(texSrc, dst, 0).r;
+#else
+  // the last row/column also covers the odd remainder of the level below
+  ivec2 srcSize = textureSize(texSrc, srcLevel);
+  ivec2 first   = dst * 2;
+  ivec2 last    = min(first + 1 + ivec2(equal(dst, dstSize - 1)) * (srcSize & 1), srcSize - 1);
+  
+  float depth = 0;
+  for (int y = first.y; y <= last.y; y++) {
+    for (int x = first.x; x <= last.x; x++) {
+      depth = max(depth, texelFetch(texSrc, ivec2(x, y), srcLevel).r);
+    }
+  }
+#endif
+
+  imageStore(imgDst, dst, vec4(depth));
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#version 430
+/**/
+
+#extension GL_ARB_shading_language_include : enable
+#include "common.h"
+
+// Coarse front-to-back order of a job's lists above level 0, so early
+// depth testing rejects more of the mesh and tessellated fragments.
+// A counting sort by depth bin, lists are sorted via the scratch lists:
+// BIN_PASS 0 histogram, 1 bin offsets, 2 scatter to scratch, 3 copy back.
+// Workgroup y is the level - 1, x loops over the level's list.
+
+layout(local_size_x=LODBIN_WORKGROUP_SIZE) in;
+
+layout(location=UNI_BIN_LIST_STRIDE)    uniform uint listStride;
+layout(location=UNI_BIN_SCRATCH_STRIDE) uniform uint scratchStride;
+// x: log2 of the nearest depth, y: bins per octave
+layout(location=UNI_BIN_RANGE)          uniform vec2 binRange;
+
+layout(binding=TEX_PARTICLES) uniform ParticleSampler texParticles;
+
+layout(binding=SSBO_DATA_INDIRECTS,std430) readonly buffer indirectsBuffer {
+  DrawIndirects cmd;
+};
+
+// counts are reset by the offset pass for the next job
+layout(binding=SSBO_DATA_BINS,std430) buffer binsBuffer {
+  uint binCnt[LOD_MAX_LEVELS * LOD_DEPTH_BINS];
+  uint binOffset[LOD_MAX_LEVELS * LOD_DEPTH_BINS];
+};
+
+#if USE_INDICES
+#define ListItem int
+#else
+#define ListItem ParticleData
+#endif
+
+layout(binding=SSBO_DATA_LISTS,std430) buffer listsBuffer {
+  ListItem lists[];
+};
+
+layout(binding=SSBO_DATA_SCRATCH,std430) buffer scratchBuffer {
+  ListItem scratch[];
+};
+
+uint levelCount(uint level)
+{
+  return level < scene.lodLevels ? cmd.counters.levelCnt[level / 4][level % 4] : 0u;
+}
+
+int depthBin(ListItem item)
+{
+  vec4 posSize;
+  vec4 color;
+#if USE_INDICES
+  decodeParticle(fetchParticle(texParticles, item), posSize, color);
+#else
+  decodeParticle(item, posSize, color);
+#endif
+  float w = (scene.viewProjMatrix * vec4(posSize.xyz, 1)).w;
+  return clamp(int((log2(max(w, 1e-6)) - binRange.x) * binRange.y), 0, LOD_DEPTH_BINS - 1);
+}
+
+#if BIN_PASS == 0
+shared uint s_binCnt[LOD_DEPTH_BINS];
+#endif
+
+void main()
+{
+  uint level  = gl_WorkGroupID.y + 1;
+  uint count  = levelCount(level);
+  uint stride = gl_NumWorkGroups.x * LODBIN_WORKGROUP_SIZE;
+  uint bins   = level * LOD_DEPTH_BINS;
+
+#if BIN_PASS == 0
+  if (gl_LocalInvocationID.x < LOD_DEPTH_BINS) {
+    s_binCnt[gl_LocalInvocationID.x] = 0;
+  }
+  barrier();
+  
+  for (uint i = gl_GlobalInvocationID.x; i < count; i += stride) {
+    atomicAdd(s_binCnt[depthBin(lists[level * listStride + i])], 1u);
+  }
+  barrier();
+  
+  if (gl_LocalInvocationID.x < LOD_DEPTH_BINS && s_binCnt[gl_LocalInvocationID.x] != 0) {
+    atomicAdd(binCnt[bins + gl_LocalInvocationID.x], s_binCnt[gl_LocalInvocationID.x]);
+  }
+#elif BIN_PASS == 1
+  // dispatched with a single workgroup in x
+  if (gl_LocalInvocationID.x == 0) {
+    uint offset = 0;
+    for (int b = 0; b < LOD_DEPTH_BINS; b++) {
+      binOffset[bins + b] = offset;
+      offset += binCnt[bins + b];
+      binCnt[bins + b] = 0;
+    }
+  }
+#elif BIN_PASS == 2
+  // within a bin the order is arbitrary
+  for (uint i = gl_GlobalInvocationID.x; i < count; i += stride) {
+    ListItem item = lists[level * listStride + i];
+    uint     slot = atomicAdd(binOffset[bins + depthBin(item)], 1u);
+    scratch[(level - 1) * scratchStride + slot] = item;
+  }
+#else
+  for (uint i = gl_GlobalInvocationID.x; i < count; i += stride) {
+    lists[level * listStride + i] = scratch[(level - 1) * scratchStride + i];
+  }
+#endif
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "lodbudget.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+namespace dynlod {
+
+double LodCostModel::getTriangles(const uint32_t* levelCounts, const float* levelTriangles, int levels) const
+{
+  double triangles = 0;
+  for(int l = 1; l < levels; l++)
+  {
+    triangles += double(levelCounts[l]) * double(levelTriangles[l]);
+  }
+  return triangles;
+}
+
+double LodCostModel::getMicroseconds(const uint32_t* levelCounts, const float* levelTriangles, int levels) const
+{
+  double nanoseconds = double(levelCounts[0]) * pointNanoseconds;
+  nanoseconds += getTriangles(levelCounts, levelTriangles, levels) * triangleNanoseconds;
+  return frameMicroseconds + nanoseconds / 1000.0;
+}
+
+void LodBudget::reset()
+{
+  m_scale    = 1.0f;
+  m_filtered = 0;
+  m_valid    = false;
+  m_hold     = 0;
+}
+
+bool LodBudget::update(double measured, double target, const Config& config)
+{
+  if(measured <= 0 || target <= 0)
+    return false;
+
+  if(m_hold > 0)
+  {
+    m_hold--;
+    return false;
+  }
+
+  m_filtered = m_valid ? m_filtered + (measured - m_filtered) * config.smoothing : measured;
+  m_valid    = true;
+
+  // the cost falls with larger thresholds, so the scale follows the
+  // ratio of filtered cost to target, in log space to treat over- and
+  // undershooting alike
+  double error = log(m_filtered / target);
+  if(fabs(error) <= log(1.0 + config.deadband))
+    return false;
+
+  double maxStep = log(1.0 + config.maxStep);
+  double step    = std::max(-maxStep, std::min(maxStep, error * config.gain));
+  float  scale   = std::max(config.scaleMin, std::min(config.scaleMax, float(m_scale * exp(step))));
+  if(scale == m_scale)
+    return false;
+
+  m_scale = scale;
+  m_hold  = config.hold;
+  return true;
+}
+
+}  // namespace dynlod
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace dynlod {
+
+// Closed-loop controller for the lod thresholds. All pixel thresholds
+// (and the tessellation pixel size) are multiplied by a common scale,
+// which is adjusted to hold a cost target. Measurements arrive a few
+// frames late, so they are low-pass filtered, small errors are ignored,
+// the change per update is limited and measurements that still predate
+// a change are skipped. Otherwise particles near a threshold would
+// oscillate between levels.
+
+enum BudgetMode
+{
+  BUDGET_OFF,
+  BUDGET_GPUTIME,    // measured gpu frame time
+  BUDGET_TRIANGLES,  // triangles estimated from the per-level counts
+  BUDGET_MODEL,      // synthetic frame time from LodCostModel, cpu only
+  NUM_BUDGET_MODES,
+};
+
+// Synthetic cost of a frame from the per-level counts. Used to run the
+// controller without gpu timers and to estimate the triangle load.
+struct LodCostModel
+{
+  float frameMicroseconds   = 500.0f;
+  float pointNanoseconds    = 1.0f;
+  float triangleNanoseconds = 0.25f;
+
+  // levelTriangles is per particle, level 0 are points
+  double getTriangles(const uint32_t* levelCounts, const float* levelTriangles, int levels) const;
+  double getMicroseconds(const uint32_t* levelCounts, const float* levelTriangles, int levels) const;
+};
+
+class LodBudget
+{
+public:
+  struct Config
+  {
+    float smoothing = 0.5f;   // weight of a new measurement
+    float gain      = 0.3f;   // fraction of the (log) error corrected per update
+    float deadband  = 0.05f;  // relative error that is ignored
+    float maxStep   = 0.1f;   // relative scale change per update
+    int   hold      = 4;      // measurements skipped after a change, they predate it
+    float scaleMin  = 0.25f;
+    float scaleMax  = 64.0f;
+  };
+
+  void reset();
+
+  // feeds a new measurement, returns true if the scale changed
+  bool update(double measured, double target, const Config& config);
+
+  float  getScale() const { return m_scale; }
+  double getFiltered() const { return m_filtered; }
+
+private:
+  float  m_scale    = 1.0f;
+  double m_filtered = 0;
+  bool   m_valid    = false;
+  int    m_hold     = 0;
+};
+
+}  // namespace dynlod
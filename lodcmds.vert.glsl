@@ -33,6 +33,47 @@ layout(binding=SSBO_DATA_INDIRECTS,std430) buffer indirectsBuffer {
   DrawIndirects cmd;
 };
 
+layout(binding=SSBO_DATA_STATS,std430) buffer statsBuffer {
+  LodStats stats;
+};
+
+// incremental classification keeps the lists and their counts, the holes
+// of moved particles are not counted as accepted
+layout(location=UNI_CMDS_KEEP) uniform bool keepCounters;
+
+layout(binding=SSBO_DATA_INCRSTATE,std430) readonly buffer incrStateBuffer {
+  IncrState incr;
+};
+
+#if USE_MULTIDRAW
+// all jobs' commands are packed per level, so each level is drawn with a
+// single multi draw indirect:
+//   level l > 0  [(l-1)*2*jobs, l*2*jobs)  full & rest per job
+//   level 0      [(LOD_MAX_LEVELS-1)*2*jobs, ...) DrawArrays in a DrawElements sized slot
+layout(location=UNI_CMDS_JOB)       uniform uint job;
+layout(location=UNI_CMDS_JOBS)      uniform uint jobs;
+layout(location=UNI_CMDS_LISTBASE)  uniform uint listBase;
+
+layout(binding=SSBO_DATA_MULTIDRAW,std430) buffer multiDrawBuffer {
+  DrawElements multiCmds[];
+};
+
+// the instance id does not include baseInstance, so it is free to encode
+// the start within the lists (accessed via gl_BaseInstanceARB)
+void writeMultiDraw(uint slot, uint batch, DrawElements full, DrawElements rest)
+{
+  full.baseInstance = listBase;
+  rest.baseInstance = listBase + full.instanceCount * batch;
+  multiCmds[slot + job * 2 + 0] = full;
+  multiCmds[slot + job * 2 + 1] = rest;
+}
+#endif
+
+uint levelCount(uint level)
+{
+  return level < scene.lodLevels ? cmd.counters.levelCnt[level / 4][level % 4] : 0u;
+}
+
 void main()
 {
 #if USE_COMPUTE
@@ -40,7 +81,7 @@ void main()
 #endif
 
   {
-    uint cnt = cmd.counters.farCnt;
+    uint cnt = levelCount(0);
     cmd.farArray.count         = cnt;
     cmd.farArray.instanceCount = 1;
     cmd.farArray.first         = 0;
@@ -51,53 +92,75 @@ void main()
     cmd.farIndexed.first         = 0;
     cmd.farIndexed.baseVertex    = 0;
     cmd.farIndexed.baseInstance  = 0;
-    cmd.farIndexed._pad          = uvec2(0);
+    cmd.farIndexed._pad0         = 0;
+    cmd.farIndexed._pad1         = uvec2(0);
   }
   
-  // med and far use a combination of replicated vertices + instancing
-  {
-    uint cnt = cmd.counters.medCnt;
-    uint cntFull = cnt / PARTICLE_BATCHSIZE;
-    uint cntRest = cnt % PARTICLE_BATCHSIZE;
+  // mesh levels and the tessellated level use a combination of
+  // replicated vertices + instancing, unused levels draw nothing
+  uint accepted = levelCount(0);
+  for (uint l = 1; l < LOD_MAX_LEVELS; l++) {
+    uint cnt     = levelCount(l);
+    uint indices = scene.lodTable[l].indices;
+    uint batch   = max(scene.lodTable[l].batch, 1u);
+    uint cntFull = cnt / batch;
+    uint cntRest = cnt % batch;
     
-    cmd.medFull.count          = PARTICLE_BATCHSIZE * PARTICLE_BASICINDICES;
-    cmd.medFull.instanceCount  = cntFull;
-    cmd.medFull.first          = 0;
-    cmd.medFull.baseVertex     = 0;
-    cmd.medFull.baseInstance   = 0;
-    cmd.medFull._pad           = uvec2(0);
+    DrawElements full;
+    full.count          = batch * indices;
+    full.instanceCount  = cntFull;
+    full.first          = 0;
+    full.baseVertex     = 0;
+    full.baseInstance   = 0;
+    full._pad0          = 0;
+    full._pad1          = uvec2(0);
     
-    cmd.medRest.count          = cntRest * PARTICLE_BASICINDICES;
-    cmd.medRest.instanceCount  = 1;
-    cmd.medRest.first          = 0;
-    cmd.medRest.baseVertex     = 0;
-    cmd.medRest.baseInstance   = 0;
-    cmd.medRest._pad           = uvec2(0);
+    DrawElements rest;
+    rest.count          = cntRest * indices;
+    rest.instanceCount  = 1;
+    rest.first          = 0;
+    rest.baseVertex     = 0;
+    rest.baseInstance   = 0;
+    rest._pad0          = 0;
+    rest._pad1          = uvec2(0);
+    
+    cmd.levelFull[l] = full;
+    cmd.levelRest[l] = rest;
+    
+#if USE_MULTIDRAW
+    writeMultiDraw((l - 1) * jobs * 2, batch, full, rest);
+#endif
+    accepted += cnt;
   }
 
+#if USE_MULTIDRAW
   {
-    uint cnt = cmd.counters.nearCnt;
-    uint cntFull = cnt / PARTICLE_BATCHSIZE;
-    uint cntRest = cnt % PARTICLE_BATCHSIZE;
-    
-    cmd.nearFull.count         = PARTICLE_BATCHSIZE * PARTICLE_BASICINDICES;
-    cmd.nearFull.instanceCount = cntFull;
-    cmd.nearFull.first          = 0;
-    cmd.nearFull.baseVertex     = 0;
-    cmd.nearFull.baseInstance   = 0;
-    cmd.nearFull._pad           = uvec2(0);
-    
-    cmd.nearRest.count         = cntRest * PARTICLE_BASICINDICES;
-    cmd.nearRest.instanceCount = 1;
-    cmd.nearRest.first          = 0;
-    cmd.nearRest.baseVertex     = 0;
-    cmd.nearRest.baseInstance   = 0;
-    cmd.nearRest._pad           = uvec2(0);
+    // matches DrawArrays: count, instanceCount, first, baseInstance
+    DrawElements farCmd;
+    farCmd.count         = cmd.farArray.count;
+    farCmd.instanceCount = 1;
+    farCmd.first         = listBase;
+    farCmd.baseVertex    = 0;
+    farCmd.baseInstance  = 0;
+    farCmd._pad0         = 0;
+    farCmd._pad1         = uvec2(0);
+    multiCmds[(LOD_MAX_LEVELS - 1) * jobs * 2 + job] = farCmd;
+  }
+#endif
+
+  for (int i = 0; i < LOD_MAX_LEVELS / 4; i++) {
+    uvec4 holes = keepCounters ? incr.holes[i] : uvec4(0);
+    accepted -= holes.x + holes.y + holes.z + holes.w;
+    stats.levelCnt[i] += cmd.counters.levelCnt[i] - holes;
   }
+  stats.accepted += accepted;
+  stats.occluded += cmd.counters.occludedCnt;
 
-  cmd.counters.farCnt  = 0;
-  cmd.counters.medCnt  = 0;
-  cmd.counters.nearCnt = 0;
-  cmd.counters._pad    = 0;
+  if (!keepCounters) {
+    for (int i = 0; i < LOD_MAX_LEVELS / 4; i++) {
+      cmd.counters.levelCnt[i] = uvec4(0);
+    }
+    cmd.counters.occludedCnt  = 0;
+  }
   
 }
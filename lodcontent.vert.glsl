@@ -23,140 +23,809 @@
 /**/
 
 #extension GL_ARB_shading_language_include : enable
+#if !USE_COMPUTE
+#define USE_PARTICLE_ATTRIBS 1
+#endif
+#define USE_LIVENESS 1
 #include "common.h"
 
+// besides the bands of common.h
+#define CLUSTER_PARTIAL -2
+
+// APPEND_MODE (compute only)
+// 0 one atomic per particle
+// 1 workgroup prefix sum, one atomic per list per workgroup
+// 2 ordered: ORDERED_PASS 0 counts per workgroup, lodscan turns counts
+//   into offsets, ORDERED_PASS 1 writes, lists match serial order
+#ifndef APPEND_MODE
+#define APPEND_MODE 0
+#endif
+
+// USE_INCREMENTAL (clusters only)
+// 1 cached results are appended again every frame
+// 2 the lists are kept, INCR_PASS 0 decides whether they are rebuilt,
+//   1 collects the clusters whose margin is used up and 2 moves their
+//   particles to new ranges of the lists, see Sample::keepsIncrementalLists
+
+#define CONTENT_WORKGROUP_SIZE 512
+
 layout(location=UNI_CONTENT_IDX_OFFSET) uniform int idxOffset;
+// only set while the active range has holes of removed particles
+layout(location=UNI_CONTENT_LIVENESS)   uniform bool useLiveness;
 
-#if USE_COMPUTE
+bool skipParticle(int idx)
+{
+  return useLiveness && !isParticleLive(idx);
+}
 
-layout(local_size_x=512) in;
+#if USE_COMPUTE
 
-int IDX = int(gl_GlobalInvocationID.x) + idxOffset;
+#if USE_CLUSTERS
+// one workgroup per cluster
+layout(local_size_x=PARTICLE_CLUSTERSIZE) in;
+#else
+layout(local_size_x=CONTENT_WORKGROUP_SIZE) in;
+#endif
 
 layout(location=UNI_CONTENT_IDX_MAX)  uniform int idxMax;
-layout(binding=TEX_PARTICLES) uniform samplerBuffer texParticles;
+layout(binding=TEX_PARTICLES) uniform ParticleSampler texParticles;
 
-#if USE_COMPACT_PARTICLE
-  vec4 inPosColor = texelFetch(texParticles, IDX);
-  vec4 inPosSize  = vec4(inPosColor.xyz, scene.particleSize);
-  vec4 inColor    = unpackUnorm4x8(floatBitsToUint(inPosColor.w));
-#else
-  vec4 inPosSize  = texelFetch(texParticles, IDX*2 + 0);
-  vec4 inColor    = texelFetch(texParticles, IDX*2 + 1);
+int           IDX;
+ParticleData  inParticle;
+vec4          inPosSize;
+vec4          inColor;
+
+#if !USE_CLUSTERS
+// simulation, particles are updated in place while being classified,
+// disabled with simStep 0 (also for the second ordered pass)
+
+layout(location=UNI_CONTENT_SIM_STEP) uniform float simStep;
+
+layout(binding=SSBO_DATA_PARTICLES,std430) buffer particlesBuffer {
+  ParticleData particles[];
+};
+
+layout(binding=SSBO_DATA_VELOCITIES,std430) buffer velocitiesBuffer {
+  vec4 velocities[];
+};
+
+// must match simulateParticle in particlesim.cpp
+void simulateParticle()
+{
+  vec3  boxMin  = scene.particleBoxMin.xyz;
+  vec3  boxMax  = scene.particleBoxMin.xyz + scene.particleBoxScale.xyz * 65535.0;
+  
+  vec3  vel     = velocities[IDX].xyz;
+  vel.y        -= float(SIM_GRAVITY) * simStep;
+  vec3  pos     = inPosSize.xyz + vel * simStep;
+  
+  bvec3 outside = bvec3(uvec3(lessThan(pos, boxMin)) | uvec3(greaterThan(pos, boxMax)));
+  vel           = mix(vel, -vel * float(SIM_RESTITUTION), outside);
+  pos           = clamp(pos, boxMin, boxMax);
+  
+  // classify what is stored
+  inParticle    = encodeParticle(vec4(pos, inPosSize.w), inColor);
+  decodeParticle(inParticle, inPosSize, inColor);
+  
+  particles[IDX]      = inParticle;
+  velocities[IDX].xyz = vel;
+}
+#endif
+
+void loadParticle(int idx)
+{
+  IDX        = idx;
+  inParticle = fetchParticle(texParticles, IDX);
+  decodeParticle(inParticle, inPosSize, inColor);
+#if !USE_CLUSTERS
+  if (simStep > 0.0) {
+    simulateParticle();
+  }
 #endif
+}
 
 #else
 
-int IDX = gl_VertexID + idxOffset;
+int           IDX;
+ParticleData  inParticle;
+vec4          inPosSize;
+vec4          inColor;
 
-in layout(location=VERTEX_POS)    vec4 inPosSize;
-in layout(location=VERTEX_COLOR)  vec4 inColor;
+void loadParticle()
+{
+  IDX        = gl_VertexID + idxOffset;
+  inParticle = loadParticleAttribs();
+  decodeParticle(inParticle, inPosSize, inColor);
+}
+
+#endif
+
+
+#if USE_CLUSTERS || APPEND_MODE != 0
+
+// bulk appends need atomicAdd, hence the counters are accessed as SSBO,
+// same layout as DrawCounters
+layout(binding=SSBO_DATA_COUNTS,std430) buffer countsBuffer {
+  uint  levelCnt[LOD_MAX_LEVELS];
+  uint  occludedCnt;
+} counters;
+
+uint appendSlot(int band, uint cnt)
+{
+  return atomicAdd(counters.levelCnt[band], cnt);
+}
+
+#else
 
-#if USE_COMPACT_PARTICLE
-vec4 inPosColor = vec4(inPosSize.xyz, uintBitsToFloat(packUnorm4x8(inColor)));
+layout(binding=ABO_DATA_COUNTS,offset=0)  uniform atomic_uint counterLevels[LOD_MAX_LEVELS];
+#if LOD_MAX_LEVELS == 8
+layout(binding=ABO_DATA_COUNTS,offset=32) uniform atomic_uint counterOccluded;
+#else
+layout(binding=ABO_DATA_COUNTS,offset=16) uniform atomic_uint counterOccluded;
 #endif
 
+uint appendSlot(int band, uint cnt)
+{
+  // atomic counter arrays only allow dynamically uniform indexing
+  switch (band) {
+  case 0:   return atomicCounterIncrement(counterLevels[0]);
+  case 1:   return atomicCounterIncrement(counterLevels[1]);
+  case 2:   return atomicCounterIncrement(counterLevels[2]);
+  case 3:   return atomicCounterIncrement(counterLevels[3]);
+#if LOD_MAX_LEVELS == 8
+  case 4:   return atomicCounterIncrement(counterLevels[4]);
+  case 5:   return atomicCounterIncrement(counterLevels[5]);
+  case 6:   return atomicCounterIncrement(counterLevels[6]);
+  case 7:   return atomicCounterIncrement(counterLevels[7]);
 #endif
+  }
+  return 0u;
+}
 
+#endif
 
-layout(binding=ABO_DATA_COUNTS,offset=0)  uniform atomic_uint counterFar;
-layout(binding=ABO_DATA_COUNTS,offset=4)  uniform atomic_uint counterMed;
-layout(binding=ABO_DATA_COUNTS,offset=8)  uniform atomic_uint counterNear;
+// the lists of all levels share one buffer, listStride items apart
+layout(location=UNI_CONTENT_LIST_STRIDE) uniform uint listStride;
 
 #if USE_INDICES
 
-layout(binding=SSBO_DATA_POINTS,std430) buffer pointsBuffer {
-  int particlesFar[];
+layout(binding=SSBO_DATA_LISTS,std430) buffer listsBuffer {
+  int lists[];
 };
 
-layout(binding=SSBO_DATA_BASIC,std430) buffer basicBuffer {
-  int particlesMed[];
-};
+void storeParticle(int band, uint slot)
+{
+  lists[uint(band) * listStride + slot] = IDX;
+}
 
-layout(binding=SSBO_DATA_TESS,std430) buffer tessBuffer {
-  int particlesNear[];
-};
+void invalidateParticle(int band, uint slot)
+{
+  lists[uint(band) * listStride + slot] = PARTICLE_INVALID;
+}
 
 #else
 
-layout(binding=SSBO_DATA_POINTS,std430) buffer pointsBuffer {
-  Particle particlesFar[];
-};
+// lists store the particles in their original format
 
-layout(binding=SSBO_DATA_BASIC,std430) buffer basicBuffer {
-  Particle particlesMed[];
+layout(binding=SSBO_DATA_LISTS,std430) buffer listsBuffer {
+  ParticleData lists[];
 };
 
-layout(binding=SSBO_DATA_TESS,std430) buffer tessBuffer {
-  Particle particlesNear[];
-};
+void storeParticle(int band, uint slot)
+{
+  lists[uint(band) * listStride + slot] = inParticle;
+}
+
+// kept lists are only used with indices
+void invalidateParticle(int band, uint slot)
+{
+}
 
 #endif
 
-void main()
+#if USE_INCREMENTAL
+// smallest change of the plane distances or hPos.w that can alter the result
+float particleMargin(vec3 pos, float size)
 {
-#if USE_COMPUTE
-  if (IDX >= idxMax) return;
+  float margin = 1e38;
+  for (int i = 0; i < 6; i++){
+    margin = min(margin, abs(dot(scene.frustum[i],vec4(pos,1)) + size));
+  }
+  
+  float w          = (scene.viewProjMatrix * vec4(pos,1)).w;
+  float pixelScale = dot(scene.viewpixelsize, vec2(1.0));
+  margin = min(margin, abs(w));
+  for (int l = 1; l < int(scene.lodLevels); l++){
+    margin = min(margin, abs(w - size * pixelScale / scene.lodTable[l].pixels));
+  }
+  return margin;
+}
 #endif
 
-  vec3  pos  = inPosSize.xyz;
-#if USE_COMPACT_PARTICLE
-  float size = scene.particleSize;
+int classifyParticle(vec3 pos, float size)
+{
+  return classifyParticleView(scene.frustum, scene.viewProjMatrix, pos, size);
+}
+
+#if !USE_CLUSTERS
+// occlusion culling, the sphere's nearest point is tested against the
+// maximum depth of the previous frame's depth pyramid
+
+layout(binding=TEX_HIZ) uniform sampler2D texHiz;
+
+bool occludedParticle(vec3 pos, float size)
+{
+  if (scene.hizSize.w == 0.0) return false;
+  
+  vec3  toEye   = scene.hizEyePos.xyz - pos;
+  float dist    = length(toEye);
+  if (dist <= size) return false;
+  
+  vec4  hNear   = scene.hizViewProjMatrix * vec4(pos + toEye * (size / dist), 1);
+  vec4  hCenter = scene.hizViewProjMatrix * vec4(pos, 1);
+  if (hNear.w <= 0.0) return false;
+  
+  // conservative screen rectangle, the radius uses the nearest w
+  vec2  center  = (hCenter.xy / hCenter.w * 0.5 + 0.5) * scene.hizSize.xy;
+  vec2  radius  = size * scene.viewpixelsize / hNear.w;
+  vec4  rect    = vec4(center - radius, center + radius);
+  if (any(lessThan(rect.zw, vec2(0))) || any(greaterThanEqual(rect.xy, scene.hizSize.xy))) return false;
+  rect          = clamp(rect, vec4(0), scene.hizSize.xyxy - 1.0);
+  
+  // level at which the rectangle spans at most 2x2 texels
+  float extent  = max(rect.z - rect.x, rect.w - rect.y);
+  int   level   = int(ceil(log2(max(extent, 1.0))));
+  if (level >= int(scene.hizSize.z)) return false;
+  
+  ivec4 texels  = ivec4(rect) >> level;
+  float depth   = max(max(texelFetch(texHiz, texels.xy, level).r, texelFetch(texHiz, texels.zy, level).r),
+                      max(texelFetch(texHiz, texels.xw, level).r, texelFetch(texHiz, texels.zw, level).r));
+  
+  // default depth range, window depth = ndc * 0.5 + 0.5
+  return (hNear.z / hNear.w) * 0.5 + 0.5 > depth;
+}
+
+void countOccluded()
+{
+#if APPEND_MODE == 2 && ORDERED_PASS == 1
+  // counted by the first pass
+#elif APPEND_MODE != 0
+  atomicAdd(counters.occludedCnt, 1u);
+#else
+  atomicCounterIncrement(counterOccluded);
+#endif
+}
+
+int classifyVisible(vec3 pos, float size)
+{
+  int band = classifyParticle(pos, size);
+  if (band != BAND_CULLED && occludedParticle(pos, size)) {
+    countOccluded();
+    band = BAND_CULLED;
+  }
+  return band;
+}
 #else
+// clusters are classified as a whole, without occlusion culling
+int classifyVisible(vec3 pos, float size)
+{
+  return classifyParticle(pos, size);
+}
+#endif
+
+void processParticle()
+{
+  vec3  pos  = inPosSize.xyz;
   float size = inPosSize.w;
+
+  int band = classifyVisible(pos, size);
+  if (band == BAND_CULLED) return;
+  
+  storeParticle(band, appendSlot(band, 1));
+}
+
+#if USE_CLUSTERS
+
+layout(location=UNI_CONTENT_CLUSTER_OFFSET) uniform int clusterOffset;
+
+layout(binding=SSBO_DATA_CLUSTERS,std430) readonly buffer clustersBuffer {
+  Cluster clusters[];
+};
+
+shared int  s_clusterBand;
+shared uint s_clusterSlot;
+
+#if USE_INCREMENTAL
+
+layout(location=UNI_CONTENT_INCR_RESET) uniform bool incrReset;
+// change of the 6 frustum planes and the w row of viewProjMatrix since the
+// previous classification
+layout(location=UNI_CONTENT_INCR_DELTA) uniform vec4 incrDelta[7];
+// relative change of the lod thresholds (lodTable pixels)
+layout(location=UNI_CONTENT_INCR_SCALE) uniform float incrScale;
+
+layout(binding=SSBO_DATA_CLUSTERCACHE,std430) buffer clusterCacheBuffer {
+  ClusterCache caches[];
+};
+
+#if USE_INCREMENTAL == 2
+// same layout as IncrState, scalars for atomics
+layout(binding=SSBO_DATA_INCRSTATE,std430) buffer incrStateBuffer {
+  uvec4 dispatch;
+  uint  holes[LOD_MAX_LEVELS];
+  uint  reset;
+  uint  _pad0;
+  uvec2 _pad1;
+  uint  dirtyClusters[];
+} incr;
 #endif
+
+shared bool s_clusterCached;
+shared uint s_clusterMargin;
+shared uint s_clusterBits[PARTICLE_CLUSTERSIZE / 8];
+
+// upper bound of how much the plane distances and hPos.w of any point
+// within the cluster's sphere changed
+float clusterDelta(Cluster cluster)
+{
+  float delta = 0;
+  for (int i = 0; i < 7; i++){
+    vec4 d = incrDelta[i];
+    delta  = max(delta, abs(dot(d.xyz, cluster.bounds.xyz) + d.w) + length(d.xyz) * cluster.bounds.w);
+  }
+  return delta;
+}
+
+// compensate rounding of the plane and w evaluations
+float clusterEpsilon(Cluster cluster)
+{
+  return 1e-4 * (1.0 + length(cluster.bounds.xyz) + cluster.bounds.w);
+}
+
+// margin left after this frame's change. Thresholds scaled by at most
+// 1 +- incrScale move by at most incrScale * (margin + hPos.w), which
+// keeps small changes of the lod table (budget controller) cached.
+float cachedMargin(uint cid, Cluster cluster)
+{
+  float margin = caches[cid].margin - clusterDelta(cluster);
+  if (incrScale > 0.0) {
+    vec3  wRow = vec3(scene.viewProjMatrix[0].w, scene.viewProjMatrix[1].w, scene.viewProjMatrix[2].w);
+    float wMax = (scene.viewProjMatrix * vec4(cluster.bounds.xyz,1)).w + cluster.bounds.w * length(wRow);
+    margin     = margin * (1.0 - incrScale) - incrScale * max(wMax, 0.0);
+  }
+  return margin;
+}
+
+#endif
+
+// conservative test of all particles within the cluster, returns
+// CLUSTER_PARTIAL if they may end up in different bands.
+// margin is only meaningful for non-partial results.
+int classifyCluster(Cluster cluster, out float margin)
+{
+  vec3  center = cluster.bounds.xyz;
+  float radius = cluster.bounds.w;
+  bool  inside = true;
+  
+  margin = 1e38;
   
   for (int i = 0; i < 6; i++){
-    if (dot(scene.frustum[i],vec4(pos,1)) < -size){
-      return;
+    float dist = dot(scene.frustum[i],vec4(center,1));
+    if (dist + radius < -cluster.sizeMax){
+      margin = -(dist + radius + cluster.sizeMax);
+      return BAND_CULLED;
     }
+    if (dist - radius < -cluster.sizeMin){
+      inside = false;
+    }
+    margin = min(margin, dist - radius + cluster.sizeMin);
   }
+  if (!inside) return CLUSTER_PARTIAL;
   
-  vec4 hPos = scene.viewProjMatrix * vec4(inPosSize.xyz,1);
-  vec2 pixelsize = 2.0 * size * scene.viewpixelsize / hPos.w;
+  // hPos.w varies at most by radius * length(wRow) within the sphere
+  vec3  wRow    = vec3(scene.viewProjMatrix[0].w, scene.viewProjMatrix[1].w, scene.viewProjMatrix[2].w);
+  float wCenter = (scene.viewProjMatrix * vec4(center,1)).w;
+  float wRange  = radius * length(wRow);
+  float wMin    = wCenter - wRange;
+  float wMax    = wCenter + wRange;
+  if (wMin <= 0.0) return CLUSTER_PARTIAL;
   
-  float coverage = dot(pixelsize,vec2(0.5));
+  // coverage = size * (viewpixelsize.x + viewpixelsize.y) / hPos.w
+  float pixelScale  = dot(scene.viewpixelsize, vec2(1.0));
+  float coverageMin = cluster.sizeMin * pixelScale / wMax;
+  float coverageMax = cluster.sizeMax * pixelScale / wMin;
   
-#if USE_INDICES
-  if (coverage > scene.nearPixels) {
-    uint slot = atomicCounterIncrement(counterNear);
-    particlesNear[slot] = IDX;
+  margin = min(margin, wMin);
+  
+  int band = classifyCoverage(coverageMin);
+  if (band != classifyCoverage(coverageMax)) return CLUSTER_PARTIAL;
+  
+  // w distances to the thresholds of the band
+  if (band > BAND_FAR) {
+    margin = min(margin, cluster.sizeMin * pixelScale / scene.lodTable[band].pixels - wMax);
   }
-  else if (coverage < scene.farPixels) {
-    uint slot = atomicCounterIncrement(counterFar);
-    particlesFar[slot] = IDX;
+  if (band + 1 < int(scene.lodLevels)) {
+    margin = min(margin, wMin - cluster.sizeMax * pixelScale / scene.lodTable[band + 1].pixels);
   }
-  else {
-    uint slot = atomicCounterIncrement(counterMed);
-    particlesMed[slot] = IDX;
+  return band;
+}
+
+void processCluster()
+{
+  uint    cid      = gl_WorkGroupID.x + clusterOffset;
+  Cluster cluster  = clusters[cid];
+  uint    lid      = gl_LocalInvocationID.x;
+  // clusters crossing job boundaries are tested per particle
+  bool    crossing = int(cluster.first) < idxOffset || int(cluster.first + cluster.count) > idxMax;
+  
+  if (lid == 0) {
+    float margin;
+    int   band;
+#if USE_INCREMENTAL
+    // reuse the previous result while the accumulated change stays below the margin
+    bool cached = false;
+    if (!incrReset && !crossing) {
+      margin = cachedMargin(cid, cluster);
+      cached = margin > 0;
+      caches[cid].margin = margin;
+    }
+    
+    if (cached) {
+      band = caches[cid].band;
+    }
+    else {
+      band = classifyCluster(cluster, margin);
+      if (!crossing) {
+        caches[cid].band   = band;
+        caches[cid].margin = margin - clusterEpsilon(cluster);
+      }
+    }
+    s_clusterCached = cached;
+    s_clusterMargin = floatBitsToUint(1e38);
+#else
+    band = classifyCluster(cluster, margin);
+#endif
+    if (band >= 0 && crossing) {
+      band = CLUSTER_PARTIAL;
+    }
+    s_clusterBand = band;
+    if (band >= 0) {
+      s_clusterSlot = appendSlot(band, cluster.count);
+    }
   }
+#if USE_INCREMENTAL
+  if (lid < PARTICLE_CLUSTERSIZE / 8) {
+    s_clusterBits[lid] = 0;
+  }
+#endif
+  
+  memoryBarrierShared();
+  barrier();
+  
+  int  band   = s_clusterBand;
+  int  idx    = int(cluster.first + lid);
+  bool active = lid < cluster.count && idx >= idxOffset && idx < idxMax;
+  if (band == BAND_CULLED) return;
+  
+  if (band == CLUSTER_PARTIAL) {
+#if USE_INCREMENTAL
+    if (s_clusterCached) {
+      if (!active) return;
+      
+      int particleBand = int((caches[cid].bands[lid / 8] >> (4 * (lid % 8))) & 15u) - 1;
+      if (particleBand == BAND_CULLED) return;
+#if USE_INDICES
+      IDX = idx;
 #else
-  if (coverage > scene.nearPixels) {
-    uint slot = atomicCounterIncrement(counterNear);
-#if USE_COMPACT_PARTICLE
-    particlesNear[slot].posColor = inPosColor;
+      loadParticle(idx);
+#endif
+      storeParticle(particleBand, appendSlot(particleBand, 1));
+      return;
+    }
+    
+    // classify per particle and update the cache
+    if (active) {
+      loadParticle(idx);
+      vec3  pos  = inPosSize.xyz;
+      float size = inPosSize.w;
+      int particleBand = classifyParticle(pos, size);
+      atomicMin(s_clusterMargin, floatBitsToUint(particleMargin(pos, size)));
+      atomicOr(s_clusterBits[lid / 8], uint(particleBand + 1) << (4 * (lid % 8)));
+      if (particleBand != BAND_CULLED) {
+        storeParticle(particleBand, appendSlot(particleBand, 1));
+      }
+    }
+    
+    memoryBarrierShared();
+    barrier();
+    
+    if (!crossing) {
+      if (lid < PARTICLE_CLUSTERSIZE / 8) {
+        caches[cid].bands[lid] = s_clusterBits[lid];
+      }
+      if (lid == 0) {
+        caches[cid].margin = uintBitsToFloat(s_clusterMargin) - clusterEpsilon(cluster);
+      }
+    }
 #else
-    particlesNear[slot].posSize = inPosSize;
-    particlesNear[slot].color   = inColor;
+    if (!active) return;
+    loadParticle(idx);
+    processParticle();
 #endif
   }
-  else if (coverage < scene.farPixels) {
-    uint slot = atomicCounterIncrement(counterFar);
-#if USE_COMPACT_PARTICLE
-    particlesFar[slot].posColor = inPosColor;
+  else {
+    if (!active) return;
+#if USE_INDICES
+    IDX = idx;
 #else
-    particlesFar[slot].posSize = inPosSize;
-    particlesFar[slot].color   = inColor;
+    loadParticle(idx);
 #endif
+    storeParticle(band, s_clusterSlot + lid);
+  }
+}
+
+#if USE_INCREMENTAL == 2
+
+// INCR_PASS 0: the lists are rebuilt on request, or before a list could
+// overflow. Until then the ranges of moved clusters stay as holes.
+void prepareLists()
+{
+  if (gl_GlobalInvocationID.x > 0u) return;
+  
+  bool reset = incrReset;
+  uint cnt   = uint(idxMax - idxOffset);
+  for (int b = 0; b < LOD_MAX_LEVELS; b++) {
+    reset = reset || counters.levelCnt[b] + cnt > listStride;
+  }
+  if (reset) {
+    for (int b = 0; b < LOD_MAX_LEVELS; b++) {
+      counters.levelCnt[b] = 0;
+      incr.holes[b]        = 0;
+    }
+  }
+  incr.reset    = reset ? 1u : 0u;
+  incr.dispatch = uvec4(0, 1, 1, 0);
+}
+
+// INCR_PASS 1: one thread per cluster, collects the clusters that are
+// classified again
+void markClusters()
+{
+  uint cid        = gl_GlobalInvocationID.x + clusterOffset;
+  uint clusterEnd = uint(idxMax + PARTICLE_CLUSTERSIZE - 1) / PARTICLE_CLUSTERSIZE;
+  if (cid >= clusterEnd) return;
+  
+  Cluster cluster  = clusters[cid];
+  bool    crossing = int(cluster.first) < idxOffset || int(cluster.first + cluster.count) > idxMax;
+  bool    dirty    = incr.reset != 0u || crossing;
+  if (!dirty) {
+    float margin = cachedMargin(cid, cluster);
+    caches[cid].margin = margin;
+    dirty = margin <= 0.0;
+  }
+  if (dirty) {
+    incr.dirtyClusters[atomicAdd(incr.dispatch.x, 1u)] = cid;
+  }
+}
+
+shared uint s_listCount[LOD_MAX_LEVELS];
+shared uint s_listStart[LOD_MAX_LEVELS];
+
+uint cachedListCount(uint cid, int band)
+{
+  return (caches[cid].listCounts[band / 4] >> (8 * (band % 4))) & 0xFFu;
+}
+
+// INCR_PASS 2: one workgroup per dirty cluster, the previous entries of
+// its particles become holes and every list gets one new range
+void updateCluster()
+{
+  uint    cid      = incr.dirtyClusters[gl_WorkGroupID.x];
+  Cluster cluster  = clusters[cid];
+  uint    lid      = gl_LocalInvocationID.x;
+  bool    crossing = int(cluster.first) < idxOffset || int(cluster.first + cluster.count) > idxMax;
+  int     idx      = int(cluster.first + lid);
+  bool    active   = lid < cluster.count && idx >= idxOffset && idx < idxMax;
+  
+  // a reset already dropped all entries
+  if (incr.reset == 0u) {
+    for (int b = 0; b < LOD_MAX_LEVELS; b++) {
+      uint count = cachedListCount(cid, b);
+      if (lid < count) {
+        invalidateParticle(b, caches[cid].listStart[b] + lid);
+      }
+      if (lid == 0 && count > 0) {
+        atomicAdd(incr.holes[b], count);
+      }
+    }
+  }
+  
+  if (lid == 0) {
+    float margin;
+    int   band = classifyCluster(cluster, margin);
+    if (band >= 0 && crossing) {
+      band = CLUSTER_PARTIAL;
+    }
+    s_clusterBand   = band;
+    s_clusterMargin = floatBitsToUint(band == CLUSTER_PARTIAL ? 1e38 : margin);
+  }
+  if (lid < LOD_MAX_LEVELS) {
+    s_listCount[lid] = 0;
+  }
+  
+  memoryBarrierShared();
+  barrier();
+  
+  int  band  = s_clusterBand;
+  int  particleBand = BAND_CULLED;
+  uint local = 0;
+  if (active) {
+    particleBand = band;
+    if (band == CLUSTER_PARTIAL) {
+      loadParticle(idx);
+      vec3  pos  = inPosSize.xyz;
+      float size = inPosSize.w;
+      particleBand = classifyParticle(pos, size);
+      atomicMin(s_clusterMargin, floatBitsToUint(particleMargin(pos, size)));
+    }
+    if (particleBand != BAND_CULLED) {
+      local = atomicAdd(s_listCount[particleBand], 1u);
+    }
+  }
+  
+  memoryBarrierShared();
+  barrier();
+  
+  if (lid < LOD_MAX_LEVELS) {
+    uint count       = s_listCount[lid];
+    s_listStart[lid] = count > 0 ? appendSlot(int(lid), count) : 0u;
+    caches[cid].listStart[lid] = s_listStart[lid];
+  }
+  if (lid < LOD_MAX_LEVELS / 4) {
+    caches[cid].listCounts[lid] = s_listCount[lid * 4 + 0] | (s_listCount[lid * 4 + 1] << 8)
+                                | (s_listCount[lid * 4 + 2] << 16) | (s_listCount[lid * 4 + 3] << 24);
+  }
+  if (lid == 0) {
+    // clusters crossing the particle range are always classified again
+    caches[cid].band   = band;
+    caches[cid].margin = crossing ? -1.0 : uintBitsToFloat(s_clusterMargin) - clusterEpsilon(cluster);
+  }
+  
+  memoryBarrierShared();
+  barrier();
+  
+  if (particleBand != BAND_CULLED) {
+#if USE_INDICES
+    IDX = idx;
+#else
+    loadParticle(idx);
+#endif
+    storeParticle(particleBand, s_listStart[particleBand] + local);
+  }
+}
+
+#endif
+
+#endif
+
+#if APPEND_MODE != 0
+
+layout(binding=SSBO_DATA_GROUPS,std430) buffer groupsBuffer {
+  uvec4 groups[];
+};
+
+#define GROUP_VECTORS (LOD_MAX_LEVELS / 4)
+
+shared uvec4 s_scan[CONTENT_WORKGROUP_SIZE];
+shared uint  s_base[LOD_MAX_LEVELS];
+
+// one 16-bit count per band, two bands per component, enough for
+// CONTENT_WORKGROUP_SIZE
+uvec4 bandBits(int band)
+{
+  uvec4 bits = uvec4(0);
+  if (band >= 0) {
+    bits[band / 2] = 1u << (16 * (band % 2));
+  }
+  return bits;
+}
+
+uint bandCount(uvec4 bits, int band)
+{
+  return (bits[band / 2] >> (16 * (band % 2))) & 0xFFFFu;
+}
+
+// returns exclusive prefix sum, s_scan[CONTENT_WORKGROUP_SIZE-1] holds the total
+uvec4 scanWorkGroup(uvec4 value)
+{
+  uint lid = gl_LocalInvocationID.x;
+  s_scan[lid] = value;
+  memoryBarrierShared();
+  barrier();
+  
+  for (uint stride = 1; stride < CONTENT_WORKGROUP_SIZE; stride <<= 1) {
+    uvec4 add = lid >= stride ? s_scan[lid - stride] : uvec4(0);
+    memoryBarrierShared();
+    barrier();
+    s_scan[lid] += add;
+    memoryBarrierShared();
+    barrier();
+  }
+  
+  return s_scan[lid] - value;
+}
+
+void processWorkGroup()
+{
+  int idx  = int(gl_GlobalInvocationID.x) + idxOffset;
+  int band = BAND_CULLED;
+  if (idx < idxMax && !skipParticle(idx)) {
+    loadParticle(idx);
+    
+    vec3  pos  = inPosSize.xyz;
+    float size = inPosSize.w;
+    band = classifyVisible(pos, size);
+  }
+  
+  uvec4 bits   = bandBits(band);
+  uvec4 prefix = scanWorkGroup(bits);
+  uvec4 total  = s_scan[CONTENT_WORKGROUP_SIZE-1];
+  
+#if APPEND_MODE == 2 && ORDERED_PASS == 0
+  if (gl_LocalInvocationID.x == 0) {
+    for (int v = 0; v < GROUP_VECTORS; v++) {
+      groups[gl_WorkGroupID.x * GROUP_VECTORS + v] = uvec4(bandCount(total, v * 4 + 0), bandCount(total, v * 4 + 1),
+                                                           bandCount(total, v * 4 + 2), bandCount(total, v * 4 + 3));
+    }
   }
-  else {
-    uint slot = atomicCounterIncrement(counterMed);
-#if USE_COMPACT_PARTICLE
-    particlesMed[slot].posColor = inPosColor;
 #else
-    particlesMed[slot].posSize = inPosSize;
-    particlesMed[slot].color   = inColor;
+  if (gl_LocalInvocationID.x == 0) {
+#if APPEND_MODE == 2
+    for (int b = 0; b < LOD_MAX_LEVELS; b++) {
+      s_base[b] = groups[gl_WorkGroupID.x * GROUP_VECTORS + b / 4][b % 4];
+    }
+#else
+    for (int b = 0; b < LOD_MAX_LEVELS; b++) {
+      uint cnt = bandCount(total, b);
+      s_base[b] = cnt > 0 ? appendSlot(b, cnt) : 0u;
+    }
 #endif
   }
+  
+  memoryBarrierShared();
+  barrier();
+  
+  if (band != BAND_CULLED) {
+    storeParticle(band, s_base[band] + bandCount(prefix, band));
+  }
+#endif
+}
+
+#endif
+
+void main()
+{
+#if USE_CLUSTERS && USE_INCREMENTAL == 2
+#if INCR_PASS == 0
+  prepareLists();
+#elif INCR_PASS == 1
+  markClusters();
+#else
+  updateCluster();
+#endif
+#elif USE_CLUSTERS
+  processCluster();
+#elif USE_COMPUTE && APPEND_MODE != 0
+  processWorkGroup();
+#else
+#if USE_COMPUTE
+  int idx = int(gl_GlobalInvocationID.x) + idxOffset;
+  if (idx >= idxMax || skipParticle(idx)) return;
+  loadParticle(idx);
+#else
+  loadParticle();
+  if (skipParticle(IDX)) return;
+#endif
+  processParticle();
 #endif
 }
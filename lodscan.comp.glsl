@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+
+#version 430
+/**/
+
+#extension GL_ARB_shading_language_include : enable
+#include "common.h"
+
+// turns the per-workgroup counts of the ordered lodcontent pass into
+// list offsets. Every lodcontent workgroup stores LOD_MAX_LEVELS / 4
+// vectors of counts, each workgroup of the scan walks over one of these
+// slots for all of them.
+
+#define SCAN_WORKGROUP_SIZE 512
+
+layout(local_size_x=SCAN_WORKGROUP_SIZE) in;
+
+layout(location=UNI_SCAN_GROUPS) uniform uint numGroups;
+
+layout(binding=SSBO_DATA_GROUPS,std430) buffer groupsBuffer {
+  uvec4 groups[];
+};
+
+#define GROUP_VECTORS (LOD_MAX_LEVELS / 4)
+
+layout(binding=SSBO_DATA_COUNTS,std430) buffer countsBuffer {
+  DrawCounters counters;
+};
+
+shared uvec4 s_scan[SCAN_WORKGROUP_SIZE];
+
+void main()
+{
+  uint  lid     = gl_LocalInvocationID.x;
+  uint  slot    = gl_WorkGroupID.x;
+  uvec4 running = uvec4(0);
+  
+  for (uint start = 0; start < numGroups; start += SCAN_WORKGROUP_SIZE) {
+    uint  group = start + lid;
+    uvec4 value = group < numGroups ? groups[group * GROUP_VECTORS + slot] : uvec4(0);
+    
+    s_scan[lid] = value;
+    memoryBarrierShared();
+    barrier();
+    
+    for (uint stride = 1; stride < SCAN_WORKGROUP_SIZE; stride <<= 1) {
+      uvec4 add = lid >= stride ? s_scan[lid - stride] : uvec4(0);
+      memoryBarrierShared();
+      barrier();
+      s_scan[lid] += add;
+      memoryBarrierShared();
+      barrier();
+    }
+    
+    if (group < numGroups) {
+      groups[group * GROUP_VECTORS + slot] = running + s_scan[lid] - value;
+    }
+    running += s_scan[SCAN_WORKGROUP_SIZE-1];
+    
+    memoryBarrierShared();
+    barrier();
+  }
+  
+  if (lid == 0) {
+    counters.levelCnt[slot] = running;
+  }
+}
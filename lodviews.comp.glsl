@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#version 430
+/**/
+
+#extension GL_ARB_shading_language_include : enable
+#define USE_LIVENESS 1
+#include "common.h"
+
+// Classifies every particle of a job against viewCount views, the
+// particle is fetched once. Each view has its own lists, viewStride
+// items apart, and its own DrawIndirects, cmdStride words apart, whose
+// counters are used for appending. The lod table and the pixel scale
+// are shared, all views have the same viewport size.
+
+layout(local_size_x=LODVIEWS_WORKGROUP_SIZE) in;
+
+layout(std140,binding=UBO_VIEWS) uniform viewsBuffer {
+  ViewData views[LOD_MAX_VIEWS];
+};
+
+layout(location=UNI_VIEWS_IDX_OFFSET)   uniform int  idxOffset;
+layout(location=UNI_VIEWS_IDX_MAX)      uniform int  idxMax;
+layout(location=UNI_VIEWS_COUNT)        uniform uint viewCount;
+layout(location=UNI_VIEWS_LIST_STRIDE)  uniform uint listStride;
+layout(location=UNI_VIEWS_VIEW_STRIDE)  uniform uint viewStride;
+layout(location=UNI_VIEWS_CMD_STRIDE)   uniform uint cmdStride;
+layout(location=UNI_VIEWS_LIVENESS)     uniform bool useLiveness;
+
+layout(binding=TEX_PARTICLES) uniform ParticleSampler texParticles;
+
+// DrawCounters::levelCnt are the first words of DrawIndirects
+layout(binding=SSBO_DATA_INDIRECTS,std430) buffer indirectsBuffer {
+  uint cmdWords[];
+};
+
+#if USE_INDICES
+#define ListItem int
+#else
+#define ListItem ParticleData
+#endif
+
+layout(binding=SSBO_DATA_LISTS,std430) buffer listsBuffer {
+  ListItem lists[];
+};
+
+int classifyView(uint v, vec3 pos, float size)
+{
+  return classifyParticleView(views[v].frustum, views[v].viewProjMatrix, pos, size);
+}
+
+void main()
+{
+  int idx = int(gl_GlobalInvocationID.x) + idxOffset;
+  if (idx >= idxMax || (useLiveness && !isParticleLive(idx))) return;
+  
+  ParticleData raw = fetchParticle(texParticles, idx);
+  vec4 posSize;
+  vec4 color;
+  decodeParticle(raw, posSize, color);
+  
+  for (uint v = 0; v < viewCount; v++){
+    int band = classifyView(v, posSize.xyz, posSize.w);
+    if (band == BAND_CULLED) continue;
+    
+    uint slot = atomicAdd(cmdWords[v * cmdStride + uint(band)], 1u);
+#if USE_INDICES
+    lists[v * viewStride + uint(band) * listStride + slot] = idx;
+#else
+    lists[v * viewStride + uint(band) * listStride + slot] = raw;
+#endif
+  }
+}
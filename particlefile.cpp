@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "particlefile.hpp"
+
+#include <nvh/nvprint.hpp>
+
+#include <algorithm>
+#include <assert.h>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dynlod {
+
+static_assert(sizeof(ParticleFileHeader) == 64, "unexpected ParticleFileHeader size");
+
+bool ParticleFile::open(const char* filename)
+{
+  close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if(file == INVALID_HANDLE_VALUE)
+  {
+    LOGE("particlefile: could not open \"%s\"\n", filename);
+    return false;
+  }
+  LARGE_INTEGER size;
+  GetFileSizeEx(file, &size);
+  HANDLE fileMapping = size.QuadPart ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+  void*  mapping     = fileMapping ? MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if(!mapping)
+  {
+    LOGE("particlefile: could not map \"%s\"\n", filename);
+    if(fileMapping)
+      CloseHandle(fileMapping);
+    CloseHandle(file);
+    return false;
+  }
+  m_file        = file;
+  m_fileMapping = fileMapping;
+  m_size        = size_t(size.QuadPart);
+#else
+  int file = ::open(filename, O_RDONLY);
+  if(file < 0)
+  {
+    LOGE("particlefile: could not open \"%s\"\n", filename);
+    return false;
+  }
+  struct stat info;
+  void*       mapping = MAP_FAILED;
+  if(fstat(file, &info) == 0 && info.st_size > 0)
+  {
+    mapping = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+  }
+  if(mapping == MAP_FAILED)
+  {
+    LOGE("particlefile: could not map \"%s\"\n", filename);
+    ::close(file);
+    return false;
+  }
+  madvise(mapping, size_t(info.st_size), MADV_SEQUENTIAL);
+  m_file = file;
+  m_size = size_t(info.st_size);
+#endif
+  m_mapping = (const uint8_t*)mapping;
+
+  const ParticleFileHeader& header = getHeader();
+  if(m_size < sizeof(ParticleFileHeader) || strncmp(header.magic, PARTICLEFILE_MAGIC, sizeof(header.magic)) != 0
+     || header.version != PARTICLEFILE_VERSION)
+  {
+    LOGE("particlefile: \"%s\" is not a particle file (version %d)\n", filename, PARTICLEFILE_VERSION);
+    close();
+    return false;
+  }
+  if(header.particleStride != sizeof(Particle))
+  {
+    LOGE("particlefile: \"%s\" particle stride %d does not match %d\n", filename,
+         header.particleStride, int(sizeof(Particle)));
+    close();
+    return false;
+  }
+  if(m_size < sizeof(ParticleFileHeader) + header.particleCount * sizeof(Particle))
+  {
+    LOGE("particlefile: \"%s\" is truncated\n", filename);
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void ParticleFile::close()
+{
+  if(!m_mapping)
+    return;
+
+#ifdef _WIN32
+  UnmapViewOfFile(m_mapping);
+  CloseHandle((HANDLE)m_fileMapping);
+  CloseHandle((HANDLE)m_file);
+  m_fileMapping = nullptr;
+  m_file        = nullptr;
+#else
+  munmap((void*)m_mapping, m_size);
+  ::close(m_file);
+  m_file = -1;
+#endif
+  m_mapping = nullptr;
+  m_size    = 0;
+}
+
+void ParticleFile::release(size_t begin, size_t end)
+{
+#ifdef _WIN32
+  // clean read-only pages are trimmed from the working set by the os
+  (void)begin;
+  (void)end;
+#else
+  // only whole pages within the range can be dropped
+  size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+  size_t first    = sizeof(ParticleFileHeader) + begin * sizeof(Particle);
+  size_t last     = sizeof(ParticleFileHeader) + end * sizeof(Particle);
+  first           = ((first + pageSize - 1) / pageSize) * pageSize;
+  last            = (last / pageSize) * pageSize;
+  if(first < last)
+  {
+    madvise((void*)(m_mapping + first), last - first, MADV_DONTNEED);
+  }
+#endif
+}
+
+bool ParticleFile::write(const char* filename, const Particle* particles, size_t count, float particleSize)
+{
+  FILE* file = fopen(filename, "wb");
+  if(!file)
+  {
+    LOGE("particlefile: could not create \"%s\"\n", filename);
+    return false;
+  }
+
+  ParticleFileHeader header;
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, PARTICLEFILE_MAGIC, sizeof(header.magic));
+  header.version        = PARTICLEFILE_VERSION;
+  header.particleStride = sizeof(Particle);
+  header.particleCount  = count;
+  header.particleSize   = particleSize;
+
+  glm::vec3 bboxMin(FLT_MAX);
+  glm::vec3 bboxMax(-FLT_MAX);
+  header.sizeMin = FLT_MAX;
+  header.sizeMax = 0;
+  for(size_t i = 0; i < count; i++)
+  {
+    glm::vec3 pos  = glm::vec3(particles[i].posSize);
+    bboxMin        = glm::min(bboxMin, pos);
+    bboxMax        = glm::max(bboxMax, pos);
+    header.sizeMin = std::min(header.sizeMin, particles[i].posSize.w);
+    header.sizeMax = std::max(header.sizeMax, particles[i].posSize.w);
+  }
+  memcpy(header.bboxMin, &bboxMin.x, sizeof(header.bboxMin));
+  memcpy(header.bboxMax, &bboxMax.x, sizeof(header.bboxMax));
+
+  bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+  success      = success && (count == 0 || fwrite(particles, sizeof(Particle), count, file) == count);
+  success      = fclose(file) == 0 && success;
+  if(!success)
+  {
+    LOGE("particlefile: could not write \"%s\"\n", filename);
+  }
+  return success;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void StagingRing::init(size_t segmentSize, uint32_t segments)
+{
+  deinit();
+
+  m_segmentSize = segmentSize;
+  m_current     = 0;
+  m_fences.resize(segments, nullptr);
+
+  GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  glCreateBuffers(1, &m_buffer);
+  glNamedBufferStorage(m_buffer, segmentSize * segments, nullptr, flags);
+  m_mapping = (uint8_t*)glMapNamedBufferRange(m_buffer, 0, segmentSize * segments, flags);
+}
+
+void StagingRing::deinit()
+{
+  for(GLsync& fence : m_fences)
+  {
+    if(fence)
+    {
+      glDeleteSync(fence);
+    }
+  }
+  m_fences.clear();
+
+  if(m_buffer)
+  {
+    glUnmapNamedBuffer(m_buffer);
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+  }
+  m_mapping = nullptr;
+}
+
+bool StagingRing::copy(GLuint dstBuffer, size_t dstOffset, const void* data, size_t size)
+{
+  assert(size <= m_segmentSize);
+
+  GLsync& fence = m_fences[m_current];
+  if(fence)
+  {
+    GLenum state = glClientWaitSync(fence, 0, 0);
+    if(state == GL_TIMEOUT_EXPIRED)
+    {
+      return false;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+
+  size_t offset = m_segmentSize * m_current;
+  memcpy(m_mapping + offset, data, size);
+  glCopyNamedBufferSubData(m_buffer, dstBuffer, offset, dstOffset, size);
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  m_current = (m_current + 1) % uint32_t(m_fences.size());
+  return true;
+}
+
+}  // namespace dynlod
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <nvgl/extensions_gl.hpp>
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "common.h"
+
+namespace dynlod {
+
+// Particle file layout (little endian):
+//
+//   ParticleFileHeader    64 bytes
+//   Particle[count]       as defined in common.h, particleStride bytes each
+//
+// The records are always stored as full Particle, they are encoded to the
+// active particle format (particleformat.hpp) while streaming. Consecutive runs
+// of PARTICLE_CLUSTERSIZE particles should be spatially compact, otherwise
+// cluster culling is not effective.
+
+#define PARTICLEFILE_MAGIC "DYNLODP"
+#define PARTICLEFILE_VERSION 1
+
+struct ParticleFileHeader
+{
+  char     magic[8];  // PARTICLEFILE_MAGIC, zero terminated
+  uint32_t version;
+  uint32_t particleStride;
+  uint64_t particleCount;
+  float    particleSize;  // used by PARTICLE_FORMAT_COMPACT
+  float    bboxMin[3];
+  float    bboxMax[3];
+  float    sizeMin;  // used by PARTICLE_FORMAT_QUANT, zero if unknown
+  float    sizeMax;
+  uint32_t _pad[1];
+};
+
+// Read-only memory mapping of a particle file, pages are only loaded when
+// accessed and can be released again after they were uploaded.
+
+class ParticleFile
+{
+public:
+  ~ParticleFile() { close(); }
+
+  bool open(const char* filename);
+  void close();
+  bool isOpen() const { return m_mapping != nullptr; }
+
+  const ParticleFileHeader& getHeader() const { return *(const ParticleFileHeader*)m_mapping; }
+  const Particle*           getParticles() const { return (const Particle*)(m_mapping + sizeof(ParticleFileHeader)); }
+  size_t                    getCount() const { return size_t(getHeader().particleCount); }
+
+  // hints that the range is no longer needed in host memory
+  void release(size_t begin, size_t end);
+
+  static bool write(const char* filename, const Particle* particles, size_t count, float particleSize);
+
+private:
+  const uint8_t* m_mapping = nullptr;
+  size_t         m_size    = 0;
+#ifdef _WIN32
+  void* m_file        = nullptr;
+  void* m_fileMapping = nullptr;
+#else
+  int m_file = -1;
+#endif
+};
+
+// Persistently mapped staging ring buffer. Copies are split into segments
+// that are guarded by fences, so uploads never stall the cpu: a copy is
+// rejected while its segment is still in flight.
+
+class StagingRing
+{
+public:
+  void init(size_t segmentSize, uint32_t segments);
+  void deinit();
+
+  size_t getSegmentSize() const { return m_segmentSize; }
+
+  // size must not exceed the segment size, returns false if no segment is free
+  bool copy(GLuint dstBuffer, size_t dstOffset, const void* data, size_t size);
+
+private:
+  GLuint              m_buffer = 0;
+  uint8_t*            m_mapping = nullptr;
+  size_t              m_segmentSize = 0;
+  uint32_t            m_current = 0;
+  std::vector<GLsync> m_fences;
+};
+
+}  // namespace dynlod
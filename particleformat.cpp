@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "particleformat.hpp"
+
+#include <string.h>
+
+namespace dynlod {
+
+static_assert(sizeof(Particle) == 32, "unexpected Particle size");
+static_assert(sizeof(ParticleCompact) == 16, "unexpected ParticleCompact size");
+static_assert(sizeof(ParticleQuant) == 8, "unexpected ParticleQuant size");
+
+size_t getParticleStride(int format)
+{
+  switch(format)
+  {
+    case PARTICLE_FORMAT_COMPACT:
+      return sizeof(ParticleCompact);
+    case PARTICLE_FORMAT_QUANT:
+      return sizeof(ParticleQuant);
+    default:
+      return sizeof(Particle);
+  }
+}
+
+GLenum getParticleTextureFormat(int format)
+{
+  return format == PARTICLE_FORMAT_QUANT ? GL_RG32UI : GL_RGBA32F;
+}
+
+int getParticleTexels(int format)
+{
+  return format == PARTICLE_FORMAT_FULL ? 2 : 1;
+}
+
+const char* getParticleFormatName(int format)
+{
+  switch(format)
+  {
+    case PARTICLE_FORMAT_COMPACT:
+      return "compact";
+    case PARTICLE_FORMAT_QUANT:
+      return "quantized";
+    default:
+      return "full";
+  }
+}
+
+void setParticleBox(SceneData& scene, const vec3& bboxMin, const vec3& bboxMax, float sizeMin, float sizeMax)
+{
+  // degenerate ranges get a tiny step, so decoding never divides by zero
+  vec3  range     = glm::max(bboxMax - bboxMin, vec3(1.0e-6f));
+  float sizeRange = glm::max(sizeMax - sizeMin, 1.0e-6f);
+
+  scene.particleBoxMin   = vec4(bboxMin, sizeMin);
+  scene.particleBoxScale = vec4(range / 65535.0f, sizeRange / 255.0f);
+}
+
+static inline uint32_t quantize(float value, float minValue, float scale, uint32_t maxValue)
+{
+  float q = (value - minValue) / scale + 0.5f;
+  q       = glm::clamp(q, 0.0f, float(maxValue));
+  return uint32_t(q);
+}
+
+static inline uint32_t packColor(const vec4& color)
+{
+  uint32_t r = uint32_t(glm::clamp(color.x, 0.0f, 1.0f) * 255.0f + 0.5f);
+  uint32_t g = uint32_t(glm::clamp(color.y, 0.0f, 1.0f) * 255.0f + 0.5f);
+  uint32_t b = uint32_t(glm::clamp(color.z, 0.0f, 1.0f) * 255.0f + 0.5f);
+  uint32_t a = uint32_t(glm::clamp(color.w, 0.0f, 1.0f) * 255.0f + 0.5f);
+  return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+static inline vec4 unpackColor(uint32_t packed)
+{
+  return vec4(float(packed & 0xFF), float((packed >> 8) & 0xFF), float((packed >> 16) & 0xFF), float(packed >> 24)) / 255.0f;
+}
+
+void encodeParticles(int format, const SceneData& scene, const Particle* particles, size_t count, void* dst)
+{
+  switch(format)
+  {
+    case PARTICLE_FORMAT_COMPACT:
+    {
+      ParticleCompact* out = (ParticleCompact*)dst;
+      for(size_t i = 0; i < count; i++)
+      {
+        uint32_t color = packColor(particles[i].color);
+        out[i].posColor = vec4(vec3(particles[i].posSize), 0.0f);
+        memcpy(&out[i].posColor.w, &color, sizeof(color));
+      }
+    }
+    break;
+    case PARTICLE_FORMAT_QUANT:
+    {
+      const vec4&    boxMin   = scene.particleBoxMin;
+      const vec4&    boxScale = scene.particleBoxScale;
+      ParticleQuant* out      = (ParticleQuant*)dst;
+      for(size_t i = 0; i < count; i++)
+      {
+        const Particle& particle = particles[i];
+
+        uint32_t x    = quantize(particle.posSize.x, boxMin.x, boxScale.x, 0xFFFF);
+        uint32_t y    = quantize(particle.posSize.y, boxMin.y, boxScale.y, 0xFFFF);
+        uint32_t z    = quantize(particle.posSize.z, boxMin.z, boxScale.z, 0xFFFF);
+        uint32_t size = quantize(particle.posSize.w, boxMin.w, boxScale.w, 0xFF);
+        uint32_t r    = quantize(particle.color.x, 0.0f, 1.0f / 7.0f, 7);
+        uint32_t g    = quantize(particle.color.y, 0.0f, 1.0f / 7.0f, 7);
+        uint32_t b    = quantize(particle.color.z, 0.0f, 1.0f / 3.0f, 3);
+
+        out[i].data.x = x | (y << 16);
+        out[i].data.y = z | (size << 16) | (((r << 5) | (g << 2) | b) << 24);
+      }
+    }
+    break;
+    default:
+      memcpy(dst, particles, sizeof(Particle) * count);
+      break;
+  }
+}
+
+// must match decodeParticle in common.h
+
+void decodeParticles(int format, const SceneData& scene, const void* src, size_t count, Particle* particles)
+{
+  switch(format)
+  {
+    case PARTICLE_FORMAT_COMPACT:
+    {
+      const ParticleCompact* in = (const ParticleCompact*)src;
+      for(size_t i = 0; i < count; i++)
+      {
+        uint32_t color;
+        memcpy(&color, &in[i].posColor.w, sizeof(color));
+        particles[i].posSize = vec4(vec3(in[i].posColor), scene.particleSize);
+        particles[i].color   = unpackColor(color);
+      }
+    }
+    break;
+    case PARTICLE_FORMAT_QUANT:
+    {
+      const vec4&          boxMin   = scene.particleBoxMin;
+      const vec4&          boxScale = scene.particleBoxScale;
+      const ParticleQuant* in       = (const ParticleQuant*)src;
+      for(size_t i = 0; i < count; i++)
+      {
+        uvec2    d = in[i].data;
+        vec3     q = vec3(float(d.x & 0xFFFF), float(d.x >> 16), float(d.y & 0xFFFF));
+        uint32_t c = d.y >> 24;
+
+        particles[i].posSize = vec4(vec3(boxMin) + q * vec3(boxScale), boxMin.w + float((d.y >> 16) & 0xFF) * boxScale.w);
+        particles[i].color   = vec4(float(c >> 5) / 7.0f, float((c >> 2) & 7) / 7.0f, float(c & 3) / 3.0f, 1.0f);
+      }
+    }
+    break;
+    default:
+      if(src != particles)
+      {
+        memcpy(particles, src, sizeof(Particle) * count);
+      }
+      break;
+  }
+}
+
+}  // namespace dynlod
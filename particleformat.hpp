@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <nvgl/extensions_gl.hpp>
+
+#include <glm/glm.hpp>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+namespace dynlod {
+
+// Conversion between the application's Particle and the gpu storage
+// formats (PARTICLE_FORMAT_ in common.h).
+
+size_t      getParticleStride(int format);
+GLenum      getParticleTextureFormat(int format);
+int         getParticleTexels(int format);  // per particle in the texture buffer
+const char* getParticleFormatName(int format);
+
+// sets the decode ranges used by PARTICLE_FORMAT_QUANT
+void setParticleBox(SceneData& scene, const vec3& bboxMin, const vec3& bboxMax, float sizeMin, float sizeMax);
+
+// dst must provide count * getParticleStride(format) bytes
+void encodeParticles(int format, const SceneData& scene, const Particle* particles, size_t count, void* dst);
+// yields what the shaders see after decodeParticle
+void decodeParticles(int format, const SceneData& scene, const void* src, size_t count, Particle* particles);
+
+}  // namespace dynlod
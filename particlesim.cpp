@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "particlesim.hpp"
+#include "particleformat.hpp"
+
+namespace dynlod {
+
+// must match simulateParticle in lodcontent.vert.glsl
+
+void simulateParticle(const SceneData& scene, float timeStep, vec4& posSize, vec4& velocity)
+{
+  vec3 boxMin = vec3(scene.particleBoxMin);
+  vec3 boxMax = vec3(scene.particleBoxMin) + vec3(scene.particleBoxScale) * 65535.0f;
+
+  vec3 vel = vec3(velocity);
+  vel.y -= float(SIM_GRAVITY) * timeStep;
+  vec3 pos = vec3(posSize) + vel * timeStep;
+
+  for(int c = 0; c < 3; c++)
+  {
+    if(pos[c] < boxMin[c] || pos[c] > boxMax[c])
+    {
+      vel[c] = -vel[c] * float(SIM_RESTITUTION);
+    }
+  }
+  pos = glm::clamp(pos, boxMin, boxMax);
+
+  posSize  = vec4(pos, posSize.w);
+  velocity = vec4(vel, velocity.w);
+}
+
+void simulateParticles(int format, const SceneData& scene, float timeStep, uint8_t* encoded, vec4* velocities,
+                       size_t begin, size_t end, Particle* decoded)
+{
+  size_t stride = getParticleStride(format);
+
+  for(size_t i = begin; i < end; i++)
+  {
+    Particle particle;
+    decodeParticles(format, scene, encoded + stride * i, 1, &particle);
+    simulateParticle(scene, timeStep, particle.posSize, velocities[i]);
+
+    // classification sees what is stored
+    encodeParticles(format, scene, &particle, 1, encoded + stride * i);
+    decodeParticles(format, scene, encoded + stride * i, 1, &decoded[i]);
+  }
+}
+
+}  // namespace dynlod
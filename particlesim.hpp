@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+namespace dynlod {
+
+// CPU reference of the simulation that lodcontent.vert.glsl fuses into
+// the classification: gravity, integrated with semi-implicit euler, and
+// particles bouncing off the scene's particle box.
+
+// advances a single particle, posSize.w is unchanged
+void simulateParticle(const SceneData& scene, float timeStep, vec4& posSize, vec4& velocity);
+
+// advances the encoded particles within [begin,end) in place, like the
+// shader does, and stores what the classification sees in decoded
+void simulateParticles(int format, const SceneData& scene, float timeStep, uint8_t* encoded, vec4* velocities,
+                       size_t begin, size_t end, Particle* decoded);
+
+}  // namespace dynlod
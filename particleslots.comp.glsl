@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+
+#version 430
+/**/
+
+#extension GL_ARB_shading_language_include : enable
+#include "common.h"
+
+// applies the changes of ParticleSlots (particleslots.cpp) to the particle
+// buffer, every invocation handles one move of a particle into a slot.
+// SLOTS_SCATTER 1: the particles of ParticleSlots::add, uploaded in the
+//                  particle format, are written to their slots
+// SLOTS_SCATTER 0: compaction, particles move from the end of the active
+//                  range into its holes
+
+layout(local_size_x=PARTICLESLOTS_WORKGROUP_SIZE) in;
+
+layout(location=UNI_SLOTS_COUNT)      uniform uint moveCount;
+layout(location=UNI_SLOTS_VELOCITIES) uniform bool useVelocities;
+
+// x: source index, y: destination slot
+layout(binding=SSBO_DATA_SLOTMOVES,std430) readonly buffer movesBuffer {
+  uvec2 moves[];
+};
+
+layout(binding=SSBO_DATA_PARTICLES,std430) buffer particlesBuffer {
+  ParticleData particles[];
+};
+
+layout(binding=SSBO_DATA_VELOCITIES,std430) buffer velocitiesBuffer {
+  vec4 velocities[];
+};
+
+#if SLOTS_SCATTER
+layout(binding=SSBO_DATA_SLOTPARTICLES,std430) readonly buffer slotParticlesBuffer {
+  ParticleData slotParticles[];
+};
+
+layout(binding=SSBO_DATA_SLOTVELOCITIES,std430) readonly buffer slotVelocitiesBuffer {
+  vec4 slotVelocities[];
+};
+#endif
+
+void main()
+{
+  uint i = gl_GlobalInvocationID.x;
+  if (i >= moveCount) return;
+  
+  uvec2 move = moves[i];
+#if SLOTS_SCATTER
+  particles[move.y] = slotParticles[move.x];
+  if (useVelocities) {
+    velocities[move.y] = slotVelocities[move.x];
+  }
+#else
+  // sources lie behind the live count and destinations before it, no
+  // move reads what another one writes
+  particles[move.y] = particles[move.x];
+  if (useVelocities) {
+    velocities[move.y] = velocities[move.x];
+  }
+#endif
+}
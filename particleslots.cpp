@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "particleslots.hpp"
+#include "particleformat.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+namespace dynlod {
+
+const uint32_t ParticleSlots::INVALID;
+
+static size_t alignSize(size_t size)
+{
+  return (size + 255) & ~size_t(255);
+}
+
+void ParticleSlots::init(uint32_t capacity, uint32_t count, bool hostCopy)
+{
+  deinit();
+
+  m_capacity     = capacity;
+  m_slotCount    = count;
+  m_liveCount    = count;
+  m_handleCount  = count;
+  m_modified     = false;
+  m_changedBegin = 0;
+  m_changedEnd   = 0;
+  if(hostCopy)
+  {
+    m_particles.resize(capacity);
+  }
+
+  m_slotHandles.resize(capacity, INVALID);
+  m_handleSlots.resize(capacity, INVALID);
+  for(uint32_t i = 0; i < count; i++)
+  {
+    m_slotHandles[i] = i;
+    m_handleSlots[i] = i;
+  }
+
+  m_livenessBits.resize(std::max((capacity + 31) / 32, 1u), 0);
+  std::fill(m_livenessBits.begin(), m_livenessBits.begin() + count / 32, ~0u);
+  if(count % 32)
+  {
+    m_livenessBits[count / 32] = (1u << (count % 32)) - 1;
+  }
+  m_dirtyBegin = 0;
+  m_dirtyEnd   = 0;
+
+  glCreateBuffers(1, &m_liveness);
+  glNamedBufferData(m_liveness, sizeof(uint32_t) * m_livenessBits.size(), m_livenessBits.data(), GL_DYNAMIC_DRAW);
+}
+
+void ParticleSlots::deinit()
+{
+  if(m_liveness)
+  {
+    glDeleteBuffers(1, &m_liveness);
+    m_liveness = 0;
+  }
+  if(m_uploads)
+  {
+    glDeleteBuffers(1, &m_uploads);
+    m_uploads     = 0;
+    m_uploadsSize = 0;
+  }
+
+  m_capacity    = 0;
+  m_slotCount   = 0;
+  m_liveCount   = 0;
+  m_handleCount = 0;
+
+  m_slotHandles   = std::vector<uint32_t>();
+  m_handleSlots   = std::vector<uint32_t>();
+  m_freeSlots     = std::vector<uint32_t>();
+  m_freeHandles   = std::vector<Handle>();
+  m_releasedSlots = std::vector<uint32_t>();
+  m_livenessBits  = std::vector<uint32_t>();
+  m_addSlots      = std::vector<uint32_t>();
+  m_addParticles  = std::vector<Particle>();
+  m_addVelocities = std::vector<vec4>();
+  m_particles     = std::vector<Particle>();
+}
+
+void ParticleSlots::setParticles(uint32_t begin, const Particle* particles, uint32_t count)
+{
+  if(m_particles.empty())
+    return;
+
+  assert(begin + count <= m_capacity);
+  std::copy(particles, particles + count, m_particles.begin() + begin);
+}
+
+void ParticleSlots::setChanged(uint32_t begin, uint32_t end)
+{
+  if(m_changedBegin == m_changedEnd)
+  {
+    m_changedBegin = begin;
+    m_changedEnd   = end;
+  }
+  else
+  {
+    m_changedBegin = std::min(m_changedBegin, begin);
+    m_changedEnd   = std::max(m_changedEnd, end);
+  }
+}
+
+void ParticleSlots::clearModified()
+{
+  assert(m_addSlots.empty() && m_releasedSlots.empty() && m_slotCount == m_liveCount);
+
+  m_modified     = false;
+  m_changedBegin = 0;
+  m_changedEnd   = 0;
+}
+
+void ParticleSlots::setLive(uint32_t slot, bool live)
+{
+  uint32_t word = slot / 32;
+  uint32_t bit  = 1u << (slot % 32);
+  m_livenessBits[word] = live ? (m_livenessBits[word] | bit) : (m_livenessBits[word] & ~bit);
+
+  if(m_dirtyBegin == m_dirtyEnd)
+  {
+    m_dirtyBegin = word;
+    m_dirtyEnd   = word + 1;
+  }
+  else
+  {
+    m_dirtyBegin = std::min(m_dirtyBegin, word);
+    m_dirtyEnd   = std::max(m_dirtyEnd, word + 1);
+  }
+}
+
+uint32_t ParticleSlots::add(const Particle* particles, const vec4* velocities, uint32_t count, Handle* handles)
+{
+  uint32_t added = 0;
+  for(; added < count; added++)
+  {
+    // holes are refilled before the active range grows
+    uint32_t slot;
+    if(!m_freeSlots.empty())
+    {
+      slot = m_freeSlots.back();
+      m_freeSlots.pop_back();
+    }
+    else if(m_slotCount < m_capacity)
+    {
+      slot = m_slotCount++;
+    }
+    else
+    {
+      break;
+    }
+
+    Handle handle;
+    if(!m_freeHandles.empty())
+    {
+      handle = m_freeHandles.back();
+      m_freeHandles.pop_back();
+    }
+    else
+    {
+      handle = m_handleCount++;
+    }
+
+    m_slotHandles[slot]   = handle;
+    m_handleSlots[handle] = slot;
+    setLive(slot, true);
+    setChanged(slot, slot + 1);
+
+    m_addSlots.push_back(slot);
+    m_addParticles.push_back(particles[added]);
+    m_addVelocities.push_back(velocities ? velocities[added] : vec4(0));
+    if(handles)
+    {
+      handles[added] = handle;
+    }
+  }
+
+  m_liveCount += added;
+  m_modified = m_modified || added > 0;
+  return added;
+}
+
+void ParticleSlots::remove(const Handle* handles, uint32_t count)
+{
+  for(uint32_t i = 0; i < count; i++)
+  {
+    Handle   handle = handles[i];
+    uint32_t slot   = getSlot(handle);
+    if(slot == INVALID)
+      continue;
+
+    m_handleSlots[handle] = INVALID;
+    m_slotHandles[slot]   = INVALID;
+    m_freeHandles.push_back(handle);
+    m_releasedSlots.push_back(slot);
+    setLive(slot, false);
+    setChanged(slot, slot + 1);
+
+    m_liveCount--;
+    m_modified = true;
+  }
+}
+
+void ParticleSlots::reserveUploads(size_t size)
+{
+  if(size <= m_uploadsSize)
+    return;
+
+  if(m_uploads)
+  {
+    glDeleteBuffers(1, &m_uploads);
+  }
+  m_uploadsSize = std::max(size, m_uploadsSize + m_uploadsSize / 2);
+  glCreateBuffers(1, &m_uploads);
+  glNamedBufferData(m_uploads, m_uploadsSize, nullptr, GL_STREAM_DRAW);
+}
+
+void ParticleSlots::uploadLiveness()
+{
+  if(m_dirtyBegin == m_dirtyEnd)
+    return;
+
+  glNamedBufferSubData(m_liveness, sizeof(uint32_t) * m_dirtyBegin, sizeof(uint32_t) * (m_dirtyEnd - m_dirtyBegin),
+                       &m_livenessBits[m_dirtyBegin]);
+  m_dirtyBegin = 0;
+  m_dirtyEnd   = 0;
+}
+
+bool ParticleSlots::upload(GLuint program, int format, const SceneData& scene, GLuint particles, GLuint velocities)
+{
+  // the lowest slots are taken first, which leaves holes towards the end
+  // of the range, where compaction has less to move
+  std::sort(m_releasedSlots.begin(), m_releasedSlots.end(), [](uint32_t a, uint32_t b) { return a > b; });
+  m_freeSlots.insert(m_freeSlots.end(), m_releasedSlots.begin(), m_releasedSlots.end());
+  m_releasedSlots.clear();
+
+  bool changed = m_dirtyBegin != m_dirtyEnd;
+  uploadLiveness();
+
+  if(m_addSlots.empty())
+  {
+    return changed;
+  }
+
+  uint32_t count  = uint32_t(m_addSlots.size());
+  size_t   stride = getParticleStride(format);
+
+  m_moves.resize(count);
+  for(uint32_t i = 0; i < count; i++)
+  {
+    m_moves[i] = uvec2(i, m_addSlots[i]);
+  }
+  m_encoded.resize(stride * count);
+  encodeParticles(format, scene, m_addParticles.data(), count, m_encoded.data());
+  if(!m_particles.empty())
+  {
+    // the host copy holds what the shaders decode
+    decodeParticles(format, scene, m_encoded.data(), count, m_addParticles.data());
+    for(uint32_t i = 0; i < count; i++)
+    {
+      m_particles[m_addSlots[i]] = m_addParticles[i];
+    }
+  }
+
+  size_t movesSize      = sizeof(uvec2) * count;
+  size_t particlesBegin = alignSize(movesSize);
+  size_t velocityBegin  = particlesBegin + alignSize(m_encoded.size());
+  size_t velocitySize   = velocities ? sizeof(vec4) * count : 0;
+
+  reserveUploads(velocityBegin + velocitySize);
+  glNamedBufferSubData(m_uploads, 0, movesSize, m_moves.data());
+  glNamedBufferSubData(m_uploads, particlesBegin, m_encoded.size(), m_encoded.data());
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_SLOTMOVES, m_uploads, 0, movesSize);
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_SLOTPARTICLES, m_uploads, particlesBegin, m_encoded.size());
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_PARTICLES, particles);
+  if(velocities)
+  {
+    glNamedBufferSubData(m_uploads, velocityBegin, velocitySize, m_addVelocities.data());
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_SLOTVELOCITIES, m_uploads, velocityBegin, velocitySize);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_VELOCITIES, velocities);
+  }
+
+  glUseProgram(program);
+  glUniform1ui(UNI_SLOTS_COUNT, count);
+  glUniform1i(UNI_SLOTS_VELOCITIES, velocities ? 1 : 0);
+  glDispatchCompute((count + PARTICLESLOTS_WORKGROUP_SIZE - 1) / PARTICLESLOTS_WORKGROUP_SIZE, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+  m_addSlots.clear();
+  m_addParticles.clear();
+  m_addVelocities.clear();
+
+  return true;
+}
+
+bool ParticleSlots::compact(GLuint program, GLuint particles, GLuint velocities)
+{
+  assert(m_addSlots.empty() && m_releasedSlots.empty());
+
+  if(m_slotCount == m_liveCount)
+  {
+    return false;
+  }
+
+  // pairs every hole below the live count with a live particle behind it,
+  // words without holes or particles are skipped
+  auto isLive = [&](uint32_t slot) { return (m_livenessBits[slot / 32] & (1u << (slot % 32))) != 0; };
+
+  m_moves.clear();
+  uint32_t dst = 0;
+  uint32_t src = m_liveCount;
+  for(;;)
+  {
+    while(dst < m_liveCount && isLive(dst))
+    {
+      dst = m_livenessBits[dst / 32] == ~0u ? (dst | 31) + 1 : dst + 1;
+    }
+    if(dst >= m_liveCount)
+      break;
+
+    while(!isLive(src))
+    {
+      src = m_livenessBits[src / 32] == 0 ? (src | 31) + 1 : src + 1;
+    }
+
+    Handle handle         = m_slotHandles[src];
+    m_slotHandles[dst]    = handle;
+    m_slotHandles[src]    = INVALID;
+    m_handleSlots[handle] = dst;
+    setLive(dst, true);
+    setLive(src, false);
+    if(!m_particles.empty())
+    {
+      m_particles[dst] = m_particles[src];
+    }
+    m_moves.push_back(uvec2(src, dst));
+  }
+
+  // particles moved into released slots, which are changed already, the
+  // slots the range shrinks by are changed as well
+  setChanged(m_liveCount, m_slotCount);
+  m_slotCount = m_liveCount;
+  m_freeSlots.clear();
+
+  uint32_t count = uint32_t(m_moves.size());
+  reserveUploads(sizeof(uvec2) * count);
+  glNamedBufferSubData(m_uploads, 0, sizeof(uvec2) * count, m_moves.data());
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_SLOTMOVES, m_uploads, 0, sizeof(uvec2) * count);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_PARTICLES, particles);
+  if(velocities)
+  {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_DATA_VELOCITIES, velocities);
+  }
+
+  glUseProgram(program);
+  glUniform1ui(UNI_SLOTS_COUNT, count);
+  glUniform1i(UNI_SLOTS_VELOCITIES, velocities ? 1 : 0);
+  glDispatchCompute((count + PARTICLESLOTS_WORKGROUP_SIZE - 1) / PARTICLESLOTS_WORKGROUP_SIZE, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+  uploadLiveness();
+
+  return true;
+}
+
+}  // namespace dynlod
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <nvgl/extensions_gl.hpp>
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "common.h"
+
+namespace dynlod {
+
+// Slot allocator for particles that are spawned and killed at runtime.
+//
+// Slots [0, getSlotCount()) form the active range of the particle buffer,
+// which is what gets classified. Removing a particle clears its bit in the
+// liveness mask, lodcontent skips such holes, and puts the slot on a free
+// list that later additions take from before the range grows. compact()
+// closes the remaining holes on the gpu by moving the particles from the end
+// of the range into them, so the range is dense again and the mask no longer
+// needs to be tested.
+//
+// As compaction changes slots, particles are referred to by handles. A handle
+// stays valid until its particle is removed, afterwards it may be reused.
+//
+// add() and remove() only record changes. upload() applies them with a
+// single scatter dispatch of the new particles and an update of the changed
+// words of the liveness mask, the particle buffer is never uploaded as a whole.
+//
+// Optionally a host copy of the particles follows all changes, the slots
+// written since the last clearModified() tell which data derived from the
+// particles (clusters, cpu copies) needs to be rebuilt.
+
+class ParticleSlots
+{
+public:
+  typedef uint32_t Handle;
+  static const uint32_t INVALID = ~0u;
+
+  // the first count slots are live, slot i has handle i. With hostCopy
+  // their particles are expected through setParticles.
+  void init(uint32_t capacity, uint32_t count, bool hostCopy = false);
+  void deinit();
+  // fills the host copy of slots [begin, begin + count)
+  void setParticles(uint32_t begin, const Particle* particles, uint32_t count);
+
+  // returns how many particles were added, which is less than count once
+  // all slots are taken. velocities and handles may be null.
+  uint32_t add(const Particle* particles, const vec4* velocities, uint32_t count, Handle* handles);
+  // handles of particles that were already removed are ignored
+  void remove(const Handle* handles, uint32_t count);
+
+  // program is particleslots.comp.glsl with SLOTS_SCATTER 1 for the format,
+  // velocities are only written if a buffer is provided. Returns true if
+  // anything changed on the gpu.
+  bool upload(GLuint program, int format, const SceneData& scene, GLuint particles, GLuint velocities);
+
+  // program is particleslots.comp.glsl with SLOTS_SCATTER 0, expects all
+  // changes to be uploaded. Returns true if particles were moved.
+  bool compact(GLuint program, GLuint particles, GLuint velocities);
+
+  bool     isValid() const { return m_liveness != 0; }
+  // once particles were added or removed, data derived from the particles
+  // (clusters, cpu copies) is outdated, until it was rebuilt for the changed
+  // slots and clearModified was called
+  bool     isModified() const { return m_modified; }
+  // expects all changes to be uploaded and compacted
+  void     clearModified();
+  // slots written or released since the last clearModified, may extend
+  // beyond the slot count after compaction
+  uint32_t getChangedBegin() const { return m_changedBegin; }
+  uint32_t getChangedEnd() const { return m_changedEnd; }
+  bool     hasHostCopy() const { return !m_particles.empty(); }
+  // decoded particles of all slots, dead slots hold their last particle
+  const Particle* getParticles() const { return m_particles.data(); }
+  uint32_t getCapacity() const { return m_capacity; }
+  uint32_t getSlotCount() const { return m_slotCount; }
+  uint32_t getLiveCount() const { return m_liveCount; }
+  uint32_t getHoleCount() const { return m_slotCount - m_liveCount; }
+  // INVALID for dead slots
+  Handle   getHandle(uint32_t slot) const { return slot < m_slotCount ? m_slotHandles[slot] : INVALID; }
+  uint32_t getSlot(Handle handle) const { return handle < m_capacity ? m_handleSlots[handle] : INVALID; }
+  GLuint   getLivenessBuffer() const { return m_liveness; }
+
+private:
+  void setLive(uint32_t slot, bool live);
+  void setChanged(uint32_t begin, uint32_t end);
+  void uploadLiveness();
+  void reserveUploads(size_t size);
+
+  uint32_t m_capacity    = 0;
+  uint32_t m_slotCount   = 0;
+  uint32_t m_liveCount   = 0;
+  uint32_t m_handleCount = 0;  // handles ever given out
+  bool     m_modified    = false;
+
+  uint32_t              m_changedBegin = 0;
+  uint32_t              m_changedEnd   = 0;
+  std::vector<Particle> m_particles;
+
+  std::vector<uint32_t> m_slotHandles;
+  std::vector<uint32_t> m_handleSlots;
+  std::vector<uint32_t> m_freeSlots;
+  std::vector<Handle>   m_freeHandles;
+  // freed by remove, they only join the free list with the next upload, so
+  // a slot is never written twice by the same scatter
+  std::vector<uint32_t> m_releasedSlots;
+
+  // host copy of the mask, words [m_dirtyBegin, m_dirtyEnd) need an upload
+  std::vector<uint32_t> m_livenessBits;
+  uint32_t              m_dirtyBegin = 0;
+  uint32_t              m_dirtyEnd   = 0;
+
+  // pending additions
+  std::vector<uint32_t> m_addSlots;
+  std::vector<Particle> m_addParticles;
+  std::vector<vec4>     m_addVelocities;
+
+  // staging for the dispatches: moves, then particles, then velocities
+  std::vector<uvec2>   m_moves;
+  std::vector<uint8_t> m_encoded;
+  GLuint               m_liveness    = 0;
+  GLuint               m_uploads     = 0;
+  size_t               m_uploadsSize = 0;
+};
+
+}  // namespace dynlod
@@ -0,0 +1,1018 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "pointcloud.hpp"
+#include "particlefile.hpp"
+
+#include <nvh/nvprint.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <ctype.h>
+#include <float.h>
+#include <functional>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dynlod {
+
+// read-only mapping of the input, or a writable mapping of a new file of
+// the given size
+class MappedFile
+{
+public:
+  ~MappedFile() { close(); }
+
+  bool open(const char* filename, size_t createSize = 0)
+  {
+    bool create = createSize != 0;
+#ifdef _WIN32
+    HANDLE file = create ? CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL) :
+                           CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER size;
+    size.QuadPart = LONGLONG(createSize);
+    if(create ? !SetFilePointerEx(file, size, NULL, FILE_BEGIN) || !SetEndOfFile(file) : !GetFileSizeEx(file, &size))
+    {
+      CloseHandle(file);
+      return false;
+    }
+    HANDLE fileMapping = size.QuadPart ? CreateFileMappingA(file, NULL, create ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL) : NULL;
+    void*  mapping = fileMapping ? MapViewOfFile(fileMapping, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0) : NULL;
+    if(!mapping)
+    {
+      if(fileMapping)
+        CloseHandle(fileMapping);
+      CloseHandle(file);
+      return false;
+    }
+    m_file        = file;
+    m_fileMapping = fileMapping;
+    m_size        = size_t(size.QuadPart);
+#else
+    int file = create ? ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644) : ::open(filename, O_RDONLY);
+    if(file < 0)
+      return false;
+    struct stat info;
+    if(create ? ftruncate(file, off_t(createSize)) != 0 || fstat(file, &info) != 0 : fstat(file, &info) != 0)
+    {
+      ::close(file);
+      return false;
+    }
+    void* mapping = MAP_FAILED;
+    if(info.st_size > 0)
+    {
+      mapping = mmap(nullptr, size_t(info.st_size), create ? PROT_READ | PROT_WRITE : PROT_READ, create ? MAP_SHARED : MAP_PRIVATE, file, 0);
+    }
+    if(mapping == MAP_FAILED)
+    {
+      ::close(file);
+      return false;
+    }
+    m_file = file;
+    m_size = size_t(info.st_size);
+#endif
+    m_mapping = (uint8_t*)mapping;
+    return true;
+  }
+
+  void close()
+  {
+    if(!m_mapping)
+      return;
+#ifdef _WIN32
+    UnmapViewOfFile(m_mapping);
+    CloseHandle((HANDLE)m_fileMapping);
+    CloseHandle((HANDLE)m_file);
+    m_fileMapping = nullptr;
+    m_file        = nullptr;
+#else
+    munmap(m_mapping, m_size);
+    ::close(m_file);
+    m_file = -1;
+#endif
+    m_mapping = nullptr;
+    m_size    = 0;
+  }
+
+  uint8_t* getData() const { return m_mapping; }
+  size_t   getSize() const { return m_size; }
+
+private:
+  uint8_t* m_mapping = nullptr;
+  size_t   m_size    = 0;
+#ifdef _WIN32
+  void* m_file        = nullptr;
+  void* m_fileMapping = nullptr;
+#else
+  int m_file = -1;
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////////
+
+// runs fn(chunk) for all chunks on all hardware threads
+static void parallelChunks(size_t numChunks, const std::function<void(size_t)>& fn)
+{
+  uint32_t numThreads = uint32_t(std::min(size_t(std::max(1u, std::thread::hardware_concurrency())), numChunks));
+
+  std::atomic_size_t nextChunk(0);
+  auto               worker = [&]() {
+    size_t chunk;
+    while((chunk = nextChunk++) < numChunks)
+    {
+      fn(chunk);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for(uint32_t t = 1; t < numThreads; t++)
+  {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for(auto& thread : threads)
+  {
+    thread.join();
+  }
+}
+
+// per chunk results, merged after parsing
+struct ChunkInfo
+{
+  glm::vec3 bboxMin  = glm::vec3(FLT_MAX);
+  glm::vec3 bboxMax  = glm::vec3(-FLT_MAX);
+  float     colorMax = 0;
+  bool      failed   = false;
+};
+
+// what the parsers fill, colors are scaled once their range is known
+struct PointCloud
+{
+  size_t    count = 0;
+  Particle* particles = nullptr;
+  double    origin[3] = {0, 0, 0};
+  bool      hasColor  = false;
+};
+
+// coordinates further away than this are shifted to the first point
+static const double FAR_COORDINATE = 65536.0;
+
+static void chooseOrigin(const double pos[3], double origin[3])
+{
+  bool far = fabs(pos[0]) > FAR_COORDINATE || fabs(pos[1]) > FAR_COORDINATE || fabs(pos[2]) > FAR_COORDINATE;
+  for(int i = 0; i < 3; i++)
+  {
+    origin[i] = far ? floor(pos[i]) : 0.0;
+  }
+}
+
+static inline void storePoint(Particle& particle, ChunkInfo& info, const double pos[3], const double origin[3], const float color[3])
+{
+  glm::vec3 position = glm::vec3(float(pos[0] - origin[0]), float(pos[1] - origin[1]), float(pos[2] - origin[2]));
+
+  particle.posSize = glm::vec4(position, 0.0f);
+  particle.color   = glm::vec4(color[0], color[1], color[2], 1.0f);
+  info.bboxMin     = glm::min(info.bboxMin, position);
+  info.bboxMax     = glm::max(info.bboxMax, position);
+  info.colorMax    = std::max(info.colorMax, std::max(color[0], std::max(color[1], color[2])));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// binary PLY
+
+enum PlyType
+{
+  PLY_INT8,
+  PLY_UINT8,
+  PLY_INT16,
+  PLY_UINT16,
+  PLY_INT32,
+  PLY_UINT32,
+  PLY_FLOAT32,
+  PLY_FLOAT64,
+  PLY_INVALID,
+};
+
+static PlyType getPlyType(const std::string& name)
+{
+  static const char* names[][2] = {{"char", "int8"},   {"uchar", "uint8"}, {"short", "int16"},  {"ushort", "uint16"},
+                                   {"int", "int32"},   {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}};
+  for(int i = 0; i < PLY_INVALID; i++)
+  {
+    if(name == names[i][0] || name == names[i][1])
+      return PlyType(i);
+  }
+  return PLY_INVALID;
+}
+
+static uint32_t getPlyTypeSize(PlyType type)
+{
+  static const uint32_t sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+  return sizes[type];
+}
+
+static inline double readPly(PlyType type, const uint8_t* data)
+{
+  switch(type)
+  {
+    case PLY_INT8:
+      return double(*(const int8_t*)data);
+    case PLY_UINT8:
+      return double(*data);
+    case PLY_INT16: {
+      int16_t value;
+      memcpy(&value, data, sizeof(value));
+      return double(value);
+    }
+    case PLY_UINT16: {
+      uint16_t value;
+      memcpy(&value, data, sizeof(value));
+      return double(value);
+    }
+    case PLY_INT32: {
+      int32_t value;
+      memcpy(&value, data, sizeof(value));
+      return double(value);
+    }
+    case PLY_UINT32: {
+      uint32_t value;
+      memcpy(&value, data, sizeof(value));
+      return double(value);
+    }
+    case PLY_FLOAT32: {
+      float value;
+      memcpy(&value, data, sizeof(value));
+      return double(value);
+    }
+    case PLY_FLOAT64: {
+      double value;
+      memcpy(&value, data, sizeof(value));
+      return value;
+    }
+    default:
+      return 0;
+  }
+}
+
+struct PlyLayout
+{
+  size_t   dataOffset = 0;
+  size_t   count      = 0;
+  uint32_t stride     = 0;
+  // x,y,z,red,green,blue
+  PlyType  types[6]   = {PLY_INVALID, PLY_INVALID, PLY_INVALID, PLY_INVALID, PLY_INVALID, PLY_INVALID};
+  uint32_t offsets[6] = {};
+};
+
+static bool parsePlyHeader(const char* filename, const uint8_t* data, size_t size, PlyLayout& layout)
+{
+  static const char* endHeader = "end_header";
+  const char*        text      = (const char*)data;
+  const char*        end       = text + std::min(size, size_t(64 * 1024));
+
+  std::vector<std::string> tokens;
+  std::string              element;
+  size_t                   elementCount = 0;
+  uint32_t                 elementSize  = 0;
+  bool                     vertexDone   = false;
+  bool                     variable     = false;
+  size_t                   skipBytes    = 0;
+  int                      line         = 0;
+
+  auto finishElement = [&]() {
+    if(element == "vertex")
+    {
+      layout.count  = elementCount;
+      layout.stride = elementSize;
+      vertexDone    = true;
+    }
+    else if(!vertexDone)
+    {
+      skipBytes += elementCount * elementSize;
+    }
+  };
+
+  while(text < end)
+  {
+    const char* lineEnd = (const char*)memchr(text, '\n', end - text);
+    if(!lineEnd)
+      break;
+
+    // tokenize the line
+    tokens.clear();
+    for(const char* c = text; c < lineEnd;)
+    {
+      while(c < lineEnd && (*c == ' ' || *c == '\t' || *c == '\r'))
+        c++;
+      const char* start = c;
+      while(c < lineEnd && *c != ' ' && *c != '\t' && *c != '\r')
+        c++;
+      if(c > start)
+        tokens.emplace_back(start, c);
+    }
+    text = lineEnd + 1;
+
+    if(line++ == 0)
+    {
+      if(tokens.size() != 1 || tokens[0] != "ply")
+        break;
+      continue;
+    }
+    if(tokens.empty() || tokens[0] == "comment" || tokens[0] == "obj_info")
+    {
+      continue;
+    }
+    if(tokens[0] == "format")
+    {
+      if(tokens.size() < 2 || tokens[1] != "binary_little_endian")
+      {
+        LOGE("pointcloud: \"%s\" is not binary little endian PLY\n", filename);
+        return false;
+      }
+    }
+    else if(tokens[0] == "element" && tokens.size() == 3)
+    {
+      finishElement();
+      element      = tokens[1];
+      elementCount = size_t(strtoull(tokens[2].c_str(), nullptr, 10));
+      elementSize  = 0;
+    }
+    else if(tokens[0] == "property" && tokens.size() >= 3)
+    {
+      if(tokens[1] == "list")
+      {
+        // list sizes are per record, only allowed after the vertices
+        if(element == "vertex" || !vertexDone)
+        {
+          variable = true;
+        }
+        continue;
+      }
+
+      PlyType type = getPlyType(tokens[1]);
+      if(type == PLY_INVALID)
+      {
+        LOGE("pointcloud: \"%s\" has unknown PLY type \"%s\"\n", filename, tokens[1].c_str());
+        return false;
+      }
+      if(element == "vertex")
+      {
+        static const char* names[6][3] = {{"x", "x", "x"},     {"y", "y", "y"},        {"z", "z", "z"},
+                                          {"red", "r", "diffuse_red"}, {"green", "g", "diffuse_green"}, {"blue", "b", "diffuse_blue"}};
+        for(int i = 0; i < 6; i++)
+        {
+          if(tokens[2] == names[i][0] || tokens[2] == names[i][1] || tokens[2] == names[i][2])
+          {
+            layout.types[i]   = type;
+            layout.offsets[i] = elementSize;
+          }
+        }
+      }
+      elementSize += getPlyTypeSize(type);
+    }
+    else if(tokens[0] == endHeader)
+    {
+      finishElement();
+      layout.dataOffset = (const uint8_t*)text - data + skipBytes;
+
+      if(variable)
+      {
+        LOGE("pointcloud: \"%s\" has list properties before or within the vertices\n", filename);
+        return false;
+      }
+      if(!vertexDone || layout.types[0] == PLY_INVALID || layout.types[1] == PLY_INVALID || layout.types[2] == PLY_INVALID)
+      {
+        LOGE("pointcloud: \"%s\" has no vertex x,y,z properties\n", filename);
+        return false;
+      }
+      if(layout.dataOffset + layout.count * layout.stride > size)
+      {
+        LOGE("pointcloud: \"%s\" is truncated\n", filename);
+        return false;
+      }
+      return true;
+    }
+  }
+
+  LOGE("pointcloud: \"%s\" is not a PLY file\n", filename);
+  return false;
+}
+
+static bool importPly(const char* filename, const MappedFile& input, MappedFile& output, const std::string& outputName,
+                      PointCloud& cloud, std::vector<ChunkInfo>& chunks)
+{
+  PlyLayout layout;
+  if(!parsePlyHeader(filename, input.getData(), input.getSize(), layout))
+  {
+    return false;
+  }
+  if(layout.count == 0)
+  {
+    LOGE("pointcloud: \"%s\" has no points\n", filename);
+    return false;
+  }
+
+  if(!output.open(outputName.c_str(), sizeof(ParticleFileHeader) + sizeof(Particle) * layout.count))
+  {
+    LOGE("pointcloud: could not create \"%s\"\n", outputName.c_str());
+    return false;
+  }
+  cloud.count     = layout.count;
+  cloud.particles = (Particle*)(output.getData() + sizeof(ParticleFileHeader));
+  cloud.hasColor  = layout.types[3] != PLY_INVALID && layout.types[4] != PLY_INVALID && layout.types[5] != PLY_INVALID;
+
+  const uint8_t* records = input.getData() + layout.dataOffset;
+
+  double first[3];
+  for(int i = 0; i < 3; i++)
+  {
+    first[i] = readPly(layout.types[i], records + layout.offsets[i]);
+  }
+  chooseOrigin(first, cloud.origin);
+
+  // integer colors are normalized by their type's range
+  float colorScale = 1.0f;
+  if(cloud.hasColor && layout.types[3] <= PLY_UINT32)
+  {
+    colorScale = 1.0f / float((1ull << (getPlyTypeSize(layout.types[3]) * 8)) - 1);
+  }
+
+  const size_t chunkSize = 256 * 1024;
+  chunks.resize((layout.count + chunkSize - 1) / chunkSize);
+
+  parallelChunks(chunks.size(), [&](size_t chunk) {
+    ChunkInfo& info  = chunks[chunk];
+    size_t     begin = chunk * chunkSize;
+    size_t     end   = std::min(layout.count, begin + chunkSize);
+
+    for(size_t p = begin; p < end; p++)
+    {
+      const uint8_t* record = records + layout.stride * p;
+
+      double pos[3];
+      float  color[3] = {1.0f, 1.0f, 1.0f};
+      for(int i = 0; i < 3; i++)
+      {
+        pos[i] = readPly(layout.types[i], record + layout.offsets[i]);
+        if(cloud.hasColor)
+        {
+          color[i] = float(readPly(layout.types[3 + i], record + layout.offsets[3 + i])) * colorScale;
+        }
+      }
+      storePoint(cloud.particles[p], info, pos, cloud.origin, color);
+    }
+  });
+
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// text: xyz, pts, csv
+
+static inline bool isSeparator(char c)
+{
+  return c == ' ' || c == '\t' || c == ',' || c == ';' || c == '\r';
+}
+
+static inline bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+// locale independent, returns the position after the number or nullptr
+static const char* parseNumber(const char* str, const char* end, double& value)
+{
+  static const double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+  bool negative = false;
+  if(str < end && (*str == '-' || *str == '+'))
+  {
+    negative = *str == '-';
+    str++;
+  }
+
+  uint64_t mantissa = 0;
+  int      exponent = 0;
+  int      digits   = 0;
+  for(; str < end && isDigit(*str); str++, digits++)
+  {
+    if(mantissa < 100000000000000000ull)
+      mantissa = mantissa * 10 + uint64_t(*str - '0');
+    else
+      exponent++;
+  }
+  if(str < end && *str == '.')
+  {
+    for(str++; str < end && isDigit(*str); str++, digits++)
+    {
+      if(mantissa < 100000000000000000ull)
+      {
+        mantissa = mantissa * 10 + uint64_t(*str - '0');
+        exponent--;
+      }
+    }
+  }
+  if(!digits)
+  {
+    return nullptr;
+  }
+
+  if(str < end && (*str == 'e' || *str == 'E'))
+  {
+    const char* expStart = ++str;
+    bool        expNeg   = false;
+    if(str < end && (*str == '-' || *str == '+'))
+    {
+      expNeg = *str == '-';
+      str++;
+    }
+    int expValue = 0;
+    for(; str < end && isDigit(*str); str++)
+    {
+      expValue = std::min(expValue * 10 + (*str - '0'), 1000);
+    }
+    if(str == expStart || !isDigit(str[-1]))
+    {
+      return nullptr;
+    }
+    exponent += expNeg ? -expValue : expValue;
+  }
+
+  double result = double(mantissa);
+  if(exponent < 0)
+    result = exponent >= -22 ? result / pow10[-exponent] : result * pow(10.0, double(exponent));
+  else if(exponent > 0)
+    result = exponent <= 22 ? result * pow10[exponent] : result * pow(10.0, double(exponent));
+
+  value = negative ? -result : result;
+  return str;
+}
+
+static const int TEXT_MAX_FIELDS = 16;
+
+// splits a line into at most TEXT_MAX_FIELDS fields
+static int splitFields(const char* line, const char* end, const char* fields[TEXT_MAX_FIELDS])
+{
+  int count = 0;
+  while(line < end && count < TEXT_MAX_FIELDS)
+  {
+    while(line < end && isSeparator(*line))
+      line++;
+    if(line == end)
+      break;
+    fields[count++] = line;
+    while(line < end && !isSeparator(*line))
+      line++;
+  }
+  return count;
+}
+
+// lines starting with a number that have at least three fields
+static bool isDataLine(const char* line, const char* end)
+{
+  while(line < end && isSeparator(*line))
+    line++;
+  if(line == end || !(isDigit(*line) || *line == '-' || *line == '+' || *line == '.'))
+    return false;
+
+  const char* fields[TEXT_MAX_FIELDS];
+  return splitFields(line, end, fields) >= 3;
+}
+
+struct TextColumns
+{
+  // x,y,z,red,green,blue,intensity, -1 if missing
+  int columns[7] = {0, 1, 2, -1, -1, -1, -1};
+  int used       = 3;
+};
+
+// columns follow the header names, or the field count of the first line:
+// 3 xyz, 4-5 xyz intensity, 6 xyz rgb, 7+ xyz intensity rgb. Returns false
+// for lines that are neither points nor a header naming x,y,z.
+static bool chooseColumns(const char* line, const char* end, TextColumns& text)
+{
+  const char* fields[TEXT_MAX_FIELDS];
+  int         count = splitFields(line, end, fields);
+
+  if(isDataLine(line, end))
+  {
+    int color = count == 6 ? 3 : count >= 7 ? 4 : -1;
+    for(int i = 0; i < 3; i++)
+    {
+      text.columns[3 + i] = color < 0 ? -1 : color + i;
+    }
+    text.columns[6] = count == 4 || count == 5 || count >= 7 ? 3 : -1;
+  }
+  else
+  {
+    static const char* names[7][3] = {{"x", "x", "x"},
+                                      {"y", "y", "y"},
+                                      {"z", "z", "z"},
+                                      {"red", "r", "diffuse_red"},
+                                      {"green", "g", "diffuse_green"},
+                                      {"blue", "b", "diffuse_blue"},
+                                      {"intensity", "i", "intensity"}};
+    for(int i = 0; i < 7; i++)
+    {
+      text.columns[i] = -1;
+    }
+    for(int f = 0; f < count; f++)
+    {
+      // names are compared lower case, without quotes and prefixes such as "//" or "scalar_"
+      const char* fieldEnd = fields[f];
+      while(fieldEnd < end && !isSeparator(*fieldEnd))
+        fieldEnd++;
+      std::string name;
+      for(const char* c = fields[f]; c < fieldEnd; c++)
+      {
+        if(*c != '"' && *c != '\'' && *c != '/')
+          name += char(tolower(*c));
+      }
+      if(name.compare(0, 7, "scalar_") == 0)
+        name = name.substr(7);
+
+      for(int i = 0; i < 7; i++)
+      {
+        if(name == names[i][0] || name == names[i][1] || name == names[i][2])
+          text.columns[i] = f;
+      }
+    }
+    if(text.columns[0] < 0 || text.columns[1] < 0 || text.columns[2] < 0)
+    {
+      return false;
+    }
+  }
+
+  text.used = 0;
+  for(int i = 0; i < 7; i++)
+  {
+    text.used = std::max(text.used, text.columns[i] + 1);
+  }
+  return true;
+}
+
+static bool parseLine(const TextColumns& text, const char* line, const char* end, double pos[3], float color[3])
+{
+  const char* fields[TEXT_MAX_FIELDS];
+  if(splitFields(line, end, fields) < text.used)
+  {
+    return false;
+  }
+
+  double values[7];
+  for(int i = 0; i < 7; i++)
+  {
+    values[i] = 1.0;
+    if(text.columns[i] >= 0)
+    {
+      const char* next = parseNumber(fields[text.columns[i]], end, values[i]);
+      if(!next || (next < end && !isSeparator(*next)))
+        return false;
+    }
+  }
+
+  for(int i = 0; i < 3; i++)
+  {
+    pos[i] = values[i];
+    if(text.columns[3 + i] >= 0)
+      color[i] = float(values[3 + i]);
+    else if(text.columns[6] >= 0)
+      color[i] = float(fabs(values[6]));
+    else
+      color[i] = 1.0f;
+  }
+  return true;
+}
+
+// calls fn(line, lineEnd) for every line in [begin,end), without line breaks
+template <class T>
+static void forEachLine(const char* begin, const char* end, T&& fn)
+{
+  while(begin < end)
+  {
+    const char* lineEnd = (const char*)memchr(begin, '\n', end - begin);
+    lineEnd             = lineEnd ? lineEnd : end;
+    fn(begin, lineEnd);
+    begin = lineEnd + 1;
+  }
+}
+
+static bool importText(const char* filename, const MappedFile& input, MappedFile& output, const std::string& outputName,
+                       PointCloud& cloud, std::vector<ChunkInfo>& chunks)
+{
+  const char* data = (const char*)input.getData();
+  const char* end  = data + input.getSize();
+
+  // the first header or point line decides the columns, this skips
+  // comments and the point count line of .pts files
+  TextColumns text;
+  const char* first = nullptr;
+  for(const char* line = data; line < end && !first;)
+  {
+    const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+    lineEnd             = lineEnd ? lineEnd : end;
+    if(line[0] != '#' && chooseColumns(line, lineEnd, text))
+    {
+      first = line;
+    }
+    line = lineEnd + 1;
+  }
+  if(!first)
+  {
+    LOGE("pointcloud: \"%s\" has no points\n", filename);
+    return false;
+  }
+
+  // chunks start at line beginnings, every line belongs to the chunk its
+  // first character is in
+  const size_t             chunkSize = 4 * 1024 * 1024;
+  size_t                   numChunks = (size_t(end - first) + chunkSize - 1) / chunkSize;
+  std::vector<const char*> starts(numChunks + 1, end);
+  starts[0] = first;
+  for(size_t c = 1; c < numChunks; c++)
+  {
+    const char* lineEnd = (const char*)memchr(first + c * chunkSize - 1, '\n', end - (first + c * chunkSize - 1));
+    starts[c]           = lineEnd ? std::min(lineEnd + 1, end) : end;
+  }
+
+  // pass 1: count the points of every chunk
+  std::vector<size_t> offsets(numChunks + 1, 0);
+  parallelChunks(numChunks, [&](size_t chunk) {
+    size_t count = 0;
+    forEachLine(starts[chunk], starts[chunk + 1], [&](const char* line, const char* lineEnd) {
+      count += isDataLine(line, lineEnd) ? 1 : 0;
+    });
+    offsets[chunk + 1] = count;
+  });
+  for(size_t c = 0; c < numChunks; c++)
+  {
+    offsets[c + 1] += offsets[c];
+  }
+
+  cloud.count = offsets[numChunks];
+  if(cloud.count == 0)
+  {
+    LOGE("pointcloud: \"%s\" has no points\n", filename);
+    return false;
+  }
+  if(!output.open(outputName.c_str(), sizeof(ParticleFileHeader) + sizeof(Particle) * cloud.count))
+  {
+    LOGE("pointcloud: could not create \"%s\"\n", outputName.c_str());
+    return false;
+  }
+  cloud.particles = (Particle*)(output.getData() + sizeof(ParticleFileHeader));
+  cloud.hasColor  = text.columns[3] >= 0 || text.columns[6] >= 0;
+
+  for(const char* line = first; line < end;)
+  {
+    const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+    lineEnd             = lineEnd ? lineEnd : end;
+    double pos[3];
+    float  color[3];
+    if(isDataLine(line, lineEnd) && parseLine(text, line, lineEnd, pos, color))
+    {
+      chooseOrigin(pos, cloud.origin);
+      break;
+    }
+    line = lineEnd + 1;
+  }
+
+  // pass 2: parse into the output records
+  chunks.resize(numChunks);
+  parallelChunks(numChunks, [&](size_t chunk) {
+    ChunkInfo& info     = chunks[chunk];
+    Particle*  particle = cloud.particles + offsets[chunk];
+    forEachLine(starts[chunk], starts[chunk + 1], [&](const char* line, const char* lineEnd) {
+      if(!isDataLine(line, lineEnd))
+        return;
+
+      double pos[3];
+      float  color[3];
+      if(!parseLine(text, line, lineEnd, pos, color))
+      {
+        if(!info.failed)
+        {
+          LOGE("pointcloud: \"%s\" has an invalid line at byte %zu\n", filename, size_t(line - data));
+        }
+        info.failed = true;
+        pos[0] = pos[1] = pos[2] = 0;
+        color[0] = color[1] = color[2] = 0;
+      }
+      storePoint(*particle++, info, pos, cloud.origin, color);
+    });
+  });
+
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+// Estimates the mean distance of neighbouring points by box counting: the
+// bounding box is divided into cubic cells at several resolutions and the
+// occupied cells are counted. How the count grows with the resolution gives
+// the dimension d of the cloud (2 for scanned surfaces, 3 for volumes),
+// then n points per occupied cell of size s are spaced s / n^(1/d).
+static float estimateSpacing(const PointCloud& cloud, glm::vec3 bboxMin, glm::vec3 bboxMax)
+{
+  const int LEVELS     = 5;
+  const int RESOLUTION = 256;  // finest level, coarser levels halve it
+
+  float extent = std::max(bboxMax.x - bboxMin.x, std::max(bboxMax.y - bboxMin.y, bboxMax.z - bboxMin.z));
+  if(!(extent > 0))
+  {
+    return 1.0f;
+  }
+  float cellSize = extent / float(RESOLUTION);
+
+  size_t                                 cells = size_t(RESOLUTION) * RESOLUTION * RESOLUTION;
+  std::unique_ptr<std::atomic_uint32_t[]> bits(new std::atomic_uint32_t[cells / 32]());
+
+  const size_t chunkSize = 256 * 1024;
+  parallelChunks((cloud.count + chunkSize - 1) / chunkSize, [&](size_t chunk) {
+    size_t end = std::min(cloud.count, (chunk + 1) * chunkSize);
+    for(size_t p = chunk * chunkSize; p < end; p++)
+    {
+      glm::ivec3 cell = glm::clamp(glm::ivec3((glm::vec3(cloud.particles[p].posSize) - bboxMin) / cellSize), 0, RESOLUTION - 1);
+      size_t     idx  = (size_t(cell.z) * RESOLUTION + cell.y) * RESOLUTION + cell.x;
+      uint32_t   bit  = 1u << (idx % 32);
+      if(!(bits[idx / 32].load(std::memory_order_relaxed) & bit))
+      {
+        bits[idx / 32].fetch_or(bit, std::memory_order_relaxed);
+      }
+    }
+  });
+
+  // occupied cells per level, level 0 is the finest
+  std::vector<std::vector<bool>> occupied(LEVELS);
+  double                         counts[LEVELS] = {};
+  for(int l = 0; l < LEVELS; l++)
+  {
+    int res = RESOLUTION >> l;
+    occupied[l].resize(size_t(res) * res * res, false);
+  }
+  for(size_t idx = 0; idx < cells; idx++)
+  {
+    if(!(bits[idx / 32].load(std::memory_order_relaxed) & (1u << (idx % 32))))
+      continue;
+
+    size_t x = idx % RESOLUTION;
+    size_t y = (idx / RESOLUTION) % RESOLUTION;
+    size_t z = idx / (size_t(RESOLUTION) * RESOLUTION);
+    for(int l = 0; l < LEVELS; l++)
+    {
+      size_t res = RESOLUTION >> l;
+      size_t cell = ((z >> l) * res + (y >> l)) * res + (x >> l);
+      if(!occupied[l][cell])
+      {
+        occupied[l][cell] = true;
+        counts[l]++;
+      }
+    }
+  }
+
+  // the finest level that still has a few points per cell, a sparser
+  // level would see every point in its own cell
+  int level = LEVELS - 2;
+  for(int l = 0; l < LEVELS - 1; l++)
+  {
+    if(double(cloud.count) / counts[l] >= 4.0)
+    {
+      level = l;
+      break;
+    }
+  }
+
+  double dimension = std::min(std::max(log2(counts[level] / counts[level + 1]), 1.0), 3.0);
+  double perCell   = double(cloud.count) / counts[level];
+  double spacing   = double(cellSize) * double(1 << level) / pow(perCell, 1.0 / dimension);
+
+  LOGI("pointcloud: %.2f dimensional, spacing %g\n", dimension, spacing);
+  return float(spacing);
+}
+
+bool importPointCloud(const char* filename, const char* particleFilename, float particleSize)
+{
+  MappedFile input;
+  if(!input.open(filename))
+  {
+    LOGE("pointcloud: could not open \"%s\"\n", filename);
+    return false;
+  }
+
+  std::string name      = filename;
+  size_t      dot       = name.find_last_of('.');
+  std::string extension = dot == std::string::npos ? std::string() : name.substr(dot + 1);
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(tolower(c)); });
+
+  MappedFile             output;
+  PointCloud             cloud;
+  std::vector<ChunkInfo> chunks;
+  bool                   success;
+  if(extension == "ply")
+  {
+    success = importPly(filename, input, output, particleFilename, cloud, chunks);
+  }
+  else if(extension == "csv" || extension == "xyz" || extension == "txt" || extension == "pts" || extension == "asc")
+  {
+    success = importText(filename, input, output, particleFilename, cloud, chunks);
+  }
+  else
+  {
+    LOGE("pointcloud: \"%s\" has an unknown extension, expected .ply, .csv, .xyz, .txt, .pts or .asc\n", filename);
+    return false;
+  }
+
+  ChunkInfo total;
+  for(const ChunkInfo& info : chunks)
+  {
+    total.bboxMin  = glm::min(total.bboxMin, info.bboxMin);
+    total.bboxMax  = glm::max(total.bboxMax, info.bboxMax);
+    total.colorMax = std::max(total.colorMax, info.colorMax);
+    total.failed   = total.failed || info.failed;
+  }
+  input.close();
+
+  if(!success || total.failed)
+  {
+    output.close();
+    remove(particleFilename);
+    return false;
+  }
+
+  if(particleSize <= 0)
+  {
+    // neighbouring spheres just touch
+    particleSize = estimateSpacing(cloud, total.bboxMin, total.bboxMax) * 0.5f;
+  }
+
+  // text colors come as 0-1, 0-255 or 16 bit as in LAS
+  float colorScale = total.colorMax > 255.0f ? 1.0f / 65535.0f : total.colorMax > 1.0f ? 1.0f / 255.0f : 1.0f;
+  const size_t chunkSize = 256 * 1024;
+  parallelChunks((cloud.count + chunkSize - 1) / chunkSize, [&](size_t chunk) {
+    size_t end = std::min(cloud.count, (chunk + 1) * chunkSize);
+    for(size_t p = chunk * chunkSize; p < end; p++)
+    {
+      Particle& particle = cloud.particles[p];
+      particle.posSize.w = particleSize;
+      particle.color     = glm::vec4(glm::min(glm::vec3(particle.color) * colorScale, 1.0f), 1.0f);
+    }
+  });
+
+  ParticleFileHeader& header = *(ParticleFileHeader*)output.getData();
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, PARTICLEFILE_MAGIC, sizeof(header.magic));
+  header.version        = PARTICLEFILE_VERSION;
+  header.particleStride = sizeof(Particle);
+  header.particleCount  = cloud.count;
+  header.particleSize   = particleSize;
+  header.sizeMin        = particleSize;
+  header.sizeMax        = particleSize;
+  memcpy(header.bboxMin, &total.bboxMin.x, sizeof(header.bboxMin));
+  memcpy(header.bboxMax, &total.bboxMax.x, sizeof(header.bboxMax));
+
+  output.close();
+
+  LOGI("pointcloud: imported %zu points%s from \"%s\" to \"%s\", particle size %g\n", cloud.count,
+       cloud.hasColor ? " with colors" : "", filename, particleFilename, particleSize);
+  if(cloud.origin[0] != 0 || cloud.origin[1] != 0 || cloud.origin[2] != 0)
+  {
+    LOGI("pointcloud: positions are relative to %.3f %.3f %.3f\n", cloud.origin[0], cloud.origin[1], cloud.origin[2]);
+  }
+  return true;
+}
+
+}  // namespace dynlod
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+namespace dynlod {
+
+// Converts point clouds into particle files (particlefile.hpp), which are
+// then streamed like any other particle file. The format is chosen by the
+// file extension:
+//
+//   .ply                   binary little endian PLY, the x,y,z and optional
+//                          red,green,blue properties of the vertex element
+//   .csv                   text with a header line naming the x,y,z and
+//                          optional red,green,blue or intensity columns
+//   .xyz .txt .pts .asc    text lines "x y z [intensity] [r g b]", as LAS
+//                          files are exported by most scan tools
+//
+// Input and output are memory mapped, the points are parsed in chunks on all
+// hardware threads directly into the output records. Far away coordinates
+// are shifted to the first point, so they keep float precision.
+// A particleSize <= 0 is derived from the point spacing.
+
+bool importPointCloud(const char* filename, const char* particleFilename, float particleSize);
+
+}  // namespace dynlod
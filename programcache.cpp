@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "programcache.hpp"
+
+#include <nvh/nvprint.hpp>
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+namespace dynlod {
+
+// File layout:
+//
+//   CacheHeader
+//   per binary: CacheEntry, followed by CacheEntry::size bytes
+
+#define PROGRAMCACHE_MAGIC "DYNLODB"
+#define PROGRAMCACHE_VERSION 1
+
+struct CacheHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t count;
+  uint64_t driverHash;
+};
+
+struct CacheEntry
+{
+  uint64_t key;
+  uint32_t format;
+  uint32_t size;
+};
+
+// 64 bit FNV-1a
+static uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+  const uint8_t* bytes = (const uint8_t*)data;
+  for(size_t i = 0; i < size; i++)
+  {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+void ProgramCache::init(const std::string& cacheFilename)
+{
+  m_filename = cacheFilename;
+  m_dirty    = false;
+  m_binaries.clear();
+
+  GLint numFormats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+  m_binarySupported = numFormats > 0;
+  if(!m_binarySupported)
+  {
+    LOGI("programcache: driver has no program binary formats, programs are compiled every start\n");
+    return;
+  }
+
+  // a driver update invalidates all binaries
+  m_driverHash = hashBytes(nullptr, 0);
+  for(GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+  {
+    const char* str = (const char*)glGetString(name);
+    m_driverHash    = str ? hashBytes(str, strlen(str) + 1, m_driverHash) : m_driverHash;
+  }
+
+  FILE* file = m_filename.empty() ? nullptr : fopen(m_filename.c_str(), "rb");
+  if(!file)
+  {
+    return;
+  }
+
+  CacheHeader header;
+  bool        valid = fread(&header, sizeof(header), 1, file) == 1
+               && strncmp(header.magic, PROGRAMCACHE_MAGIC, sizeof(header.magic)) == 0
+               && header.version == PROGRAMCACHE_VERSION && header.driverHash == m_driverHash;
+
+  for(uint32_t i = 0; valid && i < header.count; i++)
+  {
+    CacheEntry entry;
+    Binary     binary;
+    valid = fread(&entry, sizeof(entry), 1, file) == 1;
+    if(valid)
+    {
+      binary.format = entry.format;
+      binary.data.resize(entry.size);
+      valid = entry.size == 0 || fread(binary.data.data(), entry.size, 1, file) == 1;
+    }
+    if(valid)
+    {
+      m_binaries[entry.key] = std::move(binary);
+    }
+  }
+  fclose(file);
+
+  if(!valid)
+  {
+    LOGI("programcache: \"%s\" is outdated and will be rewritten\n", m_filename.c_str());
+    m_binaries.clear();
+    m_dirty = true;
+  }
+}
+
+void ProgramCache::deinit()
+{
+  deletePrograms();
+  m_binaries.clear();
+}
+
+void ProgramCache::deletePrograms()
+{
+  for(auto& it : m_programs)
+  {
+    glDeleteProgram(it.second);
+  }
+  m_programs.clear();
+  m_loaded   = 0;
+  m_compiled = 0;
+}
+
+GLuint ProgramCache::createProgram(const std::vector<Definition>& definitions)
+{
+  // the key covers the preprocessed sources including all includes and defines
+  std::vector<std::string> sources;
+  uint64_t                 key = m_driverHash;
+  for(const Definition& definition : definitions)
+  {
+    std::string filenameFound;
+    std::string source = manualInclude(definition.filename, filenameFound, m_prepend + definition.prepend, false);
+    if(source.empty())
+    {
+      LOGE("programcache: could not find \"%s\"\n", definition.filename.c_str());
+      return 0;
+    }
+    key = hashBytes(&definition.type, sizeof(definition.type), key);
+    key = hashBytes(source.data(), source.size(), key);
+    sources.push_back(std::move(source));
+  }
+
+  auto existing = m_programs.find(key);
+  if(existing != m_programs.end())
+  {
+    return existing->second;
+  }
+
+  auto cached = m_binaries.find(key);
+  if(m_binarySupported && cached != m_binaries.end())
+  {
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, cached->second.format, cached->second.data.data(), GLsizei(cached->second.data.size()));
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(linked)
+    {
+      m_programs[key] = program;
+      m_loaded++;
+      return program;
+    }
+
+    // rejected by the driver, compile again
+    glDeleteProgram(program);
+    m_binaries.erase(cached);
+  }
+
+  GLuint program = compileProgram(definitions, sources);
+  if(!program)
+  {
+    return 0;
+  }
+  m_programs[key] = program;
+  m_compiled++;
+
+  if(m_binarySupported)
+  {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    Binary binary;
+    binary.data.resize(size_t(length));
+    glGetProgramBinary(program, length, nullptr, &binary.format, binary.data.data());
+    m_binaries[key] = std::move(binary);
+    m_dirty         = true;
+  }
+
+  return program;
+}
+
+GLuint ProgramCache::createProgram(const Definition& def0, const Definition& def1, const Definition& def2, const Definition& def3)
+{
+  std::vector<Definition> definitions;
+  for(const Definition* definition : {&def0, &def1, &def2, &def3})
+  {
+    if(definition->type)
+    {
+      definitions.push_back(*definition);
+    }
+  }
+  return createProgram(definitions);
+}
+
+GLuint ProgramCache::compileProgram(const std::vector<Definition>& definitions, const std::vector<std::string>& sources)
+{
+  GLuint program = glCreateProgram();
+  glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+  bool                valid = true;
+  std::vector<GLuint> shaders;
+  for(size_t i = 0; i < definitions.size(); i++)
+  {
+    const char* source = sources[i].c_str();
+    GLuint      shader = glCreateShader(definitions[i].type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if(!compiled)
+    {
+      GLint length = 0;
+      glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+      std::string log(size_t(std::max(length, 1)), '\0');
+      glGetShaderInfoLog(shader, length, nullptr, &log[0]);
+      LOGE("programcache: \"%s\" failed to compile:\n%s\n", definitions[i].filename.c_str(), log.c_str());
+      valid = false;
+    }
+    glAttachShader(program, shader);
+    shaders.push_back(shader);
+  }
+
+  if(valid)
+  {
+    glLinkProgram(program);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if(!linked)
+    {
+      GLint length = 0;
+      glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+      std::string log(size_t(std::max(length, 1)), '\0');
+      glGetProgramInfoLog(program, length, nullptr, &log[0]);
+      LOGE("programcache: \"%s\" failed to link:\n%s\n", definitions[0].filename.c_str(), log.c_str());
+      valid = false;
+    }
+  }
+
+  for(GLuint shader : shaders)
+  {
+    glDetachShader(program, shader);
+    glDeleteShader(shader);
+  }
+  if(!valid)
+  {
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+void ProgramCache::save()
+{
+  if(!m_binarySupported || !m_dirty || m_filename.empty())
+  {
+    return;
+  }
+
+  FILE* file = fopen(m_filename.c_str(), "wb");
+  if(!file)
+  {
+    LOGE("programcache: could not create \"%s\"\n", m_filename.c_str());
+    return;
+  }
+
+  uint32_t count = 0;
+  for(const auto& it : m_binaries)
+  {
+    count += m_programs.count(it.first) ? 1 : 0;
+  }
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, PROGRAMCACHE_MAGIC, sizeof(header.magic));
+  header.version    = PROGRAMCACHE_VERSION;
+  header.count      = count;
+  header.driverHash = m_driverHash;
+
+  bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+  for(const auto& it : m_binaries)
+  {
+    if(!m_programs.count(it.first))
+      continue;
+
+    CacheEntry entry;
+    entry.key    = it.first;
+    entry.format = it.second.format;
+    entry.size   = uint32_t(it.second.data.size());
+    success      = success && fwrite(&entry, sizeof(entry), 1, file) == 1;
+    success      = success && (entry.size == 0 || fwrite(it.second.data.data(), entry.size, 1, file) == 1);
+  }
+  success = fclose(file) == 0 && success;
+
+  if(success)
+  {
+    LOGI("programcache: wrote %u binaries to \"%s\"\n", count, m_filename.c_str());
+    m_dirty = false;
+  }
+  else
+  {
+    LOGE("programcache: could not write \"%s\"\n", m_filename.c_str());
+  }
+}
+
+}  // namespace dynlod
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <nvgl/extensions_gl.hpp>
+#include <nvh/shaderfilemanager.hpp>
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dynlod {
+
+// Builds programs from GLSL files like nvgl::ProgramManager (directories,
+// registered includes and m_prepend work the same), but keeps the linked
+// binaries of glGetProgramBinary in one file on disk. Entries are keyed by
+// a hash of the preprocessed sources and the driver strings, so edited
+// shaders or a driver update compile again while everything else links
+// from the cache. Programs whose sources are identical share one GL program.
+
+class ProgramCache : public nvh::ShaderFileManager
+{
+public:
+  struct Definition
+  {
+    Definition() {}
+    Definition(GLenum type_, const std::string& filename_)
+        : type(type_)
+        , filename(filename_)
+    {
+    }
+    Definition(GLenum type_, const std::string& prepend_, const std::string& filename_)
+        : type(type_)
+        , prepend(prepend_)
+        , filename(filename_)
+    {
+    }
+
+    GLenum      type = 0;
+    std::string prepend;
+    std::string filename;
+  };
+
+  // requires a current context, an empty filename only caches in memory
+  void init(const std::string& cacheFilename);
+  void deinit();
+
+  // returns 0 if a file is missing or compilation fails
+  GLuint createProgram(const std::vector<Definition>& definitions);
+  GLuint createProgram(const Definition& def0,
+                       const Definition& def1 = Definition(),
+                       const Definition& def2 = Definition(),
+                       const Definition& def3 = Definition());
+
+  // deletes all programs, so that the next createProgram calls read the
+  // sources again. Binaries stay cached.
+  void deletePrograms();
+
+  // writes the binaries of the current programs if any were added, the
+  // ones of outdated sources are dropped
+  void save();
+
+  uint32_t getLoaded() const { return m_loaded; }
+  uint32_t getCompiled() const { return m_compiled; }
+
+private:
+  struct Binary
+  {
+    GLenum               format;
+    std::vector<uint8_t> data;
+  };
+
+  GLuint compileProgram(const std::vector<Definition>& definitions, const std::vector<std::string>& sources);
+
+  std::string m_filename;
+  bool        m_binarySupported = false;
+  bool        m_dirty           = false;
+  uint64_t    m_driverHash      = 0;
+  uint32_t    m_loaded          = 0;
+  uint32_t    m_compiled        = 0;
+
+  std::unordered_map<uint64_t, Binary> m_binaries;
+  std::unordered_map<uint64_t, GLuint> m_programs;
+};
+
+}  // namespace dynlod
@@ -23,18 +23,24 @@
 /**/
 
 #extension GL_ARB_shading_language_include : enable
+#if USE_BASEINSTANCE
+#extension GL_ARB_shader_draw_parameters : require
+#endif
 #include "common.h"
 
 in layout(location=VERTEX_POS)      vec3 offsetPos;
 
 layout(binding=TEX_PARTICLEINDICES) uniform isamplerBuffer  texParticleIndices;
-layout(binding=TEX_PARTICLES)       uniform samplerBuffer   texParticles;
+layout(binding=TEX_PARTICLES)       uniform ParticleSampler texParticles;
 
 layout(binding=UBO_CMDS,std140) uniform prevCmdBuffer {
   DrawIndirects  cmd;
 };
 
 layout(location=UNI_USE_CMDOFFSET) uniform int useCmdOffset;
+layout(location=UNI_LOD_LEVEL)     uniform int lodLevel;
+layout(location=UNI_BATCH_SIZE)    uniform int batchSize;
+layout(location=UNI_MESH_VERTICES) uniform int meshVertices;
 
 out Interpolants {
   vec3  normal;
@@ -43,21 +49,25 @@ out Interpolants {
 
 void main()
 {
-  int     particle = (gl_VertexID/PARTICLE_BASICVERTICES) + gl_InstanceID * PARTICLE_BATCHSIZE;
-  particle += useCmdOffset * (int(cmd.medFull.instanceCount) * (int(cmd.medFull.count)/PARTICLE_BASICINDICES));
+  int     particle = (gl_VertexID/meshVertices) + gl_InstanceID * batchSize;
+#if USE_BASEINSTANCE
+  // multi draw: baseInstance holds the start within the lists
+  particle += gl_BaseInstanceARB;
+#else
+  particle += useCmdOffset * (int(cmd.levelFull[lodLevel].instanceCount) * batchSize);
+#endif
   
 #if USE_INDICES
   particle = texelFetch(texParticleIndices, particle).r;
+  if (particle == PARTICLE_INVALID) {
+    gl_Position = PARTICLE_CLIPPED;
+    return;
+  }
 #endif
   
-#if USE_COMPACT_PARTICLE
-  vec4    inPosColor = texelFetch(texParticles, particle);
-  vec4    inPosSize  = vec4(inPosColor.xyz, scene.particleSize);
-  vec4    inColor    = unpackUnorm4x8(floatBitsToUint(inPosColor.w));
-#else
-  vec4    inPosSize = texelFetch(texParticles, particle*2 + 0);
-  vec4    inColor   = texelFetch(texParticles, particle*2 + 1);
-#endif
+  vec4    inPosSize;
+  vec4    inColor;
+  decodeParticle(fetchParticle(texParticles, particle), inPosSize, inColor);
   vec3    pos = offsetPos * inPosSize.w + inPosSize.xyz;
 
   gl_Position = scene.viewProjMatrix * vec4(pos,1);
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+
+#version 430
+/**/
+
+#extension GL_ARB_shading_language_include : enable
+#include "common.h"
+
+in Interpolants {
+  flat vec4 posSize;
+  flat vec4 color;
+} IN;
+
+layout(location=0,index=0) out vec4 out_Color;
+// the hit is never in front of the sprite, which keeps early depth
+// testing against the rasterized depth
+layout(depth_greater) out float gl_FragDepth;
+
+void main()
+{
+  // view ray through the pixel
+  vec2  ndc     = gl_FragCoord.xy / vec2(scene.viewport) * 2.0 - 1.0;
+  vec4  wNear   = scene.viewProjMatrixI * vec4(ndc, 0.0, 1.0);
+  vec4  wFar    = scene.viewProjMatrixI * vec4(ndc, 1.0, 1.0);
+  vec3  origin  = wNear.xyz / wNear.w;
+  vec3  dir     = normalize(wFar.xyz / wFar.w - origin);
+  
+  vec3  center  = IN.posSize.xyz;
+  float radius  = IN.posSize.w;
+  vec3  oc      = origin - center;
+  float b       = dot(oc, dir);
+  float c       = dot(oc, oc) - radius * radius;
+  float h       = b * b - c;
+  if (h < 0.0) discard;
+  
+  vec3  hit     = origin + dir * (-b - sqrt(h));
+  vec4  hPos    = scene.viewProjMatrix * vec4(hit, 1);
+  
+  // default depth range, window depth = ndc * 0.5 + 0.5
+  gl_FragDepth  = (hPos.z / hPos.w) * 0.5 + 0.5;
+  out_Color     = IN.color * shade(hit - center);
+}
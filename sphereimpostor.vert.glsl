@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2014-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2014-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+
+#version 430
+/**/
+
+#extension GL_ARB_shading_language_include : enable
+#if USE_BASEINSTANCE
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+#include "common.h"
+
+// impostor level, drawn like a mesh level with one vertex per particle
+// as point sprite, sphere.frag.glsl is replaced by an exact ray cast
+
+layout(binding=TEX_PARTICLEINDICES) uniform isamplerBuffer  texParticleIndices;
+layout(binding=TEX_PARTICLES)       uniform ParticleSampler texParticles;
+
+layout(binding=UBO_CMDS,std140) uniform prevCmdBuffer {
+  DrawIndirects  cmd;
+};
+
+layout(location=UNI_USE_CMDOFFSET) uniform int useCmdOffset;
+layout(location=UNI_LOD_LEVEL)     uniform int lodLevel;
+layout(location=UNI_BATCH_SIZE)    uniform int batchSize;
+
+out Interpolants {
+  flat vec4 posSize;
+  flat vec4 color;
+} OUT;
+
+void main()
+{
+  int     particle = gl_VertexID + gl_InstanceID * batchSize;
+#if USE_BASEINSTANCE
+  particle += gl_BaseInstanceARB;
+#else
+  particle += useCmdOffset * (int(cmd.levelFull[lodLevel].instanceCount) * batchSize);
+#endif
+  
+#if USE_INDICES
+  particle = texelFetch(texParticleIndices, particle).r;
+  if (particle == PARTICLE_INVALID) {
+    gl_Position = PARTICLE_CLIPPED;
+    return;
+  }
+#endif
+  
+  vec4    inPosSize;
+  vec4    inColor;
+  decodeParticle(fetchParticle(texParticles, particle), inPosSize, inColor);
+  
+  vec3  eyePos  = vec3(scene.viewMatrixIT[0].w,scene.viewMatrixIT[1].w,scene.viewMatrixIT[2].w);
+  float dist    = length(eyePos - inPosSize.xyz);
+  float size    = inPosSize.w;
+  
+  // the sprite gets the depth of the sphere's front most plane (hPos.w
+  // is the distance along the view direction), so the ray cast depth is
+  // never smaller than the rasterized one
+  vec3  wRow    = vec3(scene.viewProjMatrix[0].w, scene.viewProjMatrix[1].w, scene.viewProjMatrix[2].w);
+  vec4  hCenter = scene.viewProjMatrix * vec4(inPosSize.xyz,1);
+  vec4  hNear   = scene.viewProjMatrix * vec4(inPosSize.xyz - wRow * size,1);
+  
+  // the silhouette's radius grows with dist / w off-axis, (1 + size / w)
+  // covers the shift of its center relative to the projected center
+  float w       = hCenter.w;
+  vec2  radius  = size * scene.viewpixelsize * dist / max(w * w - size * size, 1e-6) * (1.0 + size / w);
+  
+  gl_Position   = vec4(hCenter.xy * (hNear.w / w), hNear.zw);
+  gl_PointSize  = 2.0 * max(radius.x, radius.y) + 2.0;
+  
+  OUT.posSize = inPosSize;
+  OUT.color   = inColor;
+}
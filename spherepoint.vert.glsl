@@ -23,24 +23,14 @@
 /**/
 
 #extension GL_ARB_shading_language_include : enable
+#if !USE_INDICES
+#define USE_PARTICLE_ATTRIBS 1
+#endif
 #include "common.h"
 
 #if USE_INDICES
   layout(binding=TEX_PARTICLEINDICES) uniform isamplerBuffer  texParticleIndices;
-  layout(binding=TEX_PARTICLES)       uniform samplerBuffer   texParticles;
-  
-  int particle = texelFetch(texParticleIndices, gl_VertexID).x;
-#if USE_COMPACT_PARTICLE
-  vec4 inPosColor = texelFetch(texParticles, particle);
-  vec4 inPosSize  = vec4(inPosColor.xyz, scene.particleSize);
-  vec4 inColor    = unpackUnorm4x8(floatBitsToUint(inPosColor.w));
-#else
-  vec4 inPosSize  = texelFetch(texParticles, particle*2 + 0);
-  vec4 inColor    = texelFetch(texParticles, particle*2 + 1);
-#endif
-#else
-  in layout(location=VERTEX_POS)    vec4 inPosSize;
-  in layout(location=VERTEX_COLOR)  vec4 inColor;
+  layout(binding=TEX_PARTICLES)       uniform ParticleSampler texParticles;
 #endif
 
 out Interpolants {
@@ -49,12 +39,21 @@ out Interpolants {
 
 void main()
 {
-#if USE_COMPACT_PARTICLE
-  float size = scene.particleSize;
+  vec4 inPosSize;
+  vec4 inColor;
+#if USE_INDICES
+  int particle = texelFetch(texParticleIndices, gl_VertexID).x;
+  if (particle == PARTICLE_INVALID) {
+    gl_Position = PARTICLE_CLIPPED;
+    return;
+  }
+  decodeParticle(fetchParticle(texParticles, particle), inPosSize, inColor);
 #else
-  float size = inPosSize.w;
+  decodeParticle(loadParticleAttribs(), inPosSize, inColor);
 #endif
 
+  float size = inPosSize.w;
+
   vec4 hPos = scene.viewProjMatrix * vec4(inPosSize.xyz,1);
   vec2 pixelsize = 2.0 * size * scene.viewpixelsize / hPos.w;
   
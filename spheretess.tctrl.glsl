@@ -28,7 +28,7 @@
 layout(vertices = 4) out;
 
 layout(binding=TEX_PARTICLEINDICES) uniform isamplerBuffer  texParticleIndices;
-layout(binding=TEX_PARTICLES)       uniform samplerBuffer   texParticles;
+layout(binding=TEX_PARTICLES)       uniform ParticleSampler texParticles;
 
 
 in Data {
@@ -41,12 +41,8 @@ out Data {
 } OUT[];
 
 patch out PerPatch {
-#if USE_COMPACT_PARTICLE
-  vec4  posColor;
-#else
   vec4  posSize;
   vec4  color;
-#endif
 }OUTpatch;
 
 void main()
@@ -55,25 +51,27 @@ void main()
   
 #if USE_INDICES
   particle = texelFetch(texParticleIndices, particle).r ;
+  // a zero outer level discards the patch
+  if (particle == PARTICLE_INVALID) {
+    if (gl_InvocationID == 0){
+      gl_TessLevelInner[0] = 0.0;
+      gl_TessLevelOuter[0] = 0.0;
+      gl_TessLevelOuter[1] = 0.0;
+      gl_TessLevelOuter[2] = 0.0;
+    }
+    return;
+  }
 #endif
   
-#if USE_COMPACT_PARTICLE
-  vec4    inPosColor = texelFetch(texParticles, particle);
-#else
-  vec4    inPosSize = texelFetch(texParticles, particle*2 + 0);
-  vec4    inColor   = texelFetch(texParticles, particle*2 + 1);
-#endif
+  vec4    inPosSize;
+  vec4    inColor;
+  decodeParticle(fetchParticle(texParticles, particle), inPosSize, inColor);
 
   OUT[gl_InvocationID].pos = IN[gl_InvocationID].offsetPos;
   
   if (gl_InvocationID == 0){
-#if USE_COMPACT_PARTICLE
-    OUTpatch.posColor = inPosColor;
-    vec4 inPosSize = vec4(inPosColor.xyz, scene.particleSize);
-#else
     OUTpatch.posSize = inPosSize;
     OUTpatch.color   = inColor;
-#endif
     vec4 hPos = scene.viewProjMatrix * vec4(inPosSize.xyz,1);
     vec2 pixelsize = 2.0 * inPosSize.w * scene.viewpixelsize / hPos.w;
     
@@ -23,6 +23,9 @@
 /**/
 
 #extension GL_ARB_shading_language_include : enable
+#if USE_BASEINSTANCE
+#extension GL_ARB_shader_draw_parameters : require
+#endif
 #include "common.h"
 
 in layout(location=VERTEX_POS)      vec3 offsetPos;
@@ -32,6 +35,8 @@ layout(binding=UBO_CMDS,std140) uniform prevCmdBuffer {
 };
 
 layout(location=UNI_USE_CMDOFFSET) uniform int useCmdOffset;
+layout(location=UNI_LOD_LEVEL)     uniform int lodLevel;
+layout(location=UNI_BATCH_SIZE)    uniform int batchSize;
 
 out Data {
   vec3  offsetPos;
@@ -40,8 +45,13 @@ out Data {
 
 void main()
 {
-  int  particle = (gl_VertexID/PARTICLE_BASICVERTICES) + gl_InstanceID * PARTICLE_BATCHSIZE;
-  particle += useCmdOffset * (int(cmd.nearFull.instanceCount * (cmd.nearFull.count/PARTICLE_BASICINDICES)));
+  int  particle = (gl_VertexID/PARTICLE_BASICVERTICES) + gl_InstanceID * batchSize;
+#if USE_BASEINSTANCE
+  // multi draw: baseInstance holds the start within the lists
+  particle += gl_BaseInstanceARB;
+#else
+  particle += useCmdOffset * (int(cmd.levelFull[lodLevel].instanceCount) * batchSize);
+#endif
   
   OUT.offsetPos = offsetPos;
   OUT.particle  = particle;